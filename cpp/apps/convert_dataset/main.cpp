@@ -0,0 +1,37 @@
+#include <data/dataset.h>
+#include <data/load_data.h>
+#include <data/dataset_binary.h>
+#include <data/grid_builder.h>
+#include <data/binarized_dataset.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+//convert_dataset features.txt dataset.bin [bordersCount [maxGroupSize]]
+//with bordersCount grid and bins are stored too, so training skips binarization
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " features.txt dataset.bin [bordersCount [maxGroupSize]]" << std::endl;
+        return 1;
+    }
+    auto start = std::chrono::system_clock::now();
+
+    auto ds = loadFeaturesTxt(argv[1]);
+
+    if (argc > 3) {
+        BinarizationConfig config;
+        config.bordersCount_ = std::stoi(argv[3]);
+        const int32_t maxGroupSize = argc > 4 ? std::stoi(argv[4]) : 16;
+        auto grid = buildGrid(ds, config);
+        const auto& bds = cachedBinarize(ds, grid, maxGroupSize);
+        saveDataSetBinary(ds, argv[2], &bds);
+    } else {
+        saveDataSetBinary(ds, argv[2]);
+    }
+
+    std::cout << "converted in "
+              << std::chrono::duration<double>(std::chrono::system_clock::now() - start).count()
+              << std::endl;
+    return 0;
+}
@@ -164,7 +164,7 @@ void Cifar10EM::LinearTreesOptimizer::train(TensorPairDataset& trainTpds, Tensor
 
     LinearTreesBooster booster(opts_);
     auto ensemble = booster.fitFrom(prevEnsemble_, trainDs, valDs);
-    auto polynom = std::make_shared<Polynom>(LinearTreesToPolynom(*std::dynamic_pointer_cast<Ensemble>(ensemble)));
+    auto polynom = std::make_shared<Polynom>(LinearTreesToPolynom(*std::dynamic_pointer_cast<Ensemble>(ensemble), opts_.polynomPruning));
     polynomModel->reset(polynom);
 
     prevEnsemble_ = std::move(std::dynamic_pointer_cast<Ensemble>(ensemble));
@@ -8,12 +8,14 @@
 #include <methods/greedy_linear_oblivious_trees.h>
 #include <util/json.h>
 #include <data/grid_builder.h>
+#include <models/model_binary.h>
+#include <util/exception.h>
 
 int main(int /*argc*/, char* argv[]) {
     auto params = readJson(argv[1]);
     torch::set_num_threads(params.value("num_threads", std::thread::hardware_concurrency()));
 
-    auto ds = loadFeaturesTxt(params.value("dataset", "featuresTest.txt"));
+    auto ds = loadDataSet(params.value("dataset", "featuresTest.txt"));
 
     // This is required at the moment
     ds.addBiasColumn();
@@ -26,11 +28,17 @@ int main(int /*argc*/, char* argv[]) {
     }
 
     std::string checkpoint_path = params["checkpoint_from_file"];
-    std::ifstream fin(checkpoint_path, std::ios::binary);
-    std::shared_ptr<Ensemble> ensemble = Ensemble::deserialize(fin, [&](GridPtr grid) {
-        return LinearObliviousTree::deserialize(fin, std::move(grid));
-    });
-    fin.close();
+    std::shared_ptr<Ensemble> ensemble;
+    if (isModelBinary(checkpoint_path)) {
+        ensemble = std::dynamic_pointer_cast<Ensemble>(loadModelBinary(checkpoint_path, params.value("verify_checksums", true)));
+        VERIFY(ensemble, "Checkpoint " << checkpoint_path << " is not an ensemble");
+    } else {
+        std::ifstream fin(checkpoint_path, std::ios::binary);
+        ensemble = Ensemble::deserialize(fin, [&](GridPtr grid) {
+            return LinearObliviousTree::deserialize(fin, std::move(grid));
+        });
+        fin.close();
+    }
 
     std::cout << "restored an ensemble of size " << ensemble->size() << std::endl;
 
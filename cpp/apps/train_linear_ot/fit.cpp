@@ -10,6 +10,7 @@
 #include <targets/cross_entropy.h>
 #include <util/json.h>
 #include <methods/linear_trees_booster.h>
+#include <models/model_binary.h>
 
 inline std::unique_ptr<GreedyLinearObliviousTreeLearner> createWeakLearner(GridPtr grid, GreedyLinearObliviousTreeLearnerOptions opts) {
     return std::make_unique<GreedyLinearObliviousTreeLearner>(grid, opts);
@@ -29,8 +30,8 @@ int main(int /*argc*/, char* argv[]) {
     auto params = readJson(argv[1]);
     torch::set_num_threads(params.value("num_threads", std::thread::hardware_concurrency()));
 
-    auto ds = loadFeaturesTxt(params.value("train", "features.txt"));
-    auto test = loadFeaturesTxt(params.value("test", "featuresTest.txt"));
+    auto ds = loadDataSet(params.value("train", "features.txt"));
+    auto test = loadDataSet(params.value("test", "featuresTest.txt"));
 
     if (params.value("normalize", false)) {
         Vec mu(ds.featuresCount());
@@ -68,19 +69,27 @@ int main(int /*argc*/, char* argv[]) {
     } else {
         VERIFY(false, "Unknown target " << target);
     }
+    if (opts.earlyStoppingOpts.patience > 0) {
+        metricsCalcer->setEarlyStopping(opts.earlyStoppingOpts.metric, opts.earlyStoppingOpts.patience, opts.earlyStoppingOpts.useBestModel);
+    }
     boosting.addListener(metricsCalcer);
 
     std::shared_ptr<Ensemble> oldEnsemble;
 
     std::string checkpointPath = params.value("checkpoint_from_file", "");
     if (checkpointPath.size()) {
-        std::ifstream in(checkpointPath, std::ios::binary);
-        if (in.good()) {
-            oldEnsemble = Ensemble::deserialize(in, [&in](GridPtr oldGrid) {
-                return LinearObliviousTree::deserialize(in, std::move(oldGrid));
-            });
+        if (isModelBinary(checkpointPath)) {
+            oldEnsemble = std::dynamic_pointer_cast<Ensemble>(loadModelBinary(checkpointPath));
+            VERIFY(oldEnsemble, "Checkpoint " << checkpointPath << " is not an ensemble");
+        } else {
+            std::ifstream in(checkpointPath, std::ios::binary);
+            if (in.good()) {
+                oldEnsemble = Ensemble::deserialize(in, [&in](GridPtr oldGrid) {
+                    return LinearObliviousTree::deserialize(in, std::move(oldGrid));
+                });
+            }
+            in.close();
         }
-        in.close();
     }
 
     std::unique_ptr<std::ofstream> out;
@@ -102,4 +111,8 @@ int main(int /*argc*/, char* argv[]) {
     if (out) {
         out->close();
     }
+
+    if (params.contains("save_binary_model_to")) {
+        saveModelBinary(ensemble, params["save_binary_model_to"]);
+    }
 }
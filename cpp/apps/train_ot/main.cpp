@@ -2,6 +2,7 @@
 
 #include <data/dataset.h>
 #include <data/load_data.h>
+#include <data/dataset_binary.h>
 
 #include <data/grid_builder.h>
 #include <models/oblivious_tree.h>
@@ -24,13 +25,17 @@ int main(int /*argc*/, char* /*argv*/[]) {
     torch::set_num_threads(32);
 //    auto ds = loadFeaturesTxt("/Users/noxoomo/Projects/moscow_learn_200k.tsv");
 //    auto test = loadFeaturesTxt("/Users/noxoomo/Projects/moscow_test.tsv");
-    auto ds = loadFeaturesTxt("train.tsv");
-    auto test = loadFeaturesTxt("test.tsv");
+    auto ds = loadDataSet("train.tsv");
+    auto test = loadDataSet("test.tsv");
 
     std::cout << " load data in memory " << std::endl;
-    BinarizationConfig config;
-    config.bordersCount_ = 128;
-    auto grid = buildGrid(ds, config);
+    //binary dataset could already contain grid and bins
+    GridPtr grid = isDataSetBinary("train.tsv") ? loadBinarizationBinary(ds, "train.tsv") : nullptr;
+    if (!grid) {
+        BinarizationConfig config;
+        config.bordersCount_ = 128;
+        grid = buildGrid(ds, config);
+    }
     std::cout << " build grid " << std::endl;
 
     BoostingConfig boostingConfig;
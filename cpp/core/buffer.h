@@ -1,6 +1,7 @@
 #pragma once
 
 #include "torch_helpers.h"
+#include "buffer_pool.h"
 #include <torch/torch.h>
 #include <util/array_ref.h>
 #include <utility>
@@ -11,9 +12,8 @@ namespace Detail {
     class TorchBufferTrait {
     public:
 
-        static torch::Tensor create(int64_t size) {
-            return torch::zeros({static_cast<int64_t>(size * sizeof(T))}, TorchHelpers::tensorOptionsOnDevice(CurrentDevice(),
-                                                                                                               torch::ScalarType::Byte));
+        static torch::Tensor create(int64_t size, bool zero = true) {
+            return createBufferTensor(torch::ScalarType::Byte, static_cast<int64_t>(size * sizeof(T)), zero);
         }
 
         static uint8_t* data(const torch::Tensor& tensor) {
@@ -32,9 +32,8 @@ namespace Detail {
     class TorchBufferTrait<float> {
     public:
 
-        static torch::Tensor create(int64_t size) {
-            return torch::zeros({static_cast<int64_t>(size)}, TorchHelpers::tensorOptionsOnDevice(CurrentDevice(),
-                                                                                                              torch::ScalarType::Float));
+        static torch::Tensor create(int64_t size, bool zero = true) {
+            return createBufferTensor(torch::ScalarType::Float, size, zero);
         }
 
         static float* data(const torch::Tensor& tensor) {
@@ -51,9 +50,8 @@ namespace Detail {
     class TorchBufferTrait<int> {
     public:
 
-        static torch::Tensor create(int64_t size) {
-            return torch::zeros({static_cast<int64_t>(size)}, TorchHelpers::tensorOptionsOnDevice(CurrentDevice(),
-                                                                                                  torch::ScalarType::Int));
+        static torch::Tensor create(int64_t size, bool zero = true) {
+            return createBufferTensor(torch::ScalarType::Int, size, zero);
         }
 
         static int* data(const torch::Tensor& tensor) {
@@ -70,7 +68,7 @@ template <class T>
 class Buffer  {
 public:
 
-    //TODO(noxoomo): should not clear memory  and this won't work with multiGPU
+    //TODO(noxoomo): this won't work with multiGPU
     explicit Buffer(int64_t size)
     : data_(Detail::TorchBufferTrait<T>::create(size)) {
 
@@ -102,6 +100,11 @@ public:
         return Buffer(Detail::TorchBufferTrait<T>::create(size));
     }
 
+    //memory is not cleared: use for scratch buffers, which are overwritten completely
+    static Buffer createUninitialized(int64_t size) {
+        return Buffer(Detail::TorchBufferTrait<T>::create(size, false));
+    }
+
     Buffer copy() const {
         return Buffer(data_.clone());
     }
@@ -115,6 +118,11 @@ public:
     }
 
 
+    //shares memory with tensor: it should hold size * sizeof(T) bytes of contiguous cpu memory
+    static Buffer fromTensor(torch::Tensor data) {
+        return Buffer(std::move(data));
+    }
+
     static Buffer fromVector(const std::vector<T>& vec) {
         Buffer x(static_cast<int64_t>(vec.size()));
         VecRef<T> dst = x.arrayRef();
@@ -0,0 +1,133 @@
+#include "buffer_pool.h"
+#include "torch_helpers.h"
+
+#include <util/singleton.h>
+#include <util/guard.h>
+
+#include <algorithm>
+#include <iterator>
+
+namespace {
+
+    int64_t bucketSize(int64_t elements) {
+        int64_t size = 64;
+        while (size < elements) {
+            size <<= 1;
+        }
+        return size;
+    }
+
+    thread_local int64_t bypassScopes = 0;
+
+}
+
+torch::Tensor BufferPool::allocateFromTorch(torch::ScalarType type, int64_t elements, bool zero) {
+    allocations_ += 1;
+    allocatedBytes_ += elements * static_cast<int64_t>(c10::elementSize(type));
+
+    const auto options = TorchHelpers::tensorOptionsOnDevice(CurrentDevice(), type);
+    return zero ? torch::zeros({elements}, options) : torch::empty({elements}, options);
+}
+
+torch::Tensor BufferPool::allocate(torch::ScalarType type, int64_t elements, bool zero) {
+    const int64_t bytes = elements * static_cast<int64_t>(c10::elementSize(type));
+    if (!enabled() || elements == 0 || bytes > MaxPooledBytes || BufferPoolBypass::active()
+        || CurrentDevice().deviceType() != ComputeDeviceType::Cpu) {
+        return allocateFromTorch(type, elements, zero);
+    }
+
+    const int64_t bucketElements = bucketSize(elements);
+    torch::Tensor result;
+
+    with_guard(lock_) {
+        auto& bucket = buckets_[std::make_pair(static_cast<int32_t>(type), bucketElements)];
+        for (auto& entry : bucket) {
+            if (entry.Tensor.storage().use_count() == 1) {
+                entry.Used = true;
+                result = entry.Tensor.narrow(0, 0, elements);
+                break;
+            }
+        }
+
+        if (result.defined()) {
+            poolHits_ += 1;
+            reusedBytes_ += bytes;
+        } else {
+            bucket.push_back({allocateFromTorch(type, bucketElements, false), true});
+            result = bucket.back().Tensor.narrow(0, 0, elements);
+        }
+    }
+
+    if (zero) {
+        result.zero_();
+    }
+    return result;
+}
+
+void BufferPool::releaseUnused() {
+    with_guard(lock_) {
+        for (auto bucket = buckets_.begin(); bucket != buckets_.end();) {
+            auto& entries = bucket->second;
+            entries.erase(std::remove_if(entries.begin(), entries.end(), [](const Entry& entry) {
+                return !entry.Used && entry.Tensor.storage().use_count() == 1;
+            }), entries.end());
+            for (auto& entry : entries) {
+                entry.Used = false;
+            }
+            bucket = entries.empty() ? buckets_.erase(bucket) : std::next(bucket);
+        }
+    }
+}
+
+void BufferPool::clear() {
+    with_guard(lock_) {
+        buckets_.clear();
+    }
+}
+
+BufferAllocationStats BufferPool::stats() const {
+    BufferAllocationStats stats;
+    stats.Allocations = allocations_.load();
+    stats.AllocatedBytes = allocatedBytes_.load();
+    stats.PoolHits = poolHits_.load();
+    stats.ReusedBytes = reusedBytes_.load();
+    return stats;
+}
+
+void BufferPool::resetStats() {
+    allocations_ = 0;
+    allocatedBytes_ = 0;
+    poolHits_ = 0;
+    reusedBytes_ = 0;
+}
+
+BufferPool& GlobalBufferPool() {
+    return Singleton<BufferPool>();
+}
+
+BufferPoolScope::BufferPoolScope() {
+    GlobalBufferPool().scopes_ += 1;
+}
+
+BufferPoolScope::~BufferPoolScope() {
+    auto& pool = GlobalBufferPool();
+    if (--pool.scopes_ == 0) {
+        pool.clear();
+    }
+}
+
+BufferPoolBypass::BufferPoolBypass() {
+    ++bypassScopes;
+}
+
+BufferPoolBypass::~BufferPoolBypass() {
+    --bypassScopes;
+}
+
+bool BufferPoolBypass::active() {
+    return bypassScopes > 0;
+}
+
+torch::Tensor Detail::createBufferTensor(torch::ScalarType type, int64_t elements, bool zero) {
+    return GlobalBufferPool().allocate(type, elements, zero);
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <torch/torch.h>
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+struct BufferAllocationStats {
+    //memory requested from torch
+    int64_t Allocations = 0;
+    int64_t AllocatedBytes = 0;
+    //requests served from pool
+    int64_t PoolHits = 0;
+    int64_t ReusedBytes = 0;
+};
+
+/*
+ * Size-bucketed pool of cpu tensors for Buffer scratch memory.
+ * Pool is used only while some BufferPoolScope is alive. Tensor is reused once nobody except pool references its storage.
+ * Large requests and requests made under BufferPoolBypass are served by torch with exact size
+ */
+class BufferPool {
+public:
+    //buckets are powers of two, so big buffers could waste up to 2x memory: they are not pooled
+    static constexpr int64_t MaxPooledBytes = 64ll << 20;
+
+    torch::Tensor allocate(torch::ScalarType type, int64_t elements, bool zero);
+
+    //drop cached tensors, which are free now and were not handed out since previous call
+    void releaseUnused();
+
+    //forget all tensors: used ones are freed by their owners, unused ones are freed right now
+    void clear();
+
+    bool enabled() const {
+        return scopes_.load() > 0;
+    }
+
+    BufferAllocationStats stats() const;
+
+    void resetStats();
+
+private:
+    struct Entry {
+        torch::Tensor Tensor;
+        bool Used = true;
+    };
+
+    torch::Tensor allocateFromTorch(torch::ScalarType type, int64_t elements, bool zero);
+
+    friend class BufferPoolScope;
+
+private:
+    std::mutex lock_;
+    std::map<std::pair<int32_t, int64_t>, std::vector<Entry>> buckets_;
+    std::atomic<int64_t> scopes_{0};
+
+    std::atomic<int64_t> allocations_{0};
+    std::atomic<int64_t> allocatedBytes_{0};
+    std::atomic<int64_t> poolHits_{0};
+    std::atomic<int64_t> reusedBytes_{0};
+};
+
+BufferPool& GlobalBufferPool();
+
+//buffers created inside scope are taken from pool, on exit of outermost scope pool is cleared
+class BufferPoolScope {
+public:
+    BufferPoolScope();
+
+    ~BufferPoolScope();
+
+    BufferPoolScope(const BufferPoolScope&) = delete;
+    BufferPoolScope& operator=(const BufferPoolScope&) = delete;
+};
+
+//buffers created inside scope by current thread bypass pool: for long-lived data, which should be allocated with exact size
+class BufferPoolBypass {
+public:
+    BufferPoolBypass();
+
+    ~BufferPoolBypass();
+
+    BufferPoolBypass(const BufferPoolBypass&) = delete;
+    BufferPoolBypass& operator=(const BufferPoolBypass&) = delete;
+
+    static bool active();
+};
+
+namespace Detail {
+    torch::Tensor createBufferTensor(torch::ScalarType type, int64_t elements, bool zero);
+}
@@ -3,26 +3,66 @@
 #include "object.h"
 #include <memory>
 #include <functional>
+#include <future>
 #include <map>
+#include <mutex>
+#include <unordered_map>
 
 template <class T>
 class CacheHolder {
 public:
+    CacheHolder() = default;
 
+    CacheHolder(CacheHolder&& other)
+        : cache_(std::move(other.cache_)) {
+
+    }
+
+    CacheHolder& operator=(CacheHolder&& other) {
+        cache_ = std::move(other.cache_);
+        return *this;
+    }
+
+    //could be called from several threads (e.g. learner and async boosting listeners). Concurrent callers for the same
+    //source wait for single build; builder runs without lock, so it can use cache for other sources
     template <class From, class To, class Builder>
     const To& computeOrGet(std::shared_ptr<From> source, Builder&& builder) const {
         int64_t weakSource = source->uuid();// std::static_pointer_cast<Object>(source);
-        if (!cache_.count(weakSource)) {
-            cache_[weakSource] = std::unique_ptr<Object>(builder(*static_cast<const T*>(this), source).release());
+        std::promise<std::shared_ptr<Object>> promise;
+        std::shared_future<std::shared_ptr<Object>> value;
+        bool buildHere = false;
+        {
+            std::lock_guard<std::mutex> guard(cacheLock_);
+            auto it = cache_.find(weakSource);
+            if (it != cache_.end()) {
+                value = it->second;
+            } else {
+                value = promise.get_future().share();
+                cache_.emplace(weakSource, value);
+                buildHere = true;
+            }
         }
 
-        auto result = cache_[weakSource].get();
-        return *dynamic_cast<const To*>(result);
+        if (buildHere) {
+            try {
+                promise.set_value(std::shared_ptr<Object>(builder(*static_cast<const T*>(this), source).release()));
+            } catch (...) {
+                //failed build isn't cached: waiters get the error, next call tries again
+                {
+                    std::lock_guard<std::mutex> guard(cacheLock_);
+                    cache_.erase(weakSource);
+                }
+                promise.set_exception(std::current_exception());
+                throw;
+            }
+        }
+        return *dynamic_cast<const To*>(value.get().get());
     }
 
 
 private:
-    mutable std::unordered_map<int64_t, std::unique_ptr<Object>> cache_;
+    mutable std::mutex cacheLock_;
+    mutable std::unordered_map<int64_t, std::shared_future<std::shared_ptr<Object>>> cache_;
 };
 
 
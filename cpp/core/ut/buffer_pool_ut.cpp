@@ -0,0 +1,96 @@
+#include <core/buffer_pool.h>
+#include <gtest/gtest.h>
+
+namespace {
+
+    torch::Tensor allocate(int64_t elements, bool zero) {
+        return GlobalBufferPool().allocate(torch::ScalarType::Float, elements, zero);
+    }
+
+}
+
+TEST(BufferPoolTest, ReusesFreeTensors) {
+    BufferPoolScope scope;
+    auto& pool = GlobalBufferPool();
+    pool.resetStats();
+
+    auto first = allocate(1000, false);
+    const float* firstData = first.data_ptr<float>();
+
+    //storage is still referenced, so it can't be handed out again
+    auto second = allocate(1000, false);
+    EXPECT_NE(second.data_ptr<float>(), firstData);
+    EXPECT_EQ(pool.stats().PoolHits, 0);
+
+    first = torch::Tensor();
+    auto third = allocate(900, false);
+    EXPECT_EQ(third.data_ptr<float>(), firstData);
+    EXPECT_EQ(third.size(0), 900);
+    EXPECT_EQ(pool.stats().PoolHits, 1);
+    EXPECT_EQ(pool.stats().Allocations, 2);
+}
+
+TEST(BufferPoolTest, ZeroesReusedTensors) {
+    BufferPoolScope scope;
+
+    auto tensor = allocate(100, false);
+    tensor.fill_(42);
+    const float* data = tensor.data_ptr<float>();
+    tensor = torch::Tensor();
+
+    auto zeroed = allocate(100, true);
+    EXPECT_EQ(zeroed.data_ptr<float>(), data);
+    EXPECT_EQ(zeroed.abs().sum().item<float>(), 0);
+
+    auto empty = allocate(0, true);
+    EXPECT_TRUE(empty.defined());
+    EXPECT_EQ(empty.numel(), 0);
+}
+
+TEST(BufferPoolTest, ReleaseAndClear) {
+    auto& pool = GlobalBufferPool();
+    {
+        BufferPoolScope scope;
+        allocate(100, false);
+        pool.resetStats();
+
+        //free tensor is dropped only by release, which follows another release without requests for it
+        pool.releaseUnused();
+        allocate(100, false);
+        EXPECT_EQ(pool.stats().PoolHits, 1);
+
+        pool.releaseUnused();
+        pool.releaseUnused();
+        allocate(100, false);
+        EXPECT_EQ(pool.stats().PoolHits, 1);
+
+        pool.clear();
+        allocate(100, false);
+        EXPECT_EQ(pool.stats().PoolHits, 1);
+    }
+    EXPECT_FALSE(pool.enabled());
+    pool.resetStats();
+    auto tensor = allocate(100, false);
+    EXPECT_EQ(pool.stats().PoolHits, 0);
+    EXPECT_EQ(pool.stats().Allocations, 1);
+}
+
+TEST(BufferPoolTest, BypassesLargeAndLongLivedTensors) {
+    BufferPoolScope scope;
+    auto& pool = GlobalBufferPool();
+    pool.resetStats();
+
+    const int64_t largeElements = BufferPool::MaxPooledBytes / sizeof(float) + 1;
+    allocate(largeElements, false);
+    allocate(largeElements, false);
+    EXPECT_EQ(pool.stats().PoolHits, 0);
+    EXPECT_EQ(pool.stats().AllocatedBytes, 2 * largeElements * static_cast<int64_t>(sizeof(float)));
+
+    {
+        BufferPoolBypass bypass;
+        allocate(1000, false);
+        allocate(1000, false);
+    }
+    EXPECT_EQ(pool.stats().PoolHits, 0);
+    EXPECT_EQ(pool.stats().AllocatedBytes, (2 * largeElements + 2000) * static_cast<int64_t>(sizeof(float)));
+}
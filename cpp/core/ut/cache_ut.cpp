@@ -0,0 +1,70 @@
+#include <core/cache.h>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace {
+
+    class Source : public UuidHolder {
+    };
+
+    class Value : public Object {
+    public:
+        explicit Value(int64_t value)
+            : value_(value) {
+
+        }
+
+        int64_t value_;
+    };
+
+    class Holder : public CacheHolder<Holder> {
+    };
+
+}
+
+TEST(CacheHolderTest, ConcurrentCallersShareOneBuild) {
+    Holder holder;
+    auto source = std::make_shared<Source>();
+    std::atomic<int64_t> builds{0};
+
+    const int64_t threadsCount = 8;
+    std::vector<const Value*> results(threadsCount);
+    std::vector<std::thread> threads;
+    for (int64_t i = 0; i < threadsCount; ++i) {
+        threads.emplace_back([&, i]() {
+            results[i] = &holder.computeOrGet<Source, Value>(source, [&](const Holder&, std::shared_ptr<Source>) {
+                ++builds;
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                return std::make_unique<Value>(42);
+            });
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(builds.load(), 1);
+    for (const auto* result : results) {
+        EXPECT_EQ(result, results[0]);
+        EXPECT_EQ(result->value_, 42);
+    }
+}
+
+TEST(CacheHolderTest, FailedBuildIsNotCached) {
+    Holder holder;
+    auto source = std::make_shared<Source>();
+
+    EXPECT_THROW((holder.computeOrGet<Source, Value>(source, [](const Holder&, std::shared_ptr<Source>) -> std::unique_ptr<Value> {
+        throw std::runtime_error("build failed");
+    })), std::runtime_error);
+
+    const auto& value = holder.computeOrGet<Source, Value>(source, [](const Holder&, std::shared_ptr<Source>) {
+        return std::make_unique<Value>(7);
+    });
+    EXPECT_EQ(value.value_, 7);
+}
@@ -1,32 +1,77 @@
 #include "binarized_dataset.h"
 
+#include <algorithm>
+#include <cassert>
+
 
 BinarizedDataSetPtr binarize(const DataSet& ds, GridPtr& gridPtr, int32_t maxGroupSize) {
     const auto& grid = *gridPtr;
     std::unique_ptr<BinarizedDataSet>
         bds(new BinarizedDataSet(ds, gridPtr, ds.samplesCount(), createGroups(grid, maxGroupSize)));
 
-    const int64_t groups = bds->groupCount();
+    const int64_t samplesCount = ds.samplesCount();
+    const int64_t fCount = ds.featuresCount();
+    const float* samples = ds.samples();
+
+    std::vector<uint8_t*> groupsData;
+    for (int64_t groupIdx = 0; groupIdx < bds->groupCount(); ++groupIdx) {
+        groupsData.push_back(bds->group(groupIdx).data());
+    }
+
+    //column-wise inside of sample block: borders of one feature and rows of block stay in cache
+    const int64_t blockSize = 4096;
+    const int64_t blocksCount = (samplesCount + blockSize - 1) / blockSize;
 
-    std::vector<uint8_t> binarizedLine(grid.nzFeaturesCount());
+    parallelFor(0, blocksCount, [&](int64_t blockId) {
+        const int64_t firstLine = blockId * blockSize;
+        const int64_t lastLine = std::min<int64_t>(firstLine + blockSize, samplesCount);
 
-    for (int64_t line = 0; line < ds.samplesCount(); ++line) {
-        const Vec lineFeatures = ds.sample(line);
-        ConstVecRef<float> row = lineFeatures.arrayRef();
-        grid.binarize(row, binarizedLine);
+        for (int64_t groupIdx = 0; groupIdx < bds->groupCount(); ++groupIdx) {
+            const auto& bundle = bds->featuresBundle(groupIdx);
+            const int32_t groupSize = bundle.groupSize();
+            uint8_t* groupData = groupsData[groupIdx];
 
-        for (int64_t i = 0; i < groups; ++i) {
-            bds->updateLineForGroup(i, line, [&](ConstVecRef<int32_t> gridFeatures, VecRef<uint8_t> bins) {
-                for (uint64_t f = 0; f < gridFeatures.size(); ++f) {
-                    bins[f] = binarizedLine[gridFeatures[f]];
+            for (int32_t f = bundle.firstFeature_; f < bundle.lastFeature_; ++f) {
+                const int64_t origFeature = grid.origFeatureIndex(f);
+                const auto borders = grid.borders(f);
+                const int32_t fIndexInGroup = f - bundle.firstFeature_;
+
+                for (int64_t line = firstLine; line < lastLine; ++line) {
+                    groupData[line * groupSize + fIndexInGroup] = computeBin(samples[line * fCount + origFeature], borders);
                 }
-            });
+            }
         }
-    }
+    });
 
     return bds;
 }
 
+void BinarizedDataSet::sampleBins(int64_t sampleId, VecRef<uint8_t> dst) const {
+    assert(static_cast<int64_t>(dst.size()) >= grid_->nzFeaturesCount());
+    for (int64_t groupIdx = 0; groupIdx < groupCount(); ++groupIdx) {
+        const auto& bundle = groups_[groupIdx];
+        const int32_t groupSize = bundle.groupSize();
+        const uint8_t* src = group(groupIdx).data() + sampleId * groupSize;
+        std::copy(src, src + groupSize, dst.data() + bundle.firstFeature_);
+    }
+}
+
+void BinarizedDataSet::fillBlockBins(ConstVecRef<int32_t> indices, int64_t first, int64_t count, uint8_t* bins) const {
+    for (int64_t groupIdx = 0; groupIdx < groupCount(); ++groupIdx) {
+        const auto& bundle = groups_[groupIdx];
+        const int32_t groupSize = bundle.groupSize();
+        const uint8_t* groupData = group(groupIdx).data();
+        uint8_t* groupBins = bins + bundle.firstFeature_ * count;
+
+        for (int64_t i = 0; i < count; ++i) {
+            const uint8_t* src = groupData + indices[first + i] * groupSize;
+            for (int32_t f = 0; f < groupSize; ++f) {
+                groupBins[f * count + i] = src[f];
+            }
+        }
+    }
+}
+
 void createGroups(
     const Grid& grid,
     int32_t maxGroupSize,
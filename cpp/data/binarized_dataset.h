@@ -4,6 +4,7 @@
 #include "dataset.h"
 #include <torch/torch.h>
 #include <core/buffer.h>
+#include <core/buffer_pool.h>
 #include <util/array_ref.h>
 #include <util/parallel_executor.h>
 
@@ -22,6 +23,8 @@ using BinarizedDataSetPtr = std::unique_ptr<BinarizedDataSet>;
 
 class BinarizedDataSet : public Object {
 public:
+    //samples in block of visitSampleBlocks: bins of block for all features fit into L1/L2
+    static constexpr int64_t DefaultSamplesBlockSize = 256;
 
     GridPtr gridPtr() const {
         return grid_;
@@ -40,6 +43,10 @@ public:
         return groups_[groupIdx];
     }
 
+    int64_t featureGroup(int64_t fIndex) const {
+        return featureToGroup_[fIndex];
+    }
+
     ConstVecRef<uint8_t> group(int64_t groupIdx) const {
        return ConstVecRef<uint8_t>(data_.arrayRef().data() + groups_[groupIdx].groupOffset_ * samplesCount_,
                                      groups_[groupIdx].groupSize()  * samplesCount_);
@@ -50,23 +57,33 @@ public:
         return samplesCount_;
     }
 
-    ConstVecRef<uint8_t> sampleBins(int64_t sampleId) const {
-        if (groups_.size() != 1) {
-            throw std::runtime_error("only 1 group is supported (for now)");
-        }
+    //row-wise view: bins of all nz features of sample, dst should have nzFeaturesCount elements
+    void sampleBins(int64_t sampleId, VecRef<uint8_t> dst) const;
+
+    //feature-major view of samples block: bins[fIndex * count + i] is bin of sample indices[first + i]
+    void fillBlockBins(ConstVecRef<int32_t> indices, int64_t first, int64_t count, uint8_t* bins) const;
 
-        return ConstVecRef<uint8_t>(data_.arrayRef().data() + groups_[0].groupOffset_ * samplesCount_ +
-                groups_[0].groupSize() * sampleId,grid_->nzFeaturesCount());
-//        std::vector<uint8_t> res;
-//        for (int fId = 0; fId < (int)grid_->nzFeaturesCount(); ++fId) {
-//            int64_t groupIdx = featureToGroup_.at(fId);
-//            const auto& groupInfo = groups_[groupIdx];
-//            auto groupBundle = group(groupIdx);
-//            const int64_t fIndexInGroup = fId - groupInfo.firstFeature_;
-//
-//            res.push_back(groupBundle[sampleId * groupInfo.groupSize() + fIndexInGroup]);
-//        }
-//        return res;
+    //visitor(blockId, first, count, bins) for blocks of indices in parallel, bins are filled as in fillBlockBins.
+    //blockId < numThreads and is exclusive for running visitor, so it could index per-thread state
+    template <class Visitor>
+    void visitSampleBlocks(ConstVecRef<int32_t> indices, Visitor&& visitor,
+                           int64_t blockSize = DefaultSamplesBlockSize) const {
+        const int64_t samplesCount = indices.size();
+        const int64_t blocksCount = (samplesCount + blockSize - 1) / blockSize;
+        const int64_t binsSize = grid_->nzFeaturesCount() * blockSize;
+
+        parallelFor(0, blocksCount, [&](int blockId, int64_t block) {
+            const int64_t first = block * blockSize;
+            const int64_t count = std::min<int64_t>(blockSize, samplesCount - first);
+            //reused between calls, fillBlockBins overwrites it
+            thread_local std::vector<uint8_t> blockBins;
+            if ((int64_t)blockBins.size() < binsSize) {
+                blockBins.resize(binsSize);
+            }
+            uint8_t* bins = blockBins.data();
+            fillBlockBins(indices, first, count, bins);
+            visitor(blockId, first, count, static_cast<const uint8_t*>(bins));
+        });
     }
 
     template <class Visitor>
@@ -134,26 +151,25 @@ private:
     }
 
 
-    template <class Visitor>
-    void updateLineForGroup(int64_t groupIdx, int64_t line, Visitor&& updater) {
-        ConstVecRef<int32_t> featureIds = groupToFeatures[groupIdx];
-        VecRef<uint8_t> groupRef = group(groupIdx);
-        const auto groupSize = groups_[groupIdx].groupSize();
-        auto lineBins = VecRef<uint8_t>(groupRef.data() + line * groupSize, groupSize);
-        updater(featureIds, lineBins);
+    BinarizedDataSet(const DataSet& owner,
+        GridPtr grid,
+        int64_t samplesCount,
+        std::vector<FeaturesBundle>&& groups)
+        : BinarizedDataSet(owner, grid, samplesCount, std::move(groups), Buffer<uint8_t>()) {
+        data_ = Buffer<uint8_t>::create(samplesCount * (groups_.back().groupOffset_ + groups_.back().groupSize()));
     }
 
-
+    //bins are already computed (e.g. mapped from file)
     BinarizedDataSet(const DataSet& owner,
         GridPtr grid,
         int64_t samplesCount,
-        std::vector<FeaturesBundle>&& groups)
+        std::vector<FeaturesBundle>&& groups,
+        Buffer<uint8_t> data)
         : owner_(owner)
         , grid_(std::move(grid))
         , samplesCount_(samplesCount)
         , groups_(std::move(groups))
-        , data_(Buffer<uint8_t>::create(samplesCount * (groups_.back().groupOffset_ + groups_.back().groupSize()))) {
-        data_.fill(0);
+        , data_(std::move(data)) {
         featureToGroup_.resize(grid_->nzFeaturesCount());
         groupToFeatures.resize(groups_.size());
 
@@ -167,6 +183,7 @@ private:
     }
 
     friend BinarizedDataSetPtr binarize(const DataSet& ds, GridPtr& grid, int32_t maxGroupSize);
+    friend GridPtr loadBinarizationBinary(const DataSet& ds, const std::string& file);
 
 private:
     const DataSet& owner_;
@@ -193,6 +210,8 @@ BinarizedDataSetPtr binarize(const DataSet& ds, GridPtr& grid, int32_t maxGroupS
 
 inline const BinarizedDataSet& cachedBinarize(const DataSet& ds, GridPtr grid, int32_t maxGroupSize = 16) {
     return ds.computeOrGet<Grid, BinarizedDataSet>(std::move(grid), [&](const DataSet& ds, GridPtr ptr) -> std::unique_ptr<BinarizedDataSet> {
+        //binarized data lives as long as dataset: allocate it with exact size even inside pool scope
+        BufferPoolBypass bypassPool;
         auto start = std::chrono::system_clock::now();
         auto binarized = binarize(ds, ptr, maxGroupSize);
         std::cout << "binarization time " << std::chrono::duration<double>(std::chrono::system_clock::now() - start).count()
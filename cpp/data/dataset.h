@@ -6,6 +6,7 @@
 #include <core/object.h>
 #include <core/matrix.h>
 #include <core/cache.h>
+#include <core/buffer.h>
 
 class DataSet : public Object, public CacheHolder<DataSet> {
 public:
@@ -140,8 +141,54 @@ public:
     torch::Tensor tensorData() const {
         return data_.data();
     }
+
+    //optional per-sample weights
+    bool hasWeights() const {
+        return weights_.dim() != 0;
+    }
+
+    Vec weights() const {
+        return weights_;
+    }
+
+    void setWeights(Vec weights) {
+        assert(weights.dim() == samplesCount());
+        weights_ = weights;
+    }
+
+    //optional query (group) ids for ranking datasets
+    bool hasQueryIds() const {
+        return queryIds_.size() != 0;
+    }
+
+    ConstVecRef<int64_t> queryIds() const {
+        return queryIds_.arrayRef();
+    }
+
+    void setQueryIds(Buffer<int64_t> queryIds) {
+        assert(queryIds.size() == samplesCount());
+        queryIds_ = queryIds;
+    }
+
+    //optional group ids (gid column of features.txt)
+    bool hasGroupIds() const {
+        return groupIds_.size() != 0;
+    }
+
+    ConstVecRef<int64_t> groupIds() const {
+        return groupIds_.arrayRef();
+    }
+
+    void setGroupIds(Buffer<int64_t> groupIds) {
+        assert(groupIds.size() == samplesCount());
+        groupIds_ = groupIds;
+    }
+
 private:
     Mx data_;
     ConstVecRef<float> dataRef_;
     Vec target_;
+    Vec weights_;
+    Buffer<int64_t> queryIds_;
+    Buffer<int64_t> groupIds_;
 };
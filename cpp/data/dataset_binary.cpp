@@ -0,0 +1,264 @@
+#include "dataset_binary.h"
+#include "grid_builder.h"
+
+#include <util/exception.h>
+#include <util/mapped_file.h>
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <type_traits>
+#include <vector>
+
+namespace {
+    const char DataSetMagic[8] = {'E', 'T', 'D', 'A', 'T', 'A', 'S', 'T'};
+    constexpr uint32_t DataSetFormatVersion = 1;
+    constexpr uint64_t SectionAlignment = 64;
+
+    enum class SectionType : uint32_t {
+        Features = 1,
+        Target = 2,
+        Weights = 3,
+        QueryIds = 4,
+        Grid = 5,
+        BinGroups = 6,
+        Bins = 7,
+        GroupIds = 8
+    };
+
+    struct FileHeader {
+        char magic_[8];
+        uint32_t version_ = DataSetFormatVersion;
+        uint32_t sectionsCount_ = 0;
+        int64_t samplesCount_ = 0;
+        int64_t featuresCount_ = 0;
+    };
+
+    struct SectionEntry {
+        uint32_t type_ = 0;
+        uint32_t reserved_ = 0;
+        uint64_t offset_ = 0;
+        uint64_t size_ = 0;
+    };
+
+    static_assert(std::is_trivially_copyable<FeaturesBundle>::value && sizeof(FeaturesBundle) == 3 * sizeof(int32_t),
+                  "bin groups are stored as raw FeaturesBundle structs");
+
+    struct SectionData {
+        SectionType type_;
+        const char* data_;
+        uint64_t size_;
+    };
+
+    uint64_t alignUp(uint64_t offset) {
+        return (offset + SectionAlignment - 1) / SectionAlignment * SectionAlignment;
+    }
+
+    template <class T>
+    SectionData section(SectionType type, ConstVecRef<T> data) {
+        return {type, reinterpret_cast<const char*>(data.data()), data.size() * sizeof(T)};
+    }
+
+    class DataSetFile {
+    public:
+        explicit DataSetFile(const std::string& path)
+            : file_(std::make_shared<MappedFile>(path)) {
+            VERIFY(file_->size() >= static_cast<int64_t>(sizeof(FileHeader)), "Not a binary dataset: " << path);
+            std::memcpy(&header_, file_->data(), sizeof(header_));
+            VERIFY(std::memcmp(header_.magic_, DataSetMagic, sizeof(DataSetMagic)) == 0, "Not a binary dataset: " << path);
+            VERIFY(header_.version_ == DataSetFormatVersion,
+                   "Unsupported binary dataset version " << header_.version_ << " in " << path);
+
+            const uint64_t tableEnd = sizeof(FileHeader) + header_.sectionsCount_ * sizeof(SectionEntry);
+            VERIFY(tableEnd <= static_cast<uint64_t>(file_->size()), "Truncated binary dataset: " << path);
+            sections_.resize(header_.sectionsCount_);
+            std::memcpy(sections_.data(), file_->data() + sizeof(FileHeader), header_.sectionsCount_ * sizeof(SectionEntry));
+            for (const auto& entry : sections_) {
+                VERIFY(entry.offset_ % SectionAlignment == 0 && entry.offset_ + entry.size_ <= static_cast<uint64_t>(file_->size()),
+                       "Corrupted section " << entry.type_ << " in " << path);
+            }
+        }
+
+        const FileHeader& header() const {
+            return header_;
+        }
+
+        const SectionEntry* find(SectionType type) const {
+            for (const auto& entry : sections_) {
+                if (entry.type_ == static_cast<uint32_t>(type)) {
+                    return &entry;
+                }
+            }
+            return nullptr;
+        }
+
+        const SectionEntry& get(SectionType type, uint64_t expectedSize) const {
+            auto entry = find(type);
+            VERIFY(entry, "Section " << static_cast<uint32_t>(type) << " is missing in " << file_->path());
+            VERIFY(entry->size_ == expectedSize, "Section " << static_cast<uint32_t>(type) << " has size " << entry->size_
+                                                            << ", expected " << expectedSize << " in " << file_->path());
+            return *entry;
+        }
+
+        const char* data(const SectionEntry& entry) const {
+            return file_->data() + entry.offset_;
+        }
+
+        //tensor over mapped memory, mapping lives while tensor does
+        torch::Tensor tensor(const SectionEntry& entry, torch::ScalarType type, int64_t elements) const {
+            auto file = file_;
+            return torch::from_blob(file_->data() + entry.offset_, {elements}, [file](void*) {},
+                                    torch::TensorOptions().dtype(type).device(torch::kCPU));
+        }
+
+    private:
+        MappedFilePtr file_;
+        FileHeader header_;
+        std::vector<SectionEntry> sections_;
+    };
+}
+
+void saveDataSetBinary(const DataSet& ds, const std::string& file, const BinarizedDataSet* bds) {
+    const int64_t samplesCount = ds.samplesCount();
+    const int64_t featuresCount = ds.featuresCount();
+
+    std::vector<SectionData> sections;
+    sections.push_back({SectionType::Features, reinterpret_cast<const char*>(ds.samples()),
+                        static_cast<uint64_t>(samplesCount * featuresCount * sizeof(float))});
+    sections.push_back({SectionType::Target, reinterpret_cast<const char*>(ds.labels()),
+                        static_cast<uint64_t>(samplesCount * sizeof(float))});
+
+    Vec weights = ds.weights();
+    if (ds.hasWeights()) {
+        sections.push_back(section(SectionType::Weights, static_cast<const Vec&>(weights).arrayRef()));
+    }
+    if (ds.hasQueryIds()) {
+        sections.push_back(section(SectionType::QueryIds, ds.queryIds()));
+    }
+    if (ds.hasGroupIds()) {
+        sections.push_back(section(SectionType::GroupIds, ds.groupIds()));
+    }
+
+    std::string grid;
+    std::vector<FeaturesBundle> groups;
+    if (bds) {
+        VERIFY(&bds->owner() == &ds, "Binarized dataset should be built from saved dataset");
+        std::ostringstream gridOut;
+        bds->grid().serialize(gridOut);
+        grid = gridOut.str();
+        sections.push_back({SectionType::Grid, grid.data(), grid.size()});
+
+        for (int64_t groupIdx = 0; groupIdx < bds->groupCount(); ++groupIdx) {
+            groups.push_back(bds->featuresBundle(groupIdx));
+        }
+        sections.push_back(section(SectionType::BinGroups, ConstVecRef<FeaturesBundle>(groups)));
+        //groups are stored one after another, so first group starts the whole bins block
+        const auto& lastGroup = groups.back();
+        sections.push_back({SectionType::Bins, reinterpret_cast<const char*>(bds->group(0).data()),
+                            static_cast<uint64_t>((lastGroup.groupOffset_ + lastGroup.groupSize()) * samplesCount)});
+    }
+
+    FileHeader header;
+    std::memcpy(header.magic_, DataSetMagic, sizeof(DataSetMagic));
+    header.sectionsCount_ = static_cast<uint32_t>(sections.size());
+    header.samplesCount_ = samplesCount;
+    header.featuresCount_ = featuresCount;
+
+    std::vector<SectionEntry> entries;
+    uint64_t offset = alignUp(sizeof(FileHeader) + sections.size() * sizeof(SectionEntry));
+    for (const auto& data : sections) {
+        SectionEntry entry;
+        entry.type_ = static_cast<uint32_t>(data.type_);
+        entry.offset_ = offset;
+        entry.size_ = data.size_;
+        entries.push_back(entry);
+        offset = alignUp(offset + data.size_);
+    }
+
+    std::ofstream out(file, std::ios::binary);
+    VERIFY(out, "Failed to open file " << file);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(SectionEntry));
+
+    const char padding[SectionAlignment] = {};
+    uint64_t written = sizeof(FileHeader) + entries.size() * sizeof(SectionEntry);
+    for (uint64_t i = 0; i < sections.size(); ++i) {
+        out.write(padding, entries[i].offset_ - written);
+        out.write(sections[i].data_, sections[i].size_);
+        written = entries[i].offset_ + sections[i].size_;
+    }
+    VERIFY(out, "Failed to write file " << file);
+}
+
+bool isDataSetBinary(const std::string& file) {
+    std::ifstream in(file, std::ios::binary);
+    char magic[sizeof(DataSetMagic)];
+    return in.read(magic, sizeof(magic)) && std::memcmp(magic, DataSetMagic, sizeof(DataSetMagic)) == 0;
+}
+
+DataSet loadDataSetBinary(const std::string& file) {
+    DataSetFile dsFile(file);
+    const int64_t samplesCount = dsFile.header().samplesCount_;
+    const int64_t featuresCount = dsFile.header().featuresCount_;
+
+    const auto& features = dsFile.get(SectionType::Features, samplesCount * featuresCount * sizeof(float));
+    const auto& target = dsFile.get(SectionType::Target, samplesCount * sizeof(float));
+
+    Vec data(dsFile.tensor(features, torch::ScalarType::Float, samplesCount * featuresCount));
+    Mx mx(data, samplesCount, featuresCount);
+    DataSet ds(mx, Vec(dsFile.tensor(target, torch::ScalarType::Float, samplesCount)));
+
+    if (dsFile.find(SectionType::Weights)) {
+        const auto& weights = dsFile.get(SectionType::Weights, samplesCount * sizeof(float));
+        ds.setWeights(Vec(dsFile.tensor(weights, torch::ScalarType::Float, samplesCount)));
+    }
+    if (dsFile.find(SectionType::QueryIds)) {
+        const auto& queryIds = dsFile.get(SectionType::QueryIds, samplesCount * sizeof(int64_t));
+        ds.setQueryIds(Buffer<int64_t>::fromTensor(
+            dsFile.tensor(queryIds, torch::ScalarType::Byte, samplesCount * sizeof(int64_t))));
+    }
+    if (dsFile.find(SectionType::GroupIds)) {
+        const auto& groupIds = dsFile.get(SectionType::GroupIds, samplesCount * sizeof(int64_t));
+        ds.setGroupIds(Buffer<int64_t>::fromTensor(
+            dsFile.tensor(groupIds, torch::ScalarType::Byte, samplesCount * sizeof(int64_t))));
+    }
+
+    std::cout << "mapped  #" << samplesCount << " lines" << std::endl;
+    std::cout << "fCount  #" << featuresCount << std::endl;
+    return ds;
+}
+
+GridPtr loadBinarizationBinary(const DataSet& ds, const std::string& file) {
+    DataSetFile dsFile(file);
+    auto gridSection = dsFile.find(SectionType::Grid);
+    if (!gridSection) {
+        return nullptr;
+    }
+    const int64_t samplesCount = dsFile.header().samplesCount_;
+    VERIFY(samplesCount == ds.samplesCount(), "Dataset doesn't match " << file);
+
+    std::istringstream gridIn(std::string(dsFile.data(*gridSection), gridSection->size_));
+    GridPtr grid = buildGridFromStream(gridIn);
+    VERIFY(grid, "Corrupted grid in " << file);
+    VERIFY(grid->origFeaturesCount() == ds.featuresCount(), "Grid in " << file << " is built for "
+        << grid->origFeaturesCount() << " features, dataset has " << ds.featuresCount());
+
+    auto groupsSection = dsFile.find(SectionType::BinGroups);
+    VERIFY(groupsSection && groupsSection->size_ % sizeof(FeaturesBundle) == 0 && groupsSection->size_ > 0,
+           "Corrupted bin groups in " << file);
+    std::vector<FeaturesBundle> groups(groupsSection->size_ / sizeof(FeaturesBundle));
+    std::memcpy(groups.data(), dsFile.data(*groupsSection), groupsSection->size_);
+    VERIFY(groups.back().lastFeature_ == grid->nzFeaturesCount(), "Bin groups don't match grid in " << file);
+
+    const auto& lastGroup = groups.back();
+    const int64_t binsSize = (lastGroup.groupOffset_ + lastGroup.groupSize()) * samplesCount;
+    const auto& bins = dsFile.get(SectionType::Bins, binsSize);
+
+    BinarizedDataSetPtr bds(new BinarizedDataSet(ds, grid, samplesCount, std::move(groups),
+        Buffer<uint8_t>::fromTensor(dsFile.tensor(bins, torch::ScalarType::Byte, binsSize))));
+    ds.computeOrGet<Grid, BinarizedDataSet>(grid, [&](const DataSet&, GridPtr) {
+        return std::move(bds);
+    });
+    return grid;
+}
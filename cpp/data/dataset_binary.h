@@ -0,0 +1,22 @@
+#pragma once
+
+#include "dataset.h"
+#include "binarized_dataset.h"
+
+#include <string>
+
+/*
+ * Binary dataset file: header, section table and 64-byte aligned sections.
+ * Sections are features (row-major samples x features, the layout of DataSet),
+ * target, optional weights, query and group ids, and optionally grid with binarized features.
+ * Loading maps the file: dataset columns are views of mapped memory, nothing is parsed or copied
+ */
+
+void saveDataSetBinary(const DataSet& ds, const std::string& file, const BinarizedDataSet* bds = nullptr);
+
+bool isDataSetBinary(const std::string& file);
+
+DataSet loadDataSetBinary(const std::string& file);
+
+//grid saved with dataset, saved bins become cached binarization of ds for this grid. nullptr if file has no bins
+GridPtr loadBinarizationBinary(const DataSet& ds, const std::string& file);
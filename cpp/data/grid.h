@@ -135,12 +135,20 @@ private:
 };
 
 
+//borders are sorted, so bin is number of borders < val. branchless lower_bound
 inline int32_t computeBin(float val, ConstVecRef<float> borders) {
-    uint32_t bin = 0;
-    while (bin < borders.size() && borders[bin] < val) {
-        ++bin;
-    }
-    return bin;
+    const float* first = borders.data();
+    const float* base = first;
+    size_t n = borders.size();
+    if (n == 0) {
+        return 0;
+    }
+    while (n > 1) {
+        const size_t half = n / 2;
+        base = (base[half] < val) ? base + half : base;
+        n -= half;
+    }
+    return static_cast<int32_t>(base - first) + (*base < val);
 }
 
 
@@ -1,2 +1,214 @@
 #include "histogram.h"
 
+#include <algorithm>
+#include <vector>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define HISTOGRAM_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace Detail {
+
+#ifdef HISTOGRAM_X86_SIMD
+
+    namespace {
+
+        //lane-private copy pays off only when samples are much more numerous than bins
+        constexpr int64_t MinSamplesPerBinForPrivateHistogram = 4;
+
+        inline void addStat(double* dst, __m128d stat) {
+            _mm_storeu_pd(dst, _mm_add_pd(_mm_loadu_pd(dst), stat));
+        }
+
+        inline void addStatsForTail(const uint8_t* row,
+                                    const int32_t* binOffsets,
+                                    int32_t from,
+                                    int32_t bundleSize,
+                                    __m128d stat,
+                                    double* dst) {
+            for (int32_t b = from; b < bundleSize; ++b) {
+                addStat(dst + 2 * (binOffsets[b] + row[b]), stat);
+            }
+        }
+
+        __attribute__((target("avx2")))
+        void addSampleAvx2(const uint8_t* row, const int32_t* binOffsets, int32_t bundleSize, __m128d stat, double* dst) {
+            alignas(32) int32_t bins[8];
+            int32_t b = 0;
+            for (; b + 8 <= bundleSize; b += 8) {
+                __m256i rowBins = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(row + b)));
+                rowBins = _mm256_add_epi32(rowBins, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(binOffsets + b)));
+                _mm256_store_si256(reinterpret_cast<__m256i*>(bins), rowBins);
+                for (int32_t k = 0; k < 8; ++k) {
+                    addStat(dst + 2 * bins[k], stat);
+                }
+            }
+            addStatsForTail(row, binOffsets, b, bundleSize, stat, dst);
+        }
+
+        __attribute__((target("avx512f")))
+        void addSampleAvx512(const uint8_t* row, const int32_t* binOffsets, int32_t bundleSize, __m128d stat, double* dst) {
+            alignas(64) int32_t bins[16];
+            int32_t b = 0;
+            for (; b + 16 <= bundleSize; b += 16) {
+                __m512i rowBins = _mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + b)));
+                rowBins = _mm512_add_epi32(rowBins, _mm512_loadu_si512(binOffsets + b));
+                _mm512_store_si512(bins, rowBins);
+                for (int32_t k = 0; k < 16; ++k) {
+                    addStat(dst + 2 * bins[k], stat);
+                }
+            }
+            if (b + 8 <= bundleSize) {
+                addSampleAvx2(row + b, binOffsets + b, bundleSize - b, stat, dst);
+            } else {
+                addStatsForTail(row, binOffsets, b, bundleSize, stat, dst);
+            }
+        }
+
+        template <class AddSample>
+        inline void buildSumWeightHistogramsImpl(
+            AddSample&& addSample,
+            int32_t bundleSize,
+            const double* statistics,
+            const int32_t* binLoadIndices,
+            int64_t size,
+            const int32_t* binOffsets,
+            const uint8_t* data,
+            double* dst) {
+            //features of one sample always hit different bins, consecutive samples often hit the same one.
+            //odd samples go to lane-private histogram, so adjacent updates don't wait for each other
+            const int64_t bundleBins = binOffsets[bundleSize - 1] - binOffsets[0] + 256;
+            const bool usePrivate = size >= MinSamplesPerBinForPrivateHistogram * bundleBins;
+
+            if (!usePrivate) {
+                for (int64_t i = 0; i < size; ++i) {
+                    addSample(data + static_cast<int64_t>(binLoadIndices[i]) * bundleSize,
+                              binOffsets,
+                              bundleSize,
+                              _mm_loadu_pd(statistics + 2 * i),
+                              dst);
+                }
+                return;
+            }
+
+            thread_local std::vector<double> privateHistogram;
+            privateHistogram.assign(2 * bundleBins, 0.0);
+            //private histogram is addressed relative to the first bin of bundle
+            double* privateDst = privateHistogram.data() - 2 * static_cast<int64_t>(binOffsets[0]);
+
+            int64_t i = 0;
+            for (; i + 2 <= size; i += 2) {
+                addSample(data + static_cast<int64_t>(binLoadIndices[i]) * bundleSize,
+                          binOffsets,
+                          bundleSize,
+                          _mm_loadu_pd(statistics + 2 * i),
+                          dst);
+                addSample(data + static_cast<int64_t>(binLoadIndices[i + 1]) * bundleSize,
+                          binOffsets,
+                          bundleSize,
+                          _mm_loadu_pd(statistics + 2 * (i + 1)),
+                          privateDst);
+            }
+            if (i < size) {
+                addSample(data + static_cast<int64_t>(binLoadIndices[i]) * bundleSize,
+                          binOffsets,
+                          bundleSize,
+                          _mm_loadu_pd(statistics + 2 * i),
+                          dst);
+            }
+
+            //bins after the last feature belong to other bundles and could be updated concurrently:
+            //touch only bins we have written to (untouched ones are exactly zero)
+            double* firstBin = dst + 2 * static_cast<int64_t>(binOffsets[0]);
+            const __m128d zero = _mm_setzero_pd();
+            for (int64_t bin = 0; bin < bundleBins; ++bin) {
+                const __m128d stat = _mm_loadu_pd(privateHistogram.data() + 2 * bin);
+                if (_mm_movemask_pd(_mm_cmpneq_pd(stat, zero))) {
+                    addStat(firstBin + 2 * bin, stat);
+                }
+            }
+        }
+
+        __attribute__((target("avx2")))
+        void buildSumWeightHistogramsAvx2(int32_t bundleSize,
+                                          const double* statistics,
+                                          const int32_t* binLoadIndices,
+                                          int64_t size,
+                                          const int32_t* binOffsets,
+                                          const uint8_t* data,
+                                          double* dst) {
+            buildSumWeightHistogramsImpl(addSampleAvx2, bundleSize, statistics, binLoadIndices, size, binOffsets, data, dst);
+        }
+
+        __attribute__((target("avx512f")))
+        void buildSumWeightHistogramsAvx512(int32_t bundleSize,
+                                            const double* statistics,
+                                            const int32_t* binLoadIndices,
+                                            int64_t size,
+                                            const int32_t* binOffsets,
+                                            const uint8_t* data,
+                                            double* dst) {
+            buildSumWeightHistogramsImpl(addSampleAvx512, bundleSize, statistics, binLoadIndices, size, binOffsets, data, dst);
+        }
+    }
+
+    HistogramSimdLevel histogramSimdLevel() {
+        static const HistogramSimdLevel level = []() {
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f")) {
+                return HistogramSimdLevel::Avx512;
+            }
+            if (__builtin_cpu_supports("avx2")) {
+                return HistogramSimdLevel::Avx2;
+            }
+            return HistogramSimdLevel::Scalar;
+        }();
+        return level;
+    }
+
+    void buildSumWeightHistograms(
+        HistogramSimdLevel level,
+        int32_t bundleSize,
+        const double* statistics,
+        const int32_t* binLoadIndices,
+        int64_t size,
+        const int32_t* binOffsets,
+        const uint8_t* data,
+        double* dst) {
+        switch (level) {
+            case HistogramSimdLevel::Avx512: {
+                buildSumWeightHistogramsAvx512(bundleSize, statistics, binLoadIndices, size, binOffsets, data, dst);
+                break;
+            }
+            case HistogramSimdLevel::Avx2: {
+                buildSumWeightHistogramsAvx2(bundleSize, statistics, binLoadIndices, size, binOffsets, data, dst);
+                break;
+            }
+            default: {
+                assert(false);
+            }
+        }
+    }
+
+#else
+
+    HistogramSimdLevel histogramSimdLevel() {
+        return HistogramSimdLevel::Scalar;
+    }
+
+    void buildSumWeightHistograms(
+        HistogramSimdLevel,
+        int32_t,
+        const double*,
+        const int32_t*,
+        int64_t,
+        const int32_t*,
+        const uint8_t*,
+        double*) {
+        assert(false);
+    }
+
+#endif
+
+}
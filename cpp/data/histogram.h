@@ -4,6 +4,9 @@
 #include <vector>
 #include <array>
 #include <cassert>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
 #include <util/array_ref.h>
 
 
@@ -44,6 +47,54 @@ void buildHistograms(
 }
 
 
+namespace Detail {
+
+    constexpr int32_t MaxHistogramBundleSize = 64;
+
+    enum class HistogramSimdLevel {
+        Scalar,
+        Avx2,
+        Avx512
+    };
+
+    //detected once on first call
+    HistogramSimdLevel histogramSimdLevel();
+
+    //stat with layout {double Sum; double Weight;} (L2Stat and alike) is stored as 2 doubles
+    template <class T, class = void>
+    struct IsSumWeightStat : std::false_type {};
+
+    template <class T>
+    struct IsSumWeightStat<T, std::enable_if_t<std::is_same<std::decay_t<decltype(T::Sum)>, double>::value
+                                               && std::is_same<std::decay_t<decltype(T::Weight)>, double>::value
+                                               && std::is_standard_layout<T>::value
+                                               && sizeof(T) == 2 * sizeof(double)>> : std::true_type {};
+
+    //vectorized kernel for {Sum, Weight} stats, stats and dst are interleaved (sum, weight) pairs
+    void buildSumWeightHistograms(
+        HistogramSimdLevel level,
+        int32_t bundleSize,
+        const double* statistics,
+        const int32_t* binLoadIndices,
+        int64_t size,
+        const int32_t* binOffsets,
+        const uint8_t* data,
+        double* dst);
+
+    template <class AdditiveStat, class I, int64_t N>
+    using HistogramKernel = void (*)(ConstVecRef<AdditiveStat>,
+                                     ConstVecRef<I>,
+                                     ConstVecRef<int32_t>,
+                                     ConstVecRef<uint8_t>,
+                                     VecRef<AdditiveStat>);
+
+    template <class AdditiveStat, class I, int64_t N, size_t... Sizes>
+    std::array<HistogramKernel<AdditiveStat, I, N>, sizeof...(Sizes)> makeHistogramKernels(std::index_sequence<Sizes...>) {
+        return {{&buildHistograms<AdditiveStat, I, static_cast<int64_t>(Sizes) + 1, N>...}};
+    }
+}
+
+
 template <class AdditiveStat,
         class I,
         int64_t N = 4>
@@ -54,154 +105,26 @@ void buildHistograms(
     ConstVecRef<int32_t> binOffsets,
     ConstVecRef<uint8_t> data,
     VecRef<AdditiveStat> dst) {
+    assert(bundleSize > 0 && bundleSize <= Detail::MaxHistogramBundleSize);
 
-    assert(bundleSize <= 64);
-    #define DISPATCH(sz)\
-    buildHistograms<AdditiveStat, I, sz, N>(statistics, binLoadIndices, binOffsets, data, dst);
-
-    #define DISPATCH_GE32(sz)\
-    buildHistograms<AdditiveStat, I, sz + 32, N>(statistics, binLoadIndices, binOffsets, data, dst);
-
-
-    if (bundleSize > 32) {
-        bundleSize -= 32;
-        if (bundleSize == 32) {
-            DISPATCH_GE32(32)
-        } else if (bundleSize == 31) {
-            DISPATCH_GE32(31);
-        } else if (bundleSize == 30) {
-            DISPATCH_GE32(30);
-        } else if (bundleSize == 29) {
-            DISPATCH_GE32(29);
-        } else if (bundleSize == 28) {
-            DISPATCH_GE32(28);
-        } else if (bundleSize == 27) {
-            DISPATCH_GE32(27);
-        } else if (bundleSize == 26) {
-            DISPATCH_GE32(26);
-        } else if (bundleSize == 25) {
-            DISPATCH_GE32(25);
-        } else if (bundleSize == 24) {
-            DISPATCH_GE32(24);
-        } else if (bundleSize == 23) {
-            DISPATCH_GE32(23);
-        } else if (bundleSize == 22) {
-            DISPATCH_GE32(22);
-        } else if (bundleSize == 21) {
-            DISPATCH_GE32(21);
-        } else if (bundleSize == 20) {
-            DISPATCH_GE32(20);
-        } else if (bundleSize == 19) {
-            DISPATCH_GE32(19);
-        } else if (bundleSize == 18) {
-            DISPATCH_GE32(18);
-        } else if (bundleSize == 17) {
-            DISPATCH_GE32(17);
-        } else if (bundleSize == 16) {
-            DISPATCH_GE32(16)
-        } else if (bundleSize == 15) {
-            DISPATCH_GE32(15);
-        } else if (bundleSize == 14) {
-            DISPATCH_GE32(14);
-        } else if (bundleSize == 13) {
-            DISPATCH_GE32(13);
-        } else if (bundleSize == 12) {
-            DISPATCH_GE32(12);
-        } else if (bundleSize == 11) {
-            DISPATCH_GE32(11);
-        } else if (bundleSize == 10) {
-            DISPATCH_GE32(10);
-        } else if (bundleSize == 9) {
-            DISPATCH_GE32(9);
-        } else if (bundleSize == 8) {
-            DISPATCH_GE32(8);
-        } else if (bundleSize == 7) {
-            DISPATCH_GE32(7);
-        } else if (bundleSize == 6) {
-            DISPATCH_GE32(6);
-        } else if (bundleSize == 5) {
-            DISPATCH_GE32(5);
-        } else if (bundleSize == 4) {
-            DISPATCH_GE32(4);
-        } else if (bundleSize == 3) {
-            DISPATCH_GE32(3);
-        } else if (bundleSize == 2) {
-            DISPATCH_GE32(2);
-        } else if (bundleSize == 1) {
-            DISPATCH_GE32(1);
-        } else {
-            assert(false);
-        }
-    } else {
-        if (bundleSize == 32) {
-            DISPATCH(32)
-        } else if (bundleSize == 31) {
-            DISPATCH(31);
-        } else if (bundleSize == 30) {
-            DISPATCH(30);
-        } else if (bundleSize == 29) {
-            DISPATCH(29);
-        } else if (bundleSize == 28) {
-            DISPATCH(28);
-        } else if (bundleSize == 27) {
-            DISPATCH(27);
-        } else if (bundleSize == 26) {
-            DISPATCH(26);
-        } else if (bundleSize == 25) {
-            DISPATCH(25);
-        } else if (bundleSize == 24) {
-            DISPATCH(24);
-        } else if (bundleSize == 23) {
-            DISPATCH(23);
-        } else if (bundleSize == 22) {
-            DISPATCH(22);
-        } else if (bundleSize == 21) {
-            DISPATCH(21);
-        } else if (bundleSize == 20) {
-            DISPATCH(20);
-        } else if (bundleSize == 19) {
-            DISPATCH(19);
-        } else if (bundleSize == 18) {
-            DISPATCH(18);
-        } else if (bundleSize == 17) {
-            DISPATCH(17);
-        } else if (bundleSize == 16) {
-            DISPATCH(16)
-        } else if (bundleSize == 15) {
-            DISPATCH(15);
-        } else if (bundleSize == 14) {
-            DISPATCH(14);
-        } else if (bundleSize == 13) {
-            DISPATCH(13);
-        } else if (bundleSize == 12) {
-            DISPATCH(12);
-        } else if (bundleSize == 11) {
-            DISPATCH(11);
-        } else if (bundleSize == 10) {
-            DISPATCH(10);
-        } else if (bundleSize == 9) {
-            DISPATCH(9);
-        } else if (bundleSize == 8) {
-            DISPATCH(8);
-        } else if (bundleSize == 7) {
-            DISPATCH(7);
-        } else if (bundleSize == 6) {
-            DISPATCH(6);
-        } else if (bundleSize == 5) {
-            DISPATCH(5);
-        } else if (bundleSize == 4) {
-            DISPATCH(4);
-        } else if (bundleSize == 3) {
-            DISPATCH(3);
-        } else if (bundleSize == 2) {
-            DISPATCH(2);
-        } else if (bundleSize == 1) {
-            DISPATCH(1);
-        } else {
-            assert(false);
+    if constexpr (Detail::IsSumWeightStat<AdditiveStat>::value && std::is_same<I, int32_t>::value) {
+        static_assert(offsetof(AdditiveStat, Sum) == 0 && offsetof(AdditiveStat, Weight) == sizeof(double),
+            "vectorized histograms expect {Sum, Weight} layout");
+        const auto level = Detail::histogramSimdLevel();
+        if (level != Detail::HistogramSimdLevel::Scalar) {
+            Detail::buildSumWeightHistograms(level,
+                                             bundleSize,
+                                             reinterpret_cast<const double*>(statistics.data()),
+                                             binLoadIndices.data(),
+                                             static_cast<int64_t>(binLoadIndices.size()),
+                                             binOffsets.data(),
+                                             data.data(),
+                                             reinterpret_cast<double*>(dst.data()));
+            return;
         }
     }
 
-    #undef DISPATCH
-    #undef DISPATCH_GE32
+    static const auto kernels = Detail::makeHistogramKernels<AdditiveStat, I, N>(
+        std::make_index_sequence<Detail::MaxHistogramBundleSize>());
+    kernels[bundleSize - 1](statistics, binLoadIndices, binOffsets, data, dst);
 }
@@ -1,65 +1,350 @@
 #include "load_data.h"
+#include "dataset_binary.h"
 
 #include <torch/torch.h>
 #include <core/vec_factory.h>
+#include <util/mapped_file.h>
+#include <util/parallel_executor.h>
 
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
 #include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
-DataSet loadFeaturesTxt(const std::string& file) {
-    std::ifstream in(file);
+namespace {
+    //qid, target, url, gid, then features
+    constexpr int64_t FeaturesTxtHeaderColumns = 4;
+    constexpr int64_t ChunksPerThread = 4;
+
+    struct TextChunk {
+        const char* begin_ = nullptr;
+        const char* end_ = nullptr;
+        //line in file (for errors) and sample index of first non-empty line
+        int64_t firstLine_ = 0;
+        int64_t firstRow_ = 0;
+        int64_t linesCount_ = 0;
+        int64_t rowsCount_ = 0;
+
+        //non-numeric qid and gid tokens with their rows, they get ids after parsing
+        std::vector<std::pair<int64_t, std::string>> namedQueryIds_;
+        std::vector<std::pair<int64_t, std::string>> namedGroupIds_;
+
+        int64_t errorLine_ = -1;
+        std::string error_;
+    };
 
-    if (!in) {
-        throw std::runtime_error("Failed to open file " + file);
+    //marks rows with non-numeric id until it is interned
+    constexpr int64_t NamedIdPlaceholder = std::numeric_limits<int64_t>::min();
+
+    inline bool isSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\r';
     }
 
-    std::vector<float> pool;
-    std::vector<float> target;
+    inline const char* lineEnd(const char* begin, const char* end) {
+        auto eol = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+        return eol ? eol : end;
+    }
 
-    int64_t linesCount = 0;
-    int64_t fCount = 0;
-    std::string tempString;
-    std::string line;
+    inline bool isEmptyLine(const char* begin, const char* end) {
+        while (begin < end && isSpace(*begin)) {
+            ++begin;
+        }
+        return begin == end;
+    }
 
-    while (std::getline(in, line) && line.size()) {
-        std::istringstream parseTokens(line);
-        float t = 0;
-//qid
-        parseTokens>>tempString;
-//target
-        parseTokens >>t;
-//url
-        parseTokens>>tempString;
-//gid
-        parseTokens>>tempString;
+    class LineTokenizer {
+    public:
+        LineTokenizer(const char* begin, const char* end)
+            : cursor_(begin)
+            , end_(end) {
 
+        }
 
-        std::vector<double> lineFeatures(std::istream_iterator<double>{parseTokens},
-                                        std::istream_iterator<double>());
-        if (linesCount == 0) {
-            fCount = lineFeatures.size();
-        } else {
-            assert(lineFeatures.size() == (size_t)fCount);
+        //false if there are no tokens left
+        bool next(const char** tokenBegin, const char** tokenEnd) {
+            while (cursor_ < end_ && isSpace(*cursor_)) {
+                ++cursor_;
+            }
+            if (cursor_ == end_) {
+                return false;
+            }
+            *tokenBegin = cursor_;
+            while (cursor_ < end_ && !isSpace(*cursor_)) {
+                ++cursor_;
+            }
+            *tokenEnd = cursor_;
+            return true;
         }
 
-        for (auto val : lineFeatures) {
-            pool.push_back(val);
+    private:
+        const char* cursor_;
+        const char* end_;
+    };
+
+    inline bool parseDouble(const char* begin, const char* end, double* value) {
+        if (begin < end && *begin == '+') {
+            ++begin;
         }
-        target.push_back(t);
-        ++linesCount;
+#if defined(__cpp_lib_to_chars)
+        auto result = std::from_chars(begin, end, *value);
+        return result.ec == std::errc() && result.ptr == end;
+#else
+        char buffer[64];
+        const size_t size = end - begin;
+        if (size == 0 || size >= sizeof(buffer)) {
+            return false;
+        }
+        std::memcpy(buffer, begin, size);
+        buffer[size] = 0;
+        char* parsedEnd = nullptr;
+        *value = std::strtod(buffer, &parsedEnd);
+        return parsedEnd == buffer + size;
+#endif
     }
-    std::cout << "read  #" << linesCount << " lines" << std::endl;
-    std::cout << "fCount  #" << fCount << std::endl;
 
-    auto data = VecFactory::create(ComputeDeviceType::Cpu, pool.size());
-    VecRef<float> dst = data.arrayRef();
-    std::copy(pool.begin(), pool.end(), dst.begin());
+    inline bool parseInt(const char* begin, const char* end, int64_t* value) {
+        if (begin < end && *begin == '+') {
+            ++begin;
+        }
+        auto result = std::from_chars(begin, end, *value);
+        return result.ec == std::errc() && result.ptr == end;
+    }
+
+    int64_t countTokens(const char* begin, const char* end) {
+        LineTokenizer tokenizer(begin, end);
+        const char* tokenBegin;
+        const char* tokenEnd;
+        int64_t count = 0;
+        while (tokenizer.next(&tokenBegin, &tokenEnd)) {
+            ++count;
+        }
+        return count;
+    }
+
+    std::vector<TextChunk> splitIntoChunks(const char* data, int64_t size, int64_t chunksCount) {
+        std::vector<TextChunk> chunks;
+        const char* end = data + size;
+        const char* cursor = data;
+        for (int64_t i = 1; i <= chunksCount && cursor < end; ++i) {
+            const char* chunkEnd = i == chunksCount ? end : data + size * i / chunksCount;
+            if (chunkEnd < cursor) {
+                continue;
+            }
+            //chunks end right after line break
+            chunkEnd = chunkEnd == end ? end : std::min(lineEnd(chunkEnd, end) + 1, end);
+            TextChunk chunk;
+            chunk.begin_ = cursor;
+            chunk.end_ = chunkEnd;
+            chunks.push_back(chunk);
+            cursor = chunkEnd;
+        }
+        return chunks;
+    }
+
+    void countLines(TextChunk* chunk) {
+        const char* cursor = chunk->begin_;
+        while (cursor < chunk->end_) {
+            const char* eol = lineEnd(cursor, chunk->end_);
+            ++chunk->linesCount_;
+            if (!isEmptyLine(cursor, eol)) {
+                ++chunk->rowsCount_;
+            }
+            cursor = eol + 1;
+        }
+    }
+
+    struct ParsedColumns {
+        int64_t featuresCount_ = 0;
+        float* features_ = nullptr;
+        float* target_ = nullptr;
+        int64_t* queryIds_ = nullptr;
+        int64_t* groupIds_ = nullptr;
+    };
+
+    void parseChunk(const ParsedColumns& dst, TextChunk* chunk) {
+        const char* cursor = chunk->begin_;
+        int64_t line = chunk->firstLine_;
+        int64_t row = chunk->firstRow_;
+
+        auto fail = [&](const std::string& message) {
+            chunk->errorLine_ = line;
+            chunk->error_ = message;
+        };
 
+        for (; cursor < chunk->end_; ++line) {
+            const char* eol = lineEnd(cursor, chunk->end_);
+            if (isEmptyLine(cursor, eol)) {
+                cursor = eol + 1;
+                continue;
+            }
 
-    auto targetVec = VecFactory::create(ComputeDeviceType::Cpu, target.size());
-    std::copy(target.begin(), target.end(), targetVec.arrayRef().begin());
+            LineTokenizer tokenizer(cursor, eol);
+            const char* tokenBegin;
+            const char* tokenEnd;
+            double value = 0;
 
-    Mx mx(data, linesCount, fCount);
-    return DataSet(mx, targetVec);
+            if (!tokenizer.next(&tokenBegin, &tokenEnd)) {
+                return fail("qid is missing");
+            }
+            if (!parseInt(tokenBegin, tokenEnd, &dst.queryIds_[row])) {
+                dst.queryIds_[row] = NamedIdPlaceholder;
+                chunk->namedQueryIds_.emplace_back(row, std::string(tokenBegin, tokenEnd));
+            }
+            if (!tokenizer.next(&tokenBegin, &tokenEnd) || !parseDouble(tokenBegin, tokenEnd, &value)) {
+                return fail("can't parse target");
+            }
+            dst.target_[row] = static_cast<float>(value);
+            if (!tokenizer.next(&tokenBegin, &tokenEnd)) {
+                return fail("url is missing");
+            }
+            if (!tokenizer.next(&tokenBegin, &tokenEnd)) {
+                return fail("gid is missing");
+            }
+            if (!parseInt(tokenBegin, tokenEnd, &dst.groupIds_[row])) {
+                dst.groupIds_[row] = NamedIdPlaceholder;
+                chunk->namedGroupIds_.emplace_back(row, std::string(tokenBegin, tokenEnd));
+            }
+
+            float* features = dst.features_ + row * dst.featuresCount_;
+            int64_t f = 0;
+            for (; tokenizer.next(&tokenBegin, &tokenEnd); ++f) {
+                if (f == dst.featuresCount_) {
+                    return fail("more than " + std::to_string(dst.featuresCount_) + " features");
+                }
+                if (!parseDouble(tokenBegin, tokenEnd, &value)) {
+                    return fail("can't parse feature #" + std::to_string(f) + ": '" + std::string(tokenBegin, tokenEnd) + "'");
+                }
+                features[f] = static_cast<float>(value);
+            }
+            if (f != dst.featuresCount_) {
+                return fail("expected " + std::to_string(dst.featuresCount_) + " features, got " + std::to_string(f));
+            }
+
+            ++row;
+            cursor = eol + 1;
+        }
+    }
 
+    /*
+     * Non-numeric ids are mapped to dense ids after max numeric id of column in order of first occurrence,
+     * so equal names get equal ids and never collide with numeric ones
+     */
+    void internNamedIds(const std::vector<TextChunk>& chunks,
+                        std::vector<std::pair<int64_t, std::string>> TextChunk::*named,
+                        int64_t* ids, int64_t rowsCount) {
+        bool hasNamed = false;
+        for (const auto& chunk : chunks) {
+            hasNamed |= !(chunk.*named).empty();
+        }
+        if (!hasNamed) {
+            return;
+        }
+
+        int64_t nextId = 0;
+        for (int64_t row = 0; row < rowsCount; ++row) {
+            if (ids[row] != NamedIdPlaceholder) {
+                nextId = std::max(nextId, ids[row] + 1);
+            }
+        }
+
+        std::unordered_map<std::string, int64_t> internedIds;
+        for (const auto& chunk : chunks) {
+            for (const auto& rowName : chunk.*named) {
+                auto interned = internedIds.emplace(rowName.second, nextId);
+                if (interned.second) {
+                    ++nextId;
+                }
+                ids[rowName.first] = interned.first->second;
+            }
+        }
+    }
 }
 
+/*
+ * File is mapped and split into chunks on line boundaries. First pass counts lines of chunks in parallel,
+ * which gives every chunk its first sample index, second pass parses chunks in parallel straight into dataset storage.
+ * Non-numeric qid and gid are interned (see internNamedIds).
+ * Empty lines are skipped and parsing goes on: old stream parser stopped at the first empty line and dropped the rest of file
+ */
+DataSet loadFeaturesTxt(const std::string& file) {
+    MappedFile mapped(file);
+    const char* data = mapped.data();
+
+    auto& pool = GlobalThreadPool<0>();
+    auto chunks = splitIntoChunks(data, mapped.size(), std::max<int64_t>(pool.numThreads() * ChunksPerThread, 1));
+    parallelFor(0, chunks.size(), [&](int64_t i) {
+        countLines(&chunks[i]);
+    });
+
+    int64_t linesCount = 0;
+    int64_t rowsCount = 0;
+    for (auto& chunk : chunks) {
+        chunk.firstLine_ = linesCount;
+        chunk.firstRow_ = rowsCount;
+        linesCount += chunk.linesCount_;
+        rowsCount += chunk.rowsCount_;
+    }
+
+    int64_t fCount = 0;
+    for (const char* cursor = data; rowsCount && cursor < data + mapped.size(); ) {
+        const char* eol = lineEnd(cursor, data + mapped.size());
+        if (!isEmptyLine(cursor, eol)) {
+            fCount = countTokens(cursor, eol) - FeaturesTxtHeaderColumns;
+            break;
+        }
+        cursor = eol + 1;
+    }
+    if (fCount < 0) {
+        throw std::runtime_error(file + ": first line has only " + std::to_string(fCount + FeaturesTxtHeaderColumns)
+            + " columns, expected qid, target, url, gid and features");
+    }
+
+    auto samples = Vec(torch::empty({rowsCount * fCount}, torch::TensorOptions().dtype(torch::kFloat32)));
+    auto target = Vec(torch::empty({rowsCount}, torch::TensorOptions().dtype(torch::kFloat32)));
+    auto queryIds = Buffer<int64_t>::createUninitialized(rowsCount);
+    auto groupIds = Buffer<int64_t>::createUninitialized(rowsCount);
+
+    ParsedColumns columns;
+    columns.featuresCount_ = fCount;
+    columns.features_ = samples.arrayRef().data();
+    columns.target_ = target.arrayRef().data();
+    columns.queryIds_ = queryIds.arrayRef().data();
+    columns.groupIds_ = groupIds.arrayRef().data();
+
+    parallelFor(0, chunks.size(), [&](int64_t i) {
+        parseChunk(columns, &chunks[i]);
+    });
+
+    for (const auto& chunk : chunks) {
+        if (chunk.errorLine_ >= 0) {
+            throw std::runtime_error(file + ":" + std::to_string(chunk.errorLine_ + 1) + ": " + chunk.error_);
+        }
+    }
+    internNamedIds(chunks, &TextChunk::namedQueryIds_, columns.queryIds_, rowsCount);
+    internNamedIds(chunks, &TextChunk::namedGroupIds_, columns.groupIds_, rowsCount);
+
+    if (linesCount != rowsCount) {
+        std::cout << "skipped #" << linesCount - rowsCount << " empty lines" << std::endl;
+    }
+    std::cout << "read  #" << rowsCount << " lines" << std::endl;
+    std::cout << "fCount  #" << fCount << std::endl;
+
+    Mx mx(samples, rowsCount, fCount);
+    DataSet ds(mx, target);
+    ds.setQueryIds(queryIds);
+    ds.setGroupIds(groupIds);
+    return ds;
+}
+
+DataSet loadDataSet(const std::string& file) {
+    if (isDataSetBinary(file)) {
+        return loadDataSetBinary(file);
+    }
+    return loadFeaturesTxt(file);
+}
@@ -3,3 +3,6 @@
 
 
 DataSet loadFeaturesTxt(const std::string& file);
+
+//binary dataset file (see dataset_binary.h) or features.txt
+DataSet loadDataSet(const std::string& file);
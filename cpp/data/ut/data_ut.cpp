@@ -3,15 +3,81 @@
 #include <gtest/gtest.h>
 #include <data/grid_builder.h>
 #include <data/binarized_dataset.h>
+#include <data/histogram.h>
+#include <data/dataset_binary.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <unistd.h>
 
 #define EPS 1e-5
 #define PATH_PREFIX "../../../../"
 
+namespace {
+    //new empty file with unique name in temp dir, so concurrent test runs don't share it
+    std::string createTempFile(const std::string& suffix) {
+        std::string path = ::testing::TempDir() + "data_ut_XXXXXX" + suffix;
+        const int fd = mkstemps(&path[0], suffix.size());
+        if (fd < 0) {
+            throw std::runtime_error("can't create temp file " + path);
+        }
+        close(fd);
+        return path;
+    }
+}
+
 TEST(Data, TestLoad) {
     auto ds = loadFeaturesTxt(PATH_PREFIX "test_data/featuresTxt/train");
     EXPECT_EQ(ds.samplesCount(), 12465);
     EXPECT_EQ(ds.featuresCount(), 50);
 
+    ASSERT_TRUE(ds.hasQueryIds());
+    ASSERT_TRUE(ds.hasGroupIds());
+    EXPECT_EQ(ds.queryIds()[0], 10);
+    EXPECT_EQ(ds.groupIds()[0], 21);
+    EXPECT_EQ(ds.groupIds()[1], 4);
+    EXPECT_FLOAT_EQ(ds.fVal(0, 0), 0.345548f);
+}
+
+TEST(Data, TestLoadErrors) {
+    const auto path = createTempFile("_bad_features.txt");
+    std::ofstream out(path);
+    out << "1\t0\turl\t2\t0.5\t0.7\n";
+    out << "1\t0\turl\t2\t0.5\n";
+    out.close();
+    try {
+        loadFeaturesTxt(path);
+        ADD_FAILURE() << "column count mismatch should be reported";
+    } catch (const std::runtime_error& e) {
+        EXPECT_NE(std::string(e.what()).find(path + ":2"), std::string::npos);
+    }
+    std::remove(path.c_str());
+}
+
+TEST(Data, TestLoadNamedIds) {
+    const auto path = createTempFile("_named_ids.txt");
+    std::ofstream out(path);
+    out << "q1\t0\turl\t7\t0.5\n";
+    out << "5\t1\turl\tg\t0.7\n";
+    out << "\n";
+    out << "q2\t0\turl\tg\t0.1\n";
+    out << "q1\t1\turl\t3\t0.2\n";
+    out.close();
+
+    //named ids go after max numeric id in order of first occurrence, empty lines are skipped
+    auto ds = loadFeaturesTxt(path);
+    ASSERT_EQ(ds.samplesCount(), 4);
+    EXPECT_EQ(ds.queryIds()[0], 6);
+    EXPECT_EQ(ds.queryIds()[1], 5);
+    EXPECT_EQ(ds.queryIds()[2], 7);
+    EXPECT_EQ(ds.queryIds()[3], 6);
+    EXPECT_EQ(ds.groupIds()[0], 7);
+    EXPECT_EQ(ds.groupIds()[1], 8);
+    EXPECT_EQ(ds.groupIds()[2], 8);
+    EXPECT_EQ(ds.groupIds()[3], 3);
+    EXPECT_FLOAT_EQ(ds.fVal(2, 0), 0.1f);
+    std::remove(path.c_str());
 }
 
 TEST(Data, TesGrid) {
@@ -60,15 +126,64 @@ TEST(Data, TestBinarize) {
 
             for (int64_t f = 0; f < grid->nzFeaturesCount(); ++f) {
                 int64_t origFeatureIndex = grid->origFeatureIndex(f);
-                // TODO this peace started to fail to compile for some reason
-//                bds->visitFeature(f, [&](int64_t lineIdx, int64_t bin) {
-//                    EXPECT_EQ(computeBin(ds.sample(lineIdx).get(origFeatureIndex), grid->borders(f)), bin);
-//                });
+                auto borders = grid->borders(f);
+                bds->visitFeature(f, [&](int, int64_t lineIdx, uint8_t bin) {
+                    const float val = ds.fVal(lineIdx, origFeatureIndex);
+                    int32_t expected = 0;
+                    while (expected < (int32_t)borders.size() && borders[expected] < val) {
+                        ++expected;
+                    }
+                    EXPECT_EQ(expected, bin);
+                });
             }
         }
     }
 }
 
+TEST(Data, BinarizedViews) {
+    auto ds = loadFeaturesTxt(PATH_PREFIX "test_data/featuresTxt/train");
+    BinarizationConfig config;
+    config.bordersCount_ = 32;
+    auto grid = buildGrid(ds, config);
+    const int64_t fCount = grid->nzFeaturesCount();
+
+    //every other sample in reversed order
+    std::vector<int32_t> indices;
+    for (int64_t i = ds.samplesCount() - 1; i >= 0; i -= 2) {
+        indices.push_back(i);
+    }
+
+    for (int32_t groupSize : {1, 5, 16, 64}) {
+        auto bds = binarize(ds, grid, groupSize);
+
+        std::vector<std::vector<uint8_t>> expected(fCount, std::vector<uint8_t>(ds.samplesCount()));
+        for (int64_t f = 0; f < fCount; ++f) {
+            bds->visitFeature(f, [&](int, int64_t lineIdx, uint8_t bin) {
+                expected[f][lineIdx] = bin;
+            });
+        }
+
+        std::vector<uint8_t> row(fCount);
+        for (int64_t i = 0; i < ds.samplesCount(); i += 97) {
+            bds->sampleBins(i, row);
+            for (int64_t f = 0; f < fCount; ++f) {
+                EXPECT_EQ(row[f], expected[f][i]);
+            }
+        }
+
+        std::atomic<int64_t> visited(0);
+        bds->visitSampleBlocks(indices, [&](int, int64_t first, int64_t count, const uint8_t* bins) {
+            for (int64_t f = 0; f < fCount; ++f) {
+                for (int64_t i = 0; i < count; ++i) {
+                    EXPECT_EQ(bins[f * count + i], expected[f][indices[first + i]]);
+                }
+            }
+            visited += count;
+        }, 100);
+        EXPECT_EQ(visited.load(), (int64_t)indices.size());
+    }
+}
+
 TEST(Data, GridSerialization) {
     auto ds = loadFeaturesTxt(PATH_PREFIX "test_data/featuresTxt/train");
     EXPECT_EQ(ds.samplesCount(), 12465);
@@ -107,3 +222,100 @@ TEST(Data, GridSerialization) {
         }
     }
 }
+
+TEST(Data, BinaryDataSet) {
+    auto ds = loadFeaturesTxt(PATH_PREFIX "test_data/featuresTxt/train");
+
+    BinarizationConfig config;
+    config.bordersCount_ = 32;
+    auto grid = buildGrid(ds, config);
+    const auto& bds = cachedBinarize(ds, grid, 8);
+
+    const auto path = createTempFile("_dataset.bin");
+    saveDataSetBinary(ds, path, &bds);
+    ASSERT_TRUE(isDataSetBinary(path));
+
+    auto loaded = loadDataSet(path);
+    ASSERT_EQ(loaded.samplesCount(), ds.samplesCount());
+    ASSERT_EQ(loaded.featuresCount(), ds.featuresCount());
+    for (int64_t i = 0; i < ds.samplesCount() * ds.featuresCount(); ++i) {
+        ASSERT_EQ(loaded.samples()[i], ds.samples()[i]);
+    }
+    for (int64_t i = 0; i < ds.samplesCount(); ++i) {
+        ASSERT_EQ(loaded.labels()[i], ds.labels()[i]);
+    }
+
+    auto loadedGrid = loadBinarizationBinary(loaded, path);
+    ASSERT_TRUE(loadedGrid);
+    ASSERT_EQ(loadedGrid->nzFeaturesCount(), grid->nzFeaturesCount());
+
+    const auto& loadedBds = cachedBinarize(loaded, loadedGrid, 8);
+    ASSERT_EQ(&loadedBds.owner(), &loaded);
+    for (int64_t f = 0; f < grid->nzFeaturesCount(); ++f) {
+        std::vector<uint8_t> expected(ds.samplesCount());
+        bds.visitFeature(f, [&](int, int64_t lineIdx, uint8_t bin) {
+            expected[lineIdx] = bin;
+        });
+        loadedBds.visitFeature(f, [&](int, int64_t lineIdx, uint8_t bin) {
+            ASSERT_EQ(bin, expected[lineIdx]);
+        });
+    }
+    //mapped data stays valid after unlink
+    std::remove(path.c_str());
+}
+
+namespace {
+    struct SumWeightStat {
+        double Sum = 0;
+        double Weight = 0;
+
+        SumWeightStat& operator+=(const SumWeightStat& other) {
+            Sum += other.Sum;
+            Weight += other.Weight;
+            return *this;
+        }
+    };
+}
+
+TEST(Data, HistogramKernels) {
+    std::mt19937 rand(0);
+    for (int32_t bundleSize : {1, 3, 8, 11, 16, 21, 32, 64}) {
+        std::vector<int32_t> binOffsets(bundleSize + 1);
+        for (int32_t b = 1; b <= bundleSize; ++b) {
+            binOffsets[b] = binOffsets[b - 1] + 1 + rand() % 32;
+        }
+        const int64_t rows = 20000;
+        std::vector<uint8_t> data(rows * bundleSize);
+        for (int64_t i = 0; i < rows; ++i) {
+            for (int32_t b = 0; b < bundleSize; ++b) {
+                data[i * bundleSize + b] = rand() % (binOffsets[b + 1] - binOffsets[b]);
+            }
+        }
+        std::vector<SumWeightStat> stats(rows);
+        std::vector<int32_t> indices(rows);
+        for (int64_t i = 0; i < rows; ++i) {
+            stats[i].Sum = (rand() % 100) / 8.0;
+            stats[i].Weight = rand() % 3;
+            indices[i] = rand() % rows;
+        }
+
+        std::vector<SumWeightStat> expected(binOffsets.back());
+        for (int64_t i = 0; i < rows; ++i) {
+            for (int32_t b = 0; b < bundleSize; ++b) {
+                expected[binOffsets[b] + data[indices[i] * bundleSize + b]] += stats[i];
+            }
+        }
+
+        std::vector<SumWeightStat> histogram(binOffsets.back());
+        buildHistograms<SumWeightStat, int32_t>(bundleSize,
+                                                stats,
+                                                indices,
+                                                ConstVecRef<int32_t>(binOffsets.data(), bundleSize),
+                                                data,
+                                                histogram);
+        for (uint64_t bin = 0; bin < histogram.size(); ++bin) {
+            EXPECT_NEAR(expected[bin].Sum, histogram[bin].Sum, EPS);
+            EXPECT_EQ(expected[bin].Weight, histogram[bin].Weight);
+        }
+    }
+}
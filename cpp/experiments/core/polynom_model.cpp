@@ -8,7 +8,10 @@ torch::Tensor PolynomModel::forward(torch::Tensor samples) {
     auto yDim = TorchHelpers::totalSize(samples) / batchSize;
     samples = samples.reshape({batchSize, yDim}).contiguous();
     if (this->device().is_cpu()) {
-      auto polynomForward = PolynomForward(polynom_);
+      if (polynomCpu_ == nullptr) {
+        polynomCpu_ = std::make_shared<PolynomCpu>(polynom_);
+      }
+      auto polynomForward = PolynomForward(polynomCpu_);
       return polynomForward.apply({samples})[0];
     } else {
       if (polynomCuda_ == nullptr) {
@@ -25,6 +25,7 @@ public:
     void reset(PolynomPtr polynom) {
         polynom_ = std::move(polynom);
         polynomCuda_ = nullptr;
+        polynomCpu_ = nullptr;
     }
 
     void setLambda(double lambda) {
@@ -38,6 +39,7 @@ public:
 private:
     PolynomPtr polynom_;
     PolynomCudaPtr polynomCuda_;
+    PolynomCpuPtr polynomCpu_;
     Monom::MonomType monomType_;
 
 };
@@ -1,11 +1,14 @@
 #include "boosting.h"
 #include <models/ensemble.h>
+#include <core/buffer_pool.h>
+#include <util/parallel_executor.h>
 #include <chrono>
 
 BoostingConfig BoostingConfig::fromJson(const json& params) {
     BoostingConfig opts;
     opts.step_ = params.value("step", opts.step_);
     opts.iterations_ = params.value("iterations", opts.iterations_);
+    opts.listenersQueueSize_ = params.value("listeners_queue_size", opts.listenersQueueSize_);
     return opts;
 }
 
@@ -18,14 +21,33 @@ ModelPtr Boosting::fitFrom(std::vector<ModelPtr> models, const DataSet& dataSet,
 
     Mx cursor(dataSet.samplesCount(), 1);
 
+    //listeners get shared model, so it outlives their task
+    std::unique_ptr<SerialExecutor> listenersExecutor;
+    if (config_.listenersQueueSize_ > 0) {
+        listenersExecutor = std::make_unique<SerialExecutor>(config_.listenersQueueSize_);
+    }
+    auto notify = [&](const ModelPtr& model) {
+        if (listenersExecutor) {
+            listenersExecutor->run([this, model]() {
+                invoke(*model);
+            });
+        } else {
+            invoke(*model);
+        }
+    };
+
     int64_t iter = 0;
     for (; iter < (int64_t)models.size(); ++iter) {
-        invoke(*models[iter]);
+        notify(models[iter]);
         models[iter]->append(dataSet, cursor);
     }
 
     std::cout << "continuing fit from iteration " << iter << std::endl;
 
+    //scratch buffers of weak targets and learners are reused between iterations
+    BufferPoolScope bufferPoolScope;
+    auto& bufferPool = GlobalBufferPool();
+
     for (; iter < config_.iterations_; ++iter) {
         auto weakTarget = weak_target_->create(dataSet, target, cursor);
 
@@ -34,8 +56,33 @@ ModelPtr Boosting::fitFrom(std::vector<ModelPtr> models, const DataSet& dataSet,
         model = model->scale(config_.step_);
         models.push_back(model);
 
-        invoke(*models.back());
+        notify(models.back());
         models.back()->append(dataSet, cursor);
+
+        //buffers not requested during this iteration won't be needed by next ones
+        bufferPool.releaseUnused();
+
+        //with async listeners stop is seen few trees later, they are cut off below
+        if (stopRequested()) {
+            std::cout << "boosting is stopped by listener on iteration " << iter << std::endl;
+            break;
+        }
+    }
+
+    if (listenersExecutor) {
+        listenersExecutor->wait();
+    }
+
+    //trees fitted after stop request are dropped even if listeners don't track best iteration
+    int64_t keepCount = stopEventsCount();
+    const int64_t bestCount = bestEventsCount();
+    if (bestCount > 0 && (keepCount < 0 || bestCount < keepCount)) {
+        keepCount = bestCount;
+    }
+    if (keepCount > 0 && keepCount < static_cast<int64_t>(models.size())) {
+        std::cout << "ensemble is truncated to " << keepCount << " trees" << (keepCount == bestCount ? " (best iteration)" : "")
+                  << std::endl;
+        models.resize(keepCount);
     }
 
     return std::make_shared<Ensemble>(std::move(models));
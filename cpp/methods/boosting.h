@@ -12,6 +12,10 @@
 struct BoostingConfig {
     double step_ = 0.01;
     int64_t iterations_ = 1000;
+    //0 runs listeners in fitting thread. Otherwise listeners run in separate thread and see trees in fitting order,
+    //so evaluation of tree k overlaps fitting of tree k + 1; when this many trees wait for listeners, fitting blocks
+    //(trees are never dropped). Output of listeners could interleave with output of fitting then
+    int64_t listenersQueueSize_ = 0;
 
     static BoostingConfig fromJson(const json& params);
 };
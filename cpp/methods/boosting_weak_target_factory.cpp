@@ -1,6 +1,14 @@
 #include "boosting_weak_target_factory.h"
 #include <core/vec_factory.h>
 #include <targets/linear_l2.h>
+#include <util/exception.h>
+#include <util/parallel_executor.h>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <vector>
 
 BootstrapOptions BootstrapOptions::fromJson(const json& params) {
     BootstrapOptions opts;
@@ -17,10 +25,139 @@ BootstrapOptions BootstrapOptions::fromJson(const json& params) {
         opts.type_ = BootstrapType::Uniform;
     } else if (type == "poisson") {
         opts.type_ = BootstrapType::Poisson;
+    } else if (type == "goss") {
+        opts.type_ = BootstrapType::Goss;
+    } else if (type == "mvs") {
+        opts.type_ = BootstrapType::MinimalVariance;
     }
+    opts.topRate_ = params.value("top_rate", opts.topRate_);
+    opts.mvsReg_ = params.value("mvs_reg", opts.mvsReg_);
     return opts;
 }
 
+namespace {
+    //fixed blocks, so drawn samples don't depend on threads count
+    constexpr int64_t BootstrapBlockSize = 1 << 14;
+    //GOSS and minimal variance thresholds are estimated on this many gradients
+    constexpr int64_t ThresholdSampleSize = 1 << 16;
+
+    //splitmix64 finalizer
+    inline uint64_t mixBits(uint64_t x) {
+        x += 0x9E3779B97F4A7C15ULL;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+        return x ^ (x >> 31);
+    }
+
+    class CounterRandom {
+    public:
+        CounterRandom(uint64_t seed, uint64_t stream)
+            : key_(mixBits(mixBits(seed) ^ stream)) {
+
+        }
+
+        //uniform in (0, 1), depends only on seed, stream and counter
+        double uniform(int64_t counter) const {
+            const uint64_t bits = mixBits(key_ + static_cast<uint64_t>(counter) * 0xD1B54A32D192ED03ULL) >> 11;
+            return (static_cast<double>(bits) + 0.5) / 9007199254740992.0;
+        }
+
+    private:
+        uint64_t key_;
+    };
+
+    //inversion of Poisson(1) cdf
+    inline int32_t poisson1(double u) {
+        double p = 0.36787944117144233;
+        double cdf = p;
+        int32_t k = 0;
+        while (u > cdf && k < 32) {
+            ++k;
+            p /= k;
+            cdf += p;
+        }
+        return k;
+    }
+
+    //scores of at most ThresholdSampleSize samples, sorted by descending
+    template <class Score>
+    std::vector<double> sortedScoresSample(int64_t size, const CounterRandom& random, Score&& score) {
+        std::vector<double> scores;
+        if (size <= ThresholdSampleSize) {
+            scores.resize(size);
+            for (int64_t i = 0; i < size; ++i) {
+                scores[i] = score(i);
+            }
+        } else {
+            scores.resize(ThresholdSampleSize);
+            for (int64_t i = 0; i < ThresholdSampleSize; ++i) {
+                scores[i] = score(std::min<int64_t>(random.uniform(i) * size, size - 1));
+            }
+        }
+        std::sort(scores.begin(), scores.end(), std::greater<double>());
+        return scores;
+    }
+
+    //mu, such that sum of min(1, score / mu) is rate * count; scores are sorted by descending
+    double minimalVarianceThreshold(const std::vector<double>& scores, double rate) {
+        const double expected = rate * scores.size();
+        std::vector<double> suffixSums(scores.size() + 1, 0.0);
+        for (int64_t i = static_cast<int64_t>(scores.size()) - 1; i >= 0; --i) {
+            suffixSums[i] = suffixSums[i + 1] + scores[i];
+        }
+        for (uint64_t saturated = 0; saturated < scores.size() && saturated < expected; ++saturated) {
+            const double mu = suffixSums[saturated] / (expected - saturated);
+            if (scores[saturated] <= mu) {
+                return mu;
+            }
+        }
+        return 0;
+    }
+
+    struct BootstrapSample {
+        Buffer<int32_t> indices_;
+        Vec weights_;
+    };
+
+    //weight(i) is zero for samples, which are not taken. it's called twice for every sample and should be pure
+    template <class Weight>
+    BootstrapSample bootstrap(int64_t size, Weight&& weight) {
+        const int64_t blocksCount = (size + BootstrapBlockSize - 1) / BootstrapBlockSize;
+        std::vector<int64_t> offsets(blocksCount + 1, 0);
+        parallelFor(0, blocksCount, [&](int64_t block) {
+            const int64_t last = std::min<int64_t>(size, (block + 1) * BootstrapBlockSize);
+            int64_t count = 0;
+            for (int64_t i = block * BootstrapBlockSize; i < last; ++i) {
+                count += weight(i) > 0;
+            }
+            offsets[block + 1] = count;
+        });
+        for (int64_t block = 0; block < blocksCount; ++block) {
+            offsets[block + 1] += offsets[block];
+        }
+
+        BootstrapSample sample;
+        sample.indices_ = Buffer<int32_t>::createUninitialized(offsets.back());
+        sample.weights_ = Vec(torch::empty({offsets.back()}, torch::TensorOptions().dtype(torch::kFloat32)));
+        auto indices = sample.indices_.arrayRef();
+        auto weights = sample.weights_.arrayRef();
+
+        parallelFor(0, blocksCount, [&](int64_t block) {
+            const int64_t last = std::min<int64_t>(size, (block + 1) * BootstrapBlockSize);
+            int64_t cursor = offsets[block];
+            for (int64_t i = block * BootstrapBlockSize; i < last; ++i) {
+                const double w = weight(i);
+                if (w > 0) {
+                    indices[cursor] = static_cast<int32_t>(i);
+                    weights[cursor] = static_cast<float>(w);
+                    ++cursor;
+                }
+            }
+        });
+        return sample;
+    }
+}
+
 SharedPtr<Target> GradientBoostingWeakTargetFactory::create(
     const DataSet& ds,
     const Target& target,
@@ -31,57 +168,83 @@ SharedPtr<Target> GradientBoostingWeakTargetFactory::create(
     return std::static_pointer_cast<Target>(std::make_shared<LinearL2>(ds, der, l2reg_));
 }
 
-template <class Rand>
-std::vector<int32_t> uniformBootstrap(int64_t size, double rate, Rand&& rand) {
-    std::vector<int32_t> indices;
-    for (int64_t i = 0; i < size; ++i) {
-        if (rand() <  rate) {
-            indices.push_back(i);
-        }
-    }
-    return indices;
-}
-
 SharedPtr<Target> GradientBoostingBootstrappedWeakTargetFactory::create(
     const DataSet& ds,
     const Target& target,
     const Mx& startPoint) {
-    std::vector<int32_t> nzIndices;
-    std::vector<double> nzWeights;
+    const int64_t size = target.dim();
+    const uint64_t iteration = iteration_++;
+    const CounterRandom random(options_.seed_, iteration);
+    const auto& pointwiseTarget = dynamic_cast<const PointwiseTarget&>(target);
 
+    if (options_.type_ == BootstrapType::Goss || options_.type_ == BootstrapType::MinimalVariance) {
+        const Vec cursor = startPoint;
+        Vec fullDer(size);
+        target.gradientTo(cursor, fullDer);
+        auto gradients = fullDer.arrayRef();
+        //thresholds are estimated on separate stream of random values
+        const CounterRandom thresholdRandom(options_.seed_ ^ 0x5851F42D4C957F2DULL, iteration);
+
+        BootstrapSample sample;
+        if (options_.type_ == BootstrapType::Goss) {
+            VERIFY(options_.topRate_ >= 0 && options_.topRate_ < options_.sampleRate_ && options_.sampleRate_ <= 1,
+                   "GOSS needs 0 <= top rate < sample rate <= 1, got " << options_.topRate_ << " and " << options_.sampleRate_);
+            auto scores = sortedScoresSample(size, thresholdRandom, [&](int64_t i) {
+                return std::abs(gradients[i]);
+            });
+            const auto topCount = static_cast<int64_t>(options_.topRate_ * scores.size());
+            const double threshold = topCount ? scores[topCount - 1] : std::numeric_limits<double>::infinity();
+            const double otherRate = (options_.sampleRate_ - options_.topRate_) / (1.0 - options_.topRate_);
+            sample = bootstrap(size, [&](int64_t i) -> double {
+                if (std::abs(gradients[i]) >= threshold) {
+                    return 1.0;
+                }
+                return random.uniform(i) < otherRate ? 1.0 / otherRate : 0.0;
+            });
+        } else {
+            VERIFY(options_.sampleRate_ > 0 && options_.sampleRate_ <= 1, "Minimal variance sampling needs 0 < sample rate <= 1");
+            const double reg = options_.mvsReg_;
+            auto score = [&](int64_t i) -> double {
+                return std::sqrt(static_cast<double>(gradients[i]) * gradients[i] + reg);
+            };
+            const double mu = minimalVarianceThreshold(sortedScoresSample(size, thresholdRandom, score), options_.sampleRate_);
+            sample = bootstrap(size, [&](int64_t i) -> double {
+                const double p = mu > 0 ? std::min(1.0, score(i) / mu) : 1.0;
+                return random.uniform(i) < p ? 1.0 / p : 0.0;
+            });
+        }
+
+        Vec der(torch::empty({sample.indices_.size()}, torch::TensorOptions().dtype(torch::kFloat32)));
+        auto derRef = der.arrayRef();
+        auto indices = sample.indices_.arrayRef();
+        parallelFor(0, sample.indices_.size(), [&](int64_t i) {
+            derRef[i] = gradients[indices[i]];
+        });
+        return std::static_pointer_cast<Target>(std::make_shared<LinearL2>(ds, der, sample.weights_, sample.indices_, l2reg_));
+    }
+
+    BootstrapSample sample;
     if (options_.type_ == BootstrapType::None) {
-        nzWeights.resize(target.dim());
-        nzIndices.resize(target.dim());
-        std::iota(nzIndices.begin(), nzIndices.end(), 0);
-        std::fill(nzWeights.begin(), nzWeights.end(), 1.0);
+        sample = bootstrap(size, [](int64_t) {
+            return 1.0;
+        });
     } else if (options_.type_ == BootstrapType::Uniform) {
-        nzIndices = uniformBootstrap(target.dim(), options_.sampleRate_, [&]() -> double {
-            return uniform_(engine_);
+        const double rate = options_.sampleRate_;
+        sample = bootstrap(size, [&](int64_t i) {
+            return random.uniform(i) < rate ? 1.0 : 0.0;
+        });
+    } else if (options_.type_ == BootstrapType::Poisson) {
+        sample = bootstrap(size, [&](int64_t i) {
+            return static_cast<double>(poisson1(random.uniform(i)));
         });
-        nzWeights.resize(nzIndices.size());
-        std::fill(nzWeights.begin(), nzWeights.end(), 1.0);
-    } else if(options_.type_ == BootstrapType::Poisson) {
-        for (int32_t i = 0; i < target.dim(); ++i) {
-            double w =  poisson_(engine_);
-            if (w > 0) {
-                nzWeights.push_back(w);
-                nzIndices.push_back(i);
-            }
-        }
     } else {
-        nzWeights.resize(target.dim());
-        nzIndices.resize(target.dim());
-        std::iota(nzIndices.begin(), nzIndices.end(), 0);
-        for (uint64_t i = 0; i < nzWeights.size(); ++i) {
-            nzWeights[i] = -log(uniform_(engine_) + 1e-20);
-        }
+        sample = bootstrap(size, [&](int64_t i) {
+            return -std::log(random.uniform(i));
+        });
     }
 
-    Vec der(nzWeights.size());
-    Vec weights = VecFactory::fromVector(nzWeights);
-    Buffer<int32_t> indices = Buffer<int32_t>::fromVector(nzIndices);
-    const auto& pointwiseTarget = dynamic_cast<const PointwiseTarget&>(target);
-    pointwiseTarget.subsetDer(startPoint, indices, der);
+    Vec der(torch::empty({sample.indices_.size()}, torch::TensorOptions().dtype(torch::kFloat32)));
+    pointwiseTarget.subsetDer(startPoint, sample.indices_, der);
     // TODO this god damn params...
-    return std::static_pointer_cast<Target>(std::make_shared<LinearL2>(ds, der, weights, indices, l2reg_));
+    return std::static_pointer_cast<Target>(std::make_shared<LinearL2>(ds, der, sample.weights_, sample.indices_, l2reg_));
 }
@@ -29,12 +29,21 @@ enum class BootstrapType {
     None,
     Bayessian,
     Uniform,
-    Poisson
+    Poisson,
+    //gradient-based one-side sampling: samples with largest |gradient| are kept, others are sampled uniformly
+    Goss,
+    //minimal variance sampling: sample is taken with probability proportional to its regularized |gradient|
+    MinimalVariance
 };
 
 struct BootstrapOptions {
     BootstrapType type_ = BootstrapType::Poisson;
+    //expected share of samples for uniform, GOSS and minimal variance sampling
     double sampleRate_ = 0.7;
+    //GOSS: share of samples with largest |gradient|, which are always taken
+    double topRate_ = 0.2;
+    //minimal variance sampling: probabilities are proportional to sqrt(gradient^2 + mvsReg_)
+    double mvsReg_ = 0;
     uint32_t seed_ = 42;
 
     static BootstrapOptions fromJson(const json& params);
@@ -45,19 +54,20 @@ public:
     // TODO remove l2reg from here
     GradientBoostingBootstrappedWeakTargetFactory(BootstrapOptions options, double l2reg)
     : options_(std::move(options))
-    , l2reg_(l2reg)
-    , engine_(options_.seed_) {
+    , l2reg_(l2reg) {
 
     }
 
+    /*
+     * Random values come from counter-based generator: value for sample is a hash of (seed, iteration, sample),
+     * so samples are drawn in parallel blocks and result doesn't depend on threads count.
+     * Blocks count their samples first, then write indices and weights straight into target buffers
+     */
     virtual SharedPtr<Target> create(const DataSet& ds,
                                      const Target& target,
                                      const Mx& startPoint) override;
 private:
     BootstrapOptions options_;
     double l2reg_;
-    std::default_random_engine engine_;
-    std::uniform_real_distribution<double> uniform_ = std::uniform_real_distribution<double>(0, 1);
-    std::poisson_distribution<int> poisson_ = std::poisson_distribution<int>(1);
-
+    uint64_t iteration_ = 0;
 };
@@ -1,5 +1,6 @@
 #include "greedy_linear_oblivious_trees.h"
 
+#include <algorithm>
 #include <memory>
 #include <set>
 #include <stdexcept>
@@ -32,6 +33,8 @@ GreedyLinearObliviousTreeLearnerOptions GreedyLinearObliviousTreeLearnerOptions:
     GreedyLinearObliviousTreeLearnerOptions opts;
     opts.l2reg = params.value("l2reg", opts.l2reg);
     opts.maxDepth = params.value("depth", opts.maxDepth);
+    opts.statsMemoryLimitMb = params.value("stats_memory_limit_mb", opts.statsMemoryLimitMb);
+    opts.subtractParentStats = params.value("subtract_parent_stats", opts.subtractParentStats);
     return opts;
 }
 
@@ -40,33 +43,35 @@ class LinearObliviousTreeLeafLearner : std::enable_shared_from_this<LinearOblivi
 public:
     LinearObliviousTreeLeafLearner(
             GridPtr grid,
-            int nUsedFeatures)
+            int nUsedFeatures,
+            int maxSize)
             : grid_(std::move(grid))
-            , stats_(MultiDimArray<1, LinearL2Stat>({(int)grid_->totalBins()}, nUsedFeatures + 1, nUsedFeatures))
+            , stats_(grid_->totalBins(), maxSize)
             , nUsedFeatures_(nUsedFeatures) {
         id_ = 0;
         (void)nUsedFeatures_;
     }
 
-    double splitScore(const StatBasedLoss<LinearL2Stat>& target, int fId, int condId) {
+    // adds left and right stats of split to batch
+    void addSplitStats(int fId, int condId, LinearL2StatBatch* batch) const {
         int bin = grid_->binOffsets()[fId] + condId;
         int lastBin = (int)grid_->binOffsets()[fId] + (int)grid_->conditionsCount(fId);
 
-        auto& leftStat = stats_[bin];
-        auto rightStat = stats_[lastBin] - leftStat;
-
-        return target.score(leftStat) + target.score(rightStat);
+        batch->add(stats_, bin);
+        batch->addDifference(stats_, lastBin, bin);
     }
 
-    void fit(double l2reg, int size = 0) {
-        w_ = stats_[grid_->totalBins() - 1].getWHat(l2reg, size);
+    void fit(double l2reg, int size) {
+        LinearL2Stat stat(stats_.maxSize(), size);
+        stats_.fill(grid_->totalBins() - 1, size, &stat);
+        w_ = stat.getWHat(l2reg, size);
     }
 
     std::pair<std::shared_ptr<LinearObliviousTreeLeafLearner>, std::shared_ptr<LinearObliviousTreeLeafLearner>>
-    split(int32_t fId, int32_t condId, int nUsedFeatures) {
+    split(int32_t fId, int32_t condId, int nUsedFeatures, int maxSize) {
 
-        auto left = std::make_shared<LinearObliviousTreeLeafLearner>(grid_, nUsedFeatures);
-        auto right = std::make_shared<LinearObliviousTreeLeafLearner>(grid_, nUsedFeatures);
+        auto left = std::make_shared<LinearObliviousTreeLeafLearner>(grid_, nUsedFeatures, maxSize);
+        auto right = std::make_shared<LinearObliviousTreeLeafLearner>(grid_, nUsedFeatures, maxSize);
 
         initChildren(left, right, fId, condId);
 
@@ -81,16 +86,18 @@ public:
     }
 
     void printHists() {
+        LinearL2Stat stat(stats_.maxSize(), 0);
         for (int fId = 0; fId < grid_->nzFeaturesCount(); ++fId) {
             int offset = grid_->binOffsets()[fId];
             for (int bin = 0; bin <= (int)grid_->conditionsCount(fId); ++bin) {
                 int absBin = offset + bin;
                 std::cout << "  fId=" << fId << ", bin=" << bin << std::endl;
                 if (bin == 0) {
-                    std::cout << "    " << stats_[absBin] << std::endl;
+                    stats_.fill(absBin, stats_.maxSize(), &stat);
                 } else {
-                    std::cout << "    " << (stats_[absBin] - stats_[absBin - 1]) << std::endl;
+                    stats_.fillDifference(absBin, absBin - 1, stats_.maxSize(), &stat);
                 }
+                std::cout << "    " << stat << std::endl;
                 std::cout << std::endl;
             }
         }
@@ -125,7 +132,8 @@ private:
 //    std::set<int32_t> usedFeatures_;
 //    std::vector<int32_t> usedFeaturesInOrder_;
     LinearL2Stat::EMx w_;
-    MultiDimArray<1, LinearL2Stat> stats_;
+    // cell per bin
+    LinearL2StatArena stats_;
 
     unsigned int nUsedFeatures_;
 
@@ -139,7 +147,7 @@ ModelPtr GreedyLinearObliviousTreeLearner::fit(const DataSet& ds, const Target&
     cacheDs(ds);
     resetState();
 
-    auto bds = cachedBinarize(ds, grid_, fCount_);
+    const auto& bds = cachedBinarize(ds, grid_);
 
     auto indices = target.indices();
     indices_ = indices.arrayRef();
@@ -205,9 +213,13 @@ ModelPtr GreedyLinearObliviousTreeLearner::fit(const DataSet& ds, const Target&
         updateNewLeaves(bds, ds, oldNUsedFeatures, ys, ws);
         TIME_BLOCK_END(UPDATE_NEW_LEAVES)
 
+        if (opts_.subtractParentStats && oldNUsedFeatures == (int)usedFeatures_.size()) {
+            parentLeaves_ = std::move(leaves_);
+        }
         leaves_ = newLeaves_;
         newLeaves_.clear();
     }
+    parentLeaves_.clear();
 
     TIME_BLOCK_START(FINAL_FIT)
     parallelFor(0, leaves_.size(), [&](int lId) {
@@ -218,7 +230,7 @@ ModelPtr GreedyLinearObliviousTreeLearner::fit(const DataSet& ds, const Target&
 
     std::vector<LinearObliviousTreeLeaf> inferenceLeaves;
     for (auto& l : leaves_) {
-        inferenceLeaves.emplace_back(usedFeaturesOrdered_, l->w_, l->stats_[totalBins_ - 1].w_);
+        inferenceLeaves.emplace_back(usedFeaturesOrdered_, l->w_, l->stats_.weight(totalBins_ - 1));
     }
 
     tree->leaves_ = std::move(inferenceLeaves);
@@ -262,16 +274,27 @@ void GreedyLinearObliviousTreeLearner::cacheDs(const DataSet &ds) {
     fullUpdate_.resize(1U << (unsigned)opts_.maxDepth, false);
     samplesLeavesCnt_.resize(1U << (unsigned)opts_.maxDepth, 0);
 
-    auto sizeV = std::vector<int>({nThreads_});
-    corStats_ = std::make_unique<MultiDimArray<1, MultiDimArray<2, LinearL2CorStat>>>(sizeV);
-    stats_ = std::make_unique<MultiDimArray<1, MultiDimArray<2, LinearL2Stat>>>(sizeV);
+    const int maxSize = opts_.maxDepth + 1;
+    const int64_t cellsCount = (int64_t)(1 << opts_.maxDepth) * totalBins_;
+    const int64_t copyBytes = cellsCount * sizeof(float)
+            * (LinearL2StatArena::cellSize(maxSize) + LinearL2CorStatArena::cellSize(maxSize));
+    // leaf stats don't depend on sharing but take their part of the limit: at most new leaves of the last level
+    // and their parents (or parents and grandparents, see parentLeaves_) are alive, each not larger than a scratch cell
+    const int64_t leavesBytes = cellsCount * sizeof(float) * LinearL2StatArena::cellSize(maxSize) * 3 / 2;
+    sharedStats_ = nThreads_ > 1 && leavesBytes + copyBytes * nThreads_ > opts_.statsMemoryLimitMb * (1LL << 20);
+    const int copiesCount = sharedStats_ ? 1 : nThreads_;
+    if (sharedStats_) {
+        std::cout << "linear tree stats: " << nThreads_ << " copies of " << (copyBytes >> 20)
+                  << "MB and " << (leavesBytes >> 20) << "MB of leaves don't fit into "
+                  << opts_.statsMemoryLimitMb << "MB, threads share one copy" << std::endl;
+    }
 
-    LinearL2CorStat defaultCorStat(opts_.maxDepth + 1, 0);
-    LinearL2Stat defaultStat(opts_.maxDepth + 1, 0);
+    corStats_.resize(copiesCount);
+    stats_.resize(copiesCount);
 
-    parallelFor(0, nThreads_, [&](int thId) {
-        (*corStats_)[thId] = MultiDimArray<2, LinearL2CorStat>({1 << opts_.maxDepth, totalBins_}, defaultCorStat);
-        (*stats_)[thId] = MultiDimArray<2, LinearL2Stat>({1 << opts_.maxDepth, totalBins_}, defaultStat);
+    parallelFor(0, copiesCount, [&](int thId) {
+        corStats_[thId] = LinearL2CorStatArena(cellsCount, maxSize);
+        stats_[thId] = LinearL2StatArena(cellsCount, maxSize);
     });
 
     xs_ = MultiDimArray<2, float>({(int)ds.samplesCount(), opts_.maxDepth + 1});
@@ -286,25 +309,15 @@ void GreedyLinearObliviousTreeLearner::resetState() {
     leafId_.resize(nSamples_, 0);
     leaves_.clear();
     newLeaves_.clear();
+    parentLeaves_.clear();
     splits_.clear();
 }
 
-void GreedyLinearObliviousTreeLearner::resetStats(int nLeaves, int filledSize) {
-    parallelFor(0, nThreads_, [&](int thId) {
-        auto& thStats = (*stats_)[thId];
-        auto& thCorStats = (*corStats_)[thId];
-        for (int lId = 0; lId < nLeaves; ++lId) {
-            auto leafCorStat = thCorStats[lId];
-            auto leafStat = thStats[lId];
-            for (int bin = 0; bin < totalBins_; ++bin) {
-                auto& corStat = leafCorStat[bin];
-                corStat.reset();
-                corStat.setFilledSize(filledSize);
-                auto& stat = leafStat[bin];
-                stat.reset();
-                stat.setFilledSize(filledSize);
-            }
-        }
+void GreedyLinearObliviousTreeLearner::resetStats(int nLeaves) {
+    const int64_t cellsCount = (int64_t)nLeaves * totalBins_;
+    parallelFor(0, stats_.size(), [&](int thId) {
+        corStats_[thId].reset(0, cellsCount);
+        stats_[thId].reset(0, cellsCount);
     });
 }
 
@@ -331,31 +344,25 @@ void GreedyLinearObliviousTreeLearner::buildRoot(
         const DataSet &ds,
         ConstVecRef<float> ys,
         ConstVecRef<float> ws) {
-    auto root = std::make_shared<LinearObliviousTreeLeafLearner>(this->grid_, 1);
+    // bias and correlations of candidate feature
+    auto root = std::make_shared<LinearObliviousTreeLeafLearner>(this->grid_, 1, std::min(2, opts_.maxDepth + 1));
 
     // TODO again, dirty hack. Handling bias here..
     usedFeatures_.insert(-1);
     usedFeaturesOrdered_.push_back(-1);
     updateXs(-1);
 
-    LinearL2StatOpParams params;
-    params.vecAddMode = LinearL2StatOpParams::FullCorrelation;
-
-    resetStats(1, 1);
+    resetStats(1);
 
-    ComputeStats<LinearL2Stat>(
+    ComputeStats(
             1, leafId_, ds, bds,
-            *stats_,
-            [&](LinearL2Stat& stat, int sampleId, int origFId) {
+            stats_,
+            [&](LinearL2StatArena& stats, int64_t cell, int sampleId, int origFId) {
         float* x = curX(sampleId);
-        stat.append(x, ys[sampleId], ws[sampleId], params);
+        stats.addFullCorrelation(cell, x, ys[sampleId], ws[sampleId], 1);
     });
 
-    auto stats = (*stats_)[0][0];
-
-    parallelFor(0, totalBins_, [&](int bin) {
-        root->stats_[bin] = stats[bin];
-    });
+    root->stats_.copy(0, stats_[0], 0, totalBins_);
 
     leaves_.emplace_back(std::move(root));
 }
@@ -366,23 +373,32 @@ void GreedyLinearObliviousTreeLearner::updateNewCorrelations(
         ConstVecRef<float> ys,
         ConstVecRef<float> ws) {
     int nUsedFeatures = usedFeaturesOrdered_.size();
-    resetStats(leaves_.size(), nUsedFeatures + 1);
+    resetStats(leaves_.size());
 
-    ComputeStats<LinearL2CorStat>(
-            leaves_.size(), leafId_, ds, bds,
-            *corStats_,
-            [&](LinearL2CorStat& stat, int sampleId, int origFId) {
-        if (usedFeatures_.count(origFId)) return;
+    // parents have correlations over the same x, so only samples of smaller children are scanned
+    const bool subtractFromParents = !parentLeaves_.empty();
+    std::vector<int> smallerLeafIds;
+    if (subtractFromParents) {
+        smallerLeafIds.resize(nSamples_);
+        parallelFor(0, nSamples_, [&](int i) {
+            int lId = leafId_[i];
+            smallerLeafIds[i] = fullUpdate_[lId] ? lId : -1;
+        });
+    }
 
-        LinearL2CorStatOpParams params;
-        params.fVal = fColumnsRefs_[origFId][indices_[sampleId]];
+    ComputeStats(
+            leaves_.size(), subtractFromParents ? smallerLeafIds : leafId_, ds, bds,
+            corStats_,
+            [&](LinearL2CorStatArena& stats, int64_t cell, int sampleId, int origFId) {
+        if (usedFeatures_.count(origFId)) return;
 
+        float fVal = fColumnsRefs_[origFId][indices_[sampleId]];
         float* x = curX(sampleId);
 
-        stat.append(x, ys[sampleId], ws[sampleId], params);
+        stats.append(cell, x, ys[sampleId], ws[sampleId], fVal, nUsedFeatures + 1);
     });
 
-    MultiDimArray<2, LinearL2CorStat>& stats = (*corStats_)[0];
+    const auto& stats = corStats_[0];
 
     // update stats with this correlations
     parallelFor(0, totalBins_, [&](int bin) {
@@ -390,14 +406,25 @@ void GreedyLinearObliviousTreeLearner::updateNewCorrelations(
         int origFId = grid_->origFeatureIndex(fId);
         if (usedFeatures_.count(origFId)) return;
 
-        LinearL2StatOpParams params = {};
         for (uint64_t lId = 0; lId < leaves_.size(); ++lId) {
-            auto& stat = stats[lId][bin];
-            leaves_[lId]->stats_[bin].append(stat.xxt.data(),
-                                             stat.xy,
-                                             stat.sumX, params);
+            if (subtractFromParents && !fullUpdate_[lId]) continue;
+            const int64_t cell = (int64_t)lId * totalBins_ + bin;
+            leaves_[lId]->stats_.addNewCorrelation(bin, stats.xxt(cell),
+                                                   stats.xy(cell),
+                                                   stats.sumX(cell), nUsedFeatures);
+        }
+
+        if (!subtractFromParents) return;
+        for (uint64_t lId = 0; lId < leaves_.size(); ++lId) {
+            if (fullUpdate_[lId]) continue;
+            leaves_[lId]->stats_.addNewCorrelationDifference(bin,
+                                                             parentLeaves_[lId / 2]->stats_, bin,
+                                                             leaves_[lId ^ 1]->stats_, bin,
+                                                             nUsedFeatures);
         }
     });
+
+    parentLeaves_.clear();
 }
 
 GreedyLinearObliviousTreeLearner::TSplit GreedyLinearObliviousTreeLearner::findBestSplit(
@@ -410,6 +437,13 @@ GreedyLinearObliviousTreeLearner::TSplit GreedyLinearObliviousTreeLearner::findB
 
     MultiDimArray<2, double> splitScores({fCount_, totalCond_});
 
+    // bins of used features have nUsedFeatures filled, others also have correlation with feature itself
+    const int nUsedFeatures = (int)usedFeatures_.size();
+    // splits of all leaves for one bin are scored by one batched solve
+    const int64_t batchSize = 2 * (int64_t)leaves_.size();
+    std::vector<LinearL2StatBatch> threadBatches(nThreads_, LinearL2StatBatch(batchSize, opts_.maxDepth + 1));
+    std::vector<std::vector<double>> threadScores(nThreads_, std::vector<double>(batchSize));
+
     // TODO can parallelize by totalBins
 //    parallelFor(0, fCount_, [&](int fId) {
 //        for (int cond = 0; cond < grid_->conditionsCount(fId); ++cond) {
@@ -419,12 +453,20 @@ GreedyLinearObliviousTreeLearner::TSplit GreedyLinearObliviousTreeLearner::findB
 //        }
 //    });
 
-    parallelFor(0, totalBins_, [&](int bin) {
+    parallelFor(0, totalBins_, [&](int thId, int bin) {
         int fId = absBinToFId_[bin];
         int cond = bin - binOffsets_[fId];
         if (cond != grid_->conditionsCount(fId)) {
+            int size = usedFeatures_.count(grid_->origFeatureIndex(fId)) ? nUsedFeatures : nUsedFeatures + 1;
+            auto& batch = threadBatches[thId];
+            auto& scores = threadScores[thId];
+            batch.clear(size);
             for (auto &l : leaves_) {
-                splitScores[fId][cond] += l->splitScore(linearL2Target, fId, cond);
+                l->addSplitStats(fId, cond, &batch);
+            }
+            linearL2Target.scoreBatch(batch, scores.data());
+            for (double score : scores) {
+                splitScores[fId][cond] += score;
             }
         }
     });
@@ -460,8 +502,11 @@ void GreedyLinearObliviousTreeLearner::initNewLeaves(GreedyLinearObliviousTreeLe
 
     newLeaves_.resize(2 * leaves_.size());
 
+    // leaves hold used features and correlations of candidate feature, both fit in max depth + 1
+    const int leafMaxSize = std::min((int)usedFeatures_.size() + 1, opts_.maxDepth + 1);
+
     parallelFor(0, leaves_.size(), [&](int lId) {
-        auto newLeavesPair = leaves_[lId]->split(splitFId, splitCond, usedFeatures_.size());
+        auto newLeavesPair = leaves_[lId]->split(splitFId, splitCond, usedFeatures_.size(), leafMaxSize);
         newLeaves_[2 * lId] = newLeavesPair.first;
         newLeaves_[2 * lId + 1] = newLeavesPair.second;
     });
@@ -510,35 +555,25 @@ void GreedyLinearObliviousTreeLearner::updateNewLeaves(
         }
     }
 
-    resetStats(leaves_.size(), nUsedFeatures);
+    resetStats(leaves_.size());
 
     // full updates
     TIME_BLOCK_START(FullUpdatesCompute)
-    ComputeStats<LinearL2Stat>(
+    ComputeStats(
             leaves_.size(), fullLeafIds, ds, bds,
-            *stats_,
-            [&](LinearL2Stat& stat, int sampleId, int origFId) {
-        LinearL2StatOpParams params;
-        params.vecAddMode = LinearL2StatOpParams::FullCorrelation;
+            stats_,
+            [&](LinearL2StatArena& stats, int64_t cell, int sampleId, int origFId) {
         float* x = curX(sampleId);
-        stat.append(x, ys[sampleId], ws[sampleId], params);
+        stats.addFullCorrelation(cell, x, ys[sampleId], ws[sampleId], nUsedFeatures);
     });
     TIME_BLOCK_END(FullUpdatesCompute)
 
-    auto& fullStats = (*stats_)[0];
+    const auto& fullStats = stats_[0];
 
     TIME_BLOCK_START(FullUpdatesAssign)
-//    parallelFor(0, newLeaves_.size(), [&](int lId) {
-//        if (fullUpdate_[lId]) {
-//            newLeaves_[lId]->stats_ = fullStats[lId / 2].copy();
-//        }
-//    });
-
-    parallelFor(0, totalBins_, [&](int bin) {
-        for (int lId = 0; lId < (int)newLeaves_.size(); ++lId) {
-            if (!fullUpdate_[lId]) continue;
-//            auto &fullStat = fullStats[lId / 2][bin];
-            newLeaves_[lId]->stats_[bin] = fullStats[lId / 2][bin];
+    parallelFor(0, newLeaves_.size(), [&](int lId) {
+        if (fullUpdate_[lId]) {
+            newLeaves_[lId]->stats_.copy(0, fullStats, (int64_t)(lId / 2) * totalBins_, totalBins_);
         }
     });
     TIME_BLOCK_END(FullUpdatesAssign)
@@ -549,40 +584,26 @@ void GreedyLinearObliviousTreeLearner::updateNewLeaves(
         // corStats have already been reset
 
         TIME_BLOCK_START(PartialUpdatesCompute)
-        ComputeStats<LinearL2CorStat>(
+        ComputeStats(
                 leaves_.size(), partialLeafIds, ds, bds,
-                *corStats_,
-                [&](LinearL2CorStat& stat, int sampleId, int origFId) {
+                corStats_,
+                [&](LinearL2CorStatArena& stats, int64_t cell, int sampleId, int origFId) {
                     float* x = curX(sampleId);
-                    LinearL2CorStatOpParams params;
-                    params.fVal = x[nUsedFeatures - 1];
-                    stat.append(x, ys[sampleId], ws[sampleId], params);
+                    stats.append(cell, x, ys[sampleId], ws[sampleId], x[nUsedFeatures - 1], nUsedFeatures);
                 });
         TIME_BLOCK_END(PartialUpdatesCompute)
 
-        auto& partialStats = (*corStats_)[0];
+        const auto& partialStats = corStats_[0];
 
         TIME_BLOCK_START(PartialUpdatesAssign)
-        LinearL2StatOpParams params;
-        params.shift = -1;
-
-//        parallelFor(0, newLeaves_.size(), [&](int lId) {
-//            if (fullUpdate_[lId]) return;
-//            for (int bin = 0; bin < totalBins_; ++bin) {
-//                auto &partialStat = partialStats[lId / 2][bin];
-//                newLeaves_[lId]->stats_[bin].append(partialStat.xxt.data(),
-//                                                    partialStat.xy,
-//                                                    partialStat.sumX, params);
-//            }
-//        });
-
+        // new feature is the last one, its correlations go to row nUsedFeatures - 1
         parallelFor(0, totalBins_, [&](int bin) {
             for (int lId = 0; lId < (int)newLeaves_.size(); ++lId) {
                 if (fullUpdate_[lId]) continue;
-                auto &partialStat = partialStats[lId / 2][bin];
-                newLeaves_[lId]->stats_[bin].append(partialStat.xxt.data(),
-                                                    partialStat.xy,
-                                                    partialStat.sumX, params);
+                const int64_t cell = (int64_t)(lId / 2) * totalBins_ + bin;
+                newLeaves_[lId]->stats_.addNewCorrelation(bin, partialStats.xxt(cell),
+                                                          partialStats.xy(cell),
+                                                          partialStats.sumX(cell), nUsedFeatures - 1);
             }
         });
         TIME_BLOCK_END(PartialUpdatesAssign)
@@ -599,17 +620,10 @@ void GreedyLinearObliviousTreeLearner::updateNewLeaves(
         // This - and += ops will only update inner correlations -- exactly what we need
         // new feature correlation will stay the same
 
-        LinearL2StatOpParams params;
-        params.opSize = oldNUsedFeatures;
-
         if (fullUpdate_[left->id_]) {
-            for (int bin = 0; bin < totalBins_; ++bin) {
-                right->stats_[bin].append(parent->stats_[bin] - left->stats_[bin], params);
-            }
+            right->stats_.addDifference(0, parent->stats_, 0, left->stats_, 0, totalBins_, oldNUsedFeatures);
         } else {
-            for (int bin = 0; bin < totalBins_; ++bin) {
-                left->stats_[bin].append(parent->stats_[bin] - right->stats_[bin], params);
-            }
+            left->stats_.addDifference(0, parent->stats_, 0, right->stats_, 0, totalBins_, oldNUsedFeatures);
         }
     });
 
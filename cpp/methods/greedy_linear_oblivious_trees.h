@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <unordered_set>
 #include <vector>
 #include <memory>
@@ -24,6 +25,11 @@ class LinearObliviousTreeLeafLearner;
 struct GreedyLinearObliviousTreeLearnerOptions {
     int maxDepth = 6;
     double l2reg = 2.0;
+    //per-thread scratch statistics are used while they fit together with leaf statistics, otherwise threads share one copy
+    int64_t statsMemoryLimitMb = 4096;
+    //after splits which don't add a feature, correlations of larger children are parent minus smaller sibling.
+    //costs one more generation of leaf stats at peak, false scans all samples instead
+    bool subtractParentStats = true;
 
     static GreedyLinearObliviousTreeLearnerOptions fromJson(const json& params);
 };
@@ -67,62 +73,78 @@ private:
     float* curX(int sampleId);
 
     void resetState();
-    void resetStats(int nLeaves, int filledSize);
+    void resetStats(int nLeaves);
 
     // TODO add bins factory
-    template <typename Stat, typename UpdaterT>
+    // updater(threadStats, cell, sampleId, origFId), cell is leafId * totalBins + bin
+    template <typename StatArena, typename UpdaterT>
     void ComputeStats(
             int nLeaves, const std::vector<int>& lIds,
             const DataSet& ds, const BinarizedDataSet& bds,
-            MultiDimArray<1, MultiDimArray<2, Stat>>& stats,
+            std::vector<StatArena>& stats,
             UpdaterT updater) {
 //        int nUsedFeatures = (int)usedFeaturesOrdered_.size();
 
-        // compute stats per [thread Id][leaf Id]
-        parallelFor(0, nSamples_, [&](int thId, int sampleId) {
-            int origSampleId = indices_[sampleId];
-            auto bins = bds.sampleBins(origSampleId);
-
-            int lId = lIds[sampleId];
-            if (lId < 0) return;
-
-            auto leafStats = stats[thId][lId];
-
-            for (int fId = 0; fId < fCount_; ++fId) {
+        if (sharedStats_) {
+            // tasks own features, so they write disjoint bins of the only copy without synchronization
+            auto& sharedStats = stats[0];
+            parallelFor(0, fCount_, [&](int fId) {
                 int origFId = grid_->origFeatureIndex(fId);
-                int bin = binOffsets_[fId] + bins[fId];
-                auto& stat = leafStats[bin];
-                updater(stat, sampleId, origFId);
-            }
-        });
-
-        // gather individual workers results together
-        // TODO maybe change order
-        parallelFor(0, nLeaves, [&](int lId) {
-            auto leftLeafStats = stats[0][lId];
-            for (int thId = 1; thId < nThreads_; ++thId) {
-                auto rightLeafStats = stats[thId][lId];
-                for (int bin = 0; bin < totalBins_; ++bin) {
-                    leftLeafStats[bin] += rightLeafStats[bin];
+                int offset = binOffsets_[fId];
+                bds.visitFeature(fId, indices_, [&](int, int64_t sampleId, uint8_t bin) {
+                    int lId = lIds[sampleId];
+                    if (lId < 0) return;
+                    updater(sharedStats, (int64_t)lId * totalBins_ + offset + bin, (int)sampleId, origFId);
+                });
+            });
+        } else {
+            // compute stats per [thread Id][leaf Id x bin], bins of samples block are feature-major
+            bds.visitSampleBlocks(indices_, [&](int thId, int64_t first, int64_t count, const uint8_t* bins) {
+                auto& thStats = stats[thId];
+
+                for (int fId = 0; fId < fCount_; ++fId) {
+                    int origFId = grid_->origFeatureIndex(fId);
+                    const uint8_t* fBins = bins + fId * count;
+                    for (int64_t i = 0; i < count; ++i) {
+                        int sampleId = (int)(first + i);
+                        int lId = lIds[sampleId];
+                        if (lId < 0) continue;
+
+                        int bin = binOffsets_[fId] + fBins[i];
+                        updater(thStats, (int64_t)lId * totalBins_ + bin, sampleId, origFId);
+                    }
                 }
-            }
-        });
+            });
+
+            // gather individual workers results together: cells of all leaves are one flat range
+            const int64_t cellsCount = (int64_t)nLeaves * totalBins_;
+            const int64_t blocksCount = (cellsCount + ReduceBlockCells - 1) / ReduceBlockCells;
+            parallelFor(0, blocksCount, [&](int64_t blockId) {
+                const int64_t firstCell = blockId * ReduceBlockCells;
+                const int64_t count = std::min<int64_t>(ReduceBlockCells, cellsCount - firstCell);
+                for (int thId = 1; thId < (int)stats.size(); ++thId) {
+                    stats[0].add(firstCell, stats[thId], firstCell, count);
+                }
+            });
+        }
 
         // prefix sum
         parallelFor(0, fCount_, [&](int fId) {
             int offset = binOffsets_[fId];
             const int condCount = grid_->conditionsCount(fId);
             for (int lId = 0; lId < nLeaves; ++lId) {
-                auto leafStats = stats[0][lId];
+                const int64_t leafOffset = (int64_t)lId * totalBins_ + offset;
                 for (int bin = 1; bin <= condCount; ++bin) {
-                    int absBin = offset + bin;
-                    leafStats[absBin] += leafStats[absBin - 1];
+                    stats[0].add(leafOffset + bin, stats[0], leafOffset + bin - 1, 1);
                 }
             }
         });
     }
 
 private:
+    //cells of per-thread stats, which are summed by one task
+    static constexpr int64_t ReduceBlockCells = 256;
+
     GridPtr grid_;
     Options opts_;
 
@@ -136,9 +158,15 @@ private:
     std::vector<int32_t> leafId_;
     std::vector<std::shared_ptr<LinearObliviousTreeLeafLearner>> leaves_;
     std::vector<std::shared_ptr<LinearObliviousTreeLeafLearner>> newLeaves_;
-
-    std::unique_ptr<MultiDimArray<1, MultiDimArray<2, LinearL2CorStat>>> corStats_;
-    std::unique_ptr<MultiDimArray<1, MultiDimArray<2, LinearL2Stat>>> stats_;
+    // kept till next updateNewCorrelations if split didn't add a feature:
+    // then correlations of larger children are parent minus smaller sibling.
+    // Peak memory grows by these leaves, i.e. by one generation of leaf stats (see subtractParentStats)
+    std::vector<std::shared_ptr<LinearObliviousTreeLeafLearner>> parentLeaves_;
+
+    // per thread (or one shared, see statsMemoryLimitMb), cells are [leaf][bin]
+    bool sharedStats_ = false;
+    std::vector<LinearL2CorStatArena> corStats_;
+    std::vector<LinearL2StatArena> stats_;
 
     std::set<TSplit> splits_;
 
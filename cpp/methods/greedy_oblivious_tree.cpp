@@ -15,6 +15,9 @@ namespace {
         int64_t Size = 0;
     };
 
+    //leaves smaller than this per thread are not worth private histograms
+    constexpr int64_t MinSamplesPerHistogramBlock = 16384;
+
 
     template <class StatBasedTarget>
     class Subsets {
@@ -29,65 +32,86 @@ namespace {
             bins_ = Buffer<int32_t>(stat_.size());
             bins_.fill(0);
 
+            //partition is double-buffered: split writes reordered data here and swaps
+            nextStat_ = Buffer<Stat>::createUninitialized(stat_.size());
+            nextIndices_ = Buffer<int32_t>::createUninitialized(indices_.size());
+            nextBins_ = Buffer<int32_t>::createUninitialized(bins_.size());
+
             leaves_.push_back({0, indices_.size()});
             updateLeavesStats();
         }
 
         void split(const BinaryFeature& feature) {
-            VecRef<int32_t> binsRef = bins_.arrayRef();
-            auto indicesRef = indices_.arrayRef();
-            auto statRef = stat_.arrayRef();
+            const int64_t size = bins_.size();
+            const int64_t leavesCount = 1 << (level_ + 1);
+            const int64_t numBlocks = std::max<int64_t>(std::min<int64_t>(GlobalThreadPool<0>().numThreads(), size), 1);
+            const int64_t blockSize = (size + numBlocks - 1) / numBlocks;
 
-            ds_.visitFeature(feature.featureId_,
-                             indicesRef,
-                             [&](int blockId, int32_t i, uint8_t bin) {
-                binsRef[i] |= (bin  > feature.conditionId_) << level_;
-            }, /*parallel*/ true);
+            VecRef<int32_t> binsRef = bins_.arrayRef();
+            ConstVecRef<int32_t> indicesRef = indices_.arrayRef();
+            ConstVecRef<Stat> statRef = stat_.arrayRef();
+
+            //first pass: new leaf ids, per-block leaf sizes and stats
+            std::vector<int64_t> blockCounts(numBlocks * leavesCount);
+            std::vector<Stat> blockStats(numBlocks * leavesCount);
+
+            parallelFor(0, numBlocks, [&](int64_t blockId) {
+                const int64_t start = std::min<int64_t>(blockId * blockSize, size);
+                const int64_t end = std::min<int64_t>(start + blockSize, size);
+                int64_t* counts = blockCounts.data() + blockId * leavesCount;
+                Stat* stats = blockStats.data() + blockId * leavesCount;
+
+                ds_.visitFeature(feature.featureId_,
+                                 indicesRef.slice(start, end - start),
+                                 [&](int, int64_t i, uint8_t bin) {
+                    const int64_t idx = start + i;
+                    const int32_t leaf = binsRef[idx] | ((bin > feature.conditionId_) << level_);
+                    binsRef[idx] = leaf;
+                    ++counts[leaf];
+                    stats[leaf] += statRef[idx];
+                });
+            });
             ++level_;
 
-            std::vector<DataPartition> newLeaves;
-            newLeaves.resize(1 << level_);
-
-            for (int32_t bin : binsRef) {
-                ++newLeaves[bin].Size;
-            }
-
-            std::vector<int64_t> writeOffsets(newLeaves.size());
-            for (uint32_t i =  1; i < newLeaves.size(); ++i) {
-                newLeaves[i].Offset = newLeaves[i - 1].Offset + newLeaves[i - 1].Size;
-                writeOffsets[i] = newLeaves[i].Offset;
-            }
-
-            //reorder data now
-
-            Buffer<Stat> nextStat(stat_.size());
-            Buffer<int32_t> nextIndices(indices_.size());
-            Buffer<int32_t> nextBins(bins_.size());
-
-            auto nextStatRef = nextStat.arrayRef();
-            auto nextIndicesRef = nextIndices.arrayRef();
-            auto nextBinsRef = nextBins.arrayRef();
-
+            std::vector<DataPartition> newLeaves(leavesCount);
+            std::vector<int64_t> writeOffsets(numBlocks * leavesCount);
+            leaves_stats_ = Buffer<Stat>(leavesCount);
+            auto leavesStatsRef = leaves_stats_.arrayRef();
 
-            std::vector<int64_t> sorted(binsRef.size());
-            for (uint32_t i = 0; i < binsRef.size(); ++i) {
-               sorted[i] = writeOffsets[binsRef[i]]++;
+            int64_t cursor = 0;
+            for (int64_t leaf = 0; leaf < leavesCount; ++leaf) {
+                newLeaves[leaf].Offset = cursor;
+                for (int64_t blockId = 0; blockId < numBlocks; ++blockId) {
+                    writeOffsets[blockId * leavesCount + leaf] = cursor;
+                    cursor += blockCounts[blockId * leavesCount + leaf];
+                    leavesStatsRef[leaf] += blockStats[blockId * leavesCount + leaf];
+                }
+                newLeaves[leaf].Size = cursor - newLeaves[leaf].Offset;
             }
 
-            parallelFor(0, binsRef.size(), [&](int64_t i) {
-                int64_t writeOffset = sorted[i];
-                nextBinsRef[writeOffset] = binsRef[i];
-                nextIndicesRef[writeOffset] = indicesRef[i];
-                nextStatRef[writeOffset] = statRef[i];
+            //second pass: stable scatter, every block writes to its own ranges of leaves
+            auto nextStatRef = nextStat_.arrayRef();
+            auto nextIndicesRef = nextIndices_.arrayRef();
+            auto nextBinsRef = nextBins_.arrayRef();
+
+            parallelFor(0, numBlocks, [&](int64_t blockId) {
+                const int64_t start = std::min<int64_t>(blockId * blockSize, size);
+                const int64_t end = std::min<int64_t>(start + blockSize, size);
+                int64_t* offsets = writeOffsets.data() + blockId * leavesCount;
+
+                for (int64_t i = start; i < end; ++i) {
+                    const int64_t writeOffset = offsets[binsRef[i]]++;
+                    nextBinsRef[writeOffset] = binsRef[i];
+                    nextIndicesRef[writeOffset] = indicesRef[i];
+                    nextStatRef[writeOffset] = statRef[i];
+                }
             });
 
-            stat_.swap(nextStat);
-            indices_.swap(nextIndices);
-            bins_.swap(nextBins);
+            std::swap(stat_, nextStat_);
+            std::swap(indices_, nextIndices_);
+            std::swap(bins_, nextBins_);
             leaves_.swap(newLeaves);
 
-            updateLeavesStats();
-
             prevHistograms_ = std::move(histograms_);
             histograms_.reset(nullptr);
         }
@@ -169,12 +193,12 @@ namespace {
                 auto histograms = histograms_->arrayRef();
                 auto prevHistograms = prevHistograms_->arrayRef();
 
-                auto& executor = GlobalThreadPool<0>();
-                const int64_t numBlocks = executor.numThreads();
+                TaskGroup group;
+                const int64_t numBlocks = GlobalThreadPool<0>().numThreads();
                 const int64_t blockSize = (totalBins + numBlocks - 1) / numBlocks;
 
                 for (int64_t blockId = 0; blockId < numBlocks; ++blockId) {
-                    executor.enqueue([&, blockId]() {
+                    group.run([&, blockId]() {
                         int64_t firstBin = std::min<int64_t>(blockId * blockSize, totalBins);
                         int64_t lastBin = std::min<int64_t>((blockId + 1) * blockSize, totalBins);
 
@@ -198,40 +222,93 @@ namespace {
                         }
                     });
                 }
-                executor.waitComplete();
+                group.wait();
 
                 prevHistograms_.reset();
             }
         }
 
         void buildHistogramsForParts(ConstVecRef<int32_t> partIds, VecRef<Stat> dst) const {
-            auto& threadPool = GlobalThreadPool<0>();
+            const int64_t numThreads = GlobalThreadPool<0>().numThreads();
+            const int64_t totalBins = ds_.totalBins();
+
+            //by feature: one task per (leaf, bundle). When there are too few such tasks to load all threads
+            //large leaves are built by sample: sample range is split between threads,
+            //each one builds all bundles into private histogram, private histograms are reduced afterwards
+            const bool enoughTasksByFeature = static_cast<int64_t>(partIds.size()) * ds_.groupCount() >= 2 * numThreads;
+
+            struct SampleSplitPart {
+                int32_t dstIdx = 0;
+                int64_t blocks = 0;
+                Buffer<Stat> privateHistograms;
+            };
+            std::vector<SampleSplitPart> bySample;
+
+            for (uint32_t i = 0; i < partIds.size(); ++i) {
+                const auto& part = leaves_[partIds[i]];
+                const int64_t blocks = std::min<int64_t>(numThreads, part.Size / MinSamplesPerHistogramBlock);
+                if (!enoughTasksByFeature && blocks > 1) {
+                    bySample.push_back({static_cast<int32_t>(i), blocks, Buffer<Stat>(blocks * totalBins)});
+                }
+            }
+
+            TaskGroup group;
+            uint32_t nextBySample = 0;
             for (uint32_t i = 0; i < partIds.size(); ++i) {
-                const int32_t partId = partIds[i];
-                const auto& part = leaves_[partId];
+                const auto& part = leaves_[partIds[i]];
                 ConstVecRef<int32_t> indices = indices_.arrayRef().slice(part.Offset, part.Size);
                 ConstVecRef<Stat> stat = stat_.arrayRef().slice(part.Offset, part.Size);
 
-                ds_.visitGroups([dst, this, indices, stat, i, &threadPool](
-                    FeaturesBundle bundle,
-                    ConstVecRef<uint8_t> data) {
-
-//                    const int64_t minIndicesToBuildParallel = 4096;
-                    auto binOffsets = ds_.binOffsets().slice(bundle.firstFeature_, bundle.groupSize());
-                    VecRef<Stat> dstForBundle = dst.slice(ds_.totalBins() * i, ds_.totalBins());
-
-                    threadPool.enqueue([=]() {
-                        buildHistograms(bundle.groupSize(),
-                                        stat,
-                                        indices,
-                                        binOffsets,
-                                        data,
-                                        dstForBundle
-                        );
-                    });
+                if (nextBySample < bySample.size() && bySample[nextBySample].dstIdx == static_cast<int32_t>(i)) {
+                    auto& splitPart = bySample[nextBySample++];
+                    const int64_t blockSize = (part.Size + splitPart.blocks - 1) / splitPart.blocks;
+                    VecRef<Stat> privateHistograms = splitPart.privateHistograms.arrayRef();
+
+                    for (int64_t blockId = 0; blockId < splitPart.blocks; ++blockId) {
+                        const int64_t blockStart = std::min<int64_t>(blockId * blockSize, part.Size);
+                        const int64_t blockEnd = std::min<int64_t>((blockId + 1) * blockSize, part.Size);
+                        enqueueBundles(group,
+                                       indices.slice(blockStart, blockEnd - blockStart),
+                                       stat.slice(blockStart, blockEnd - blockStart),
+                                       privateHistograms.slice(blockId * totalBins, totalBins));
+                    }
+                } else {
+                    enqueueBundles(group, indices, stat, dst.slice(totalBins * i, totalBins));
+                }
+            }
+            group.wait();
+
+            for (auto& splitPart : bySample) {
+                ConstVecRef<Stat> privateHistograms = splitPart.privateHistograms.arrayRef();
+                VecRef<Stat> partDst = dst.slice(totalBins * splitPart.dstIdx, totalBins);
+                const int64_t blocks = splitPart.blocks;
+
+                parallelFor(0, totalBins, [&](int64_t bin) {
+                    Stat sum = privateHistograms[bin];
+                    for (int64_t blockId = 1; blockId < blocks; ++blockId) {
+                        sum += privateHistograms[blockId * totalBins + bin];
+                    }
+                    partDst[bin] = sum;
                 });
-            };
-            threadPool.waitComplete();
+            }
+        }
+
+        void enqueueBundles(TaskGroup& group, ConstVecRef<int32_t> indices, ConstVecRef<Stat> stat, VecRef<Stat> dst) const {
+            ds_.visitGroups([dst, this, indices, stat, &group](
+                FeaturesBundle bundle,
+                ConstVecRef<uint8_t> data) {
+                auto binOffsets = ds_.binOffsets().slice(bundle.firstFeature_, bundle.groupSize());
+
+                group.run([=]() {
+                    buildHistograms(bundle.groupSize(),
+                                    stat,
+                                    indices,
+                                    binOffsets,
+                                    data,
+                                    dst
+                    );
+                });
+            });
         }
 
         void updateLeavesStats() {
@@ -240,12 +317,12 @@ namespace {
             auto statRef = stat_.arrayRef();
             auto leaves_stats_ref = leaves_stats_.arrayRef();
             std::mutex lock;
-            auto& executor = GlobalThreadPool<0>();
-            const int64_t numBlocks = executor.numThreads();
+            TaskGroup group;
+            const int64_t numBlocks = GlobalThreadPool<0>().numThreads();
             const int64_t blockSize = (binsRef.size() + numBlocks - 1) / numBlocks;
 
             for (int64_t blockId = 0; blockId < numBlocks; ++blockId) {
-                executor.enqueue([&, blockId]() {
+                group.run([&, blockId]() {
                      int64_t start = blockId * blockSize;
                      int64_t end = std::min<int64_t>((blockId + 1) * blockSize, binsRef.size());
                      std::vector<Stat> tmp(leaves_.size());
@@ -262,7 +339,7 @@ namespace {
                  }
                 );
             }
-            executor.waitComplete();
+            group.wait();
         }
     private:
 
@@ -272,6 +349,10 @@ namespace {
         Buffer<int32_t> indices_;
         Buffer<int32_t> bins_;
 
+        Buffer<Stat> nextStat_;
+        Buffer<int32_t> nextIndices_;
+        Buffer<int32_t> nextBins_;
+
         Buffer<Stat> leaves_stats_;
         std::vector<DataPartition> leaves_;
         int32_t level_ = 0;
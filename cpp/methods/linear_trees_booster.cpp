@@ -47,6 +47,14 @@ private:
 
 };
 
+EarlyStoppingOptions EarlyStoppingOptions::fromJson(const json& params) {
+    EarlyStoppingOptions opts;
+    opts.patience = params.value("patience", opts.patience);
+    opts.metric = params.value("metric", opts.metric);
+    opts.useBestModel = params.value("use_best_model", opts.useBestModel);
+    return opts;
+}
+
 LinearTreesBoosterOptions LinearTreesBoosterOptions::fromJson(const json& params) {
     LinearTreesBoosterOptions opts;
 
@@ -54,6 +62,13 @@ LinearTreesBoosterOptions LinearTreesBoosterOptions::fromJson(const json& params
     opts.boostingCfg = BoostingConfig::fromJson(params["boosting_config"]);
     opts.boostrapOpts = BootstrapOptions::fromJson(params["bootstrap_options"]);
     opts.greedyLinearTreesOpts = GreedyLinearObliviousTreeLearnerOptions::fromJson(params["tree_config"]);
+    if (params.contains("early_stopping")) {
+        opts.earlyStoppingOpts = EarlyStoppingOptions::fromJson(params["early_stopping"]);
+    }
+    if (params.contains("polynom_pruning")) {
+        opts.polynomPruning.MinWeight = params["polynom_pruning"].value("min_weight", opts.polynomPruning.MinWeight);
+        opts.polynomPruning.MinAbsValue = params["polynom_pruning"].value("min_abs_value", opts.polynomPruning.MinAbsValue);
+    }
 
     return opts;
 }
@@ -109,6 +124,9 @@ ModelPtr LinearTreesBooster::fitFrom(const std::shared_ptr<Ensemble>& oldEnsembl
     auto testMetricsCalcer = std::make_shared<BoostingMetricsCalcer>(valDs);
     testMetricsCalcer->addMetric(CrossEntropy(valDs), "cross_entropy-val", 1, BoostingMetricsCalcer::MetricType::Maximization);
     testMetricsCalcer->addMetric(BinaryAcc(valDs), "acc-val", 1, BoostingMetricsCalcer::MetricType::Maximization);
+    if (opts_.earlyStoppingOpts.patience > 0) {
+        testMetricsCalcer->setEarlyStopping(opts_.earlyStoppingOpts.metric, opts_.earlyStoppingOpts.patience, opts_.earlyStoppingOpts.useBestModel);
+    }
     boosting.addListener(testMetricsCalcer);
 
     auto trainMetricsCalcer = std::make_shared<BoostingMetricsCalcer>(trainDs);
@@ -134,7 +152,7 @@ ModelPtr LinearTreesBooster::fitFrom(const std::shared_ptr<Ensemble>& oldEnsembl
     }
 
     {
-        auto polynom = std::make_shared<Polynom>(LinearTreesToPolynom(*std::dynamic_pointer_cast<Ensemble>(ensemble)));
+        auto polynom = std::make_shared<Polynom>(LinearTreesToPolynom(*std::dynamic_pointer_cast<Ensemble>(ensemble), opts_.polynomPruning));
         std::cout << "polynom size: " << polynom->Ensemble_.size() << std::endl;
 //        std::cout << *polynom << std::endl;
         auto polynomModel = std::make_shared<PolynomModel>(Monom::MonomType::LinearMonom);
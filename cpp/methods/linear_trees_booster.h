@@ -5,13 +5,29 @@
 #include <methods/greedy_linear_oblivious_trees.h>
 #include <data/grid_builder.h>
 #include <data/dataset.h>
+#include <models/polynom/polynom.h>
 #include <util/json.h>
 
+struct EarlyStoppingOptions {
+    //0 disables early stopping
+    int64_t patience = 0;
+    //validation metric to watch, empty for the first one
+    std::string metric;
+    //truncate ensemble to the best iteration
+    bool useBestModel = true;
+
+    static EarlyStoppingOptions fromJson(const json& params);
+};
+
 struct LinearTreesBoosterOptions {
     BoostingConfig boostingCfg;
     BinarizationConfig binarizationCfg;
     BootstrapOptions boostrapOpts;
     GreedyLinearObliviousTreeLearnerOptions greedyLinearTreesOpts;
+    //applied to validation metrics
+    EarlyStoppingOptions earlyStoppingOpts;
+    //applied when ensemble is converted to polynom
+    PolynomPruning polynomPruning;
 
     static LinearTreesBoosterOptions fromJson(const json& params);
 };
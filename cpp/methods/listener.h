@@ -2,6 +2,9 @@
 
 #include <core/object.h>
 #include <core/func.h>
+#include <util/exception.h>
+#include <algorithm>
+#include <atomic>
 #include <vector>
 #include <memory>
 #include <models/linear_oblivious_tree.h>
@@ -10,6 +13,21 @@ template <class T>
 class Listener : public Object {
 public:
     virtual void operator()(const T& event) = 0;
+
+    //process (e.g. boosting) stops once some listener requests it. could be called from other thread
+    virtual bool stopRequested() const {
+        return stopEventsCount() >= 0;
+    }
+
+    //count of events seen when stop was requested, results of later events are dropped; -1 if stop wasn't requested
+    virtual int64_t stopEventsCount() const {
+        return -1;
+    }
+
+    //count of first events, which gave the best result; -1 if listener doesn't track it. could be called from other thread
+    virtual int64_t bestEventsCount() const {
+        return -1;
+    }
 };
 
 template <class T>
@@ -32,6 +50,40 @@ protected:
         }
     }
 
+    bool stopRequested() const {
+        for (const auto& listener : listeners_) {
+            SharedPtr<Inner> ptr = listener.lock();
+            if (ptr && ptr->stopRequested()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    //smallest count of best events among listeners, which track it; -1 if there are none
+    int64_t bestEventsCount() const {
+        return minEventsCount(&Inner::bestEventsCount);
+    }
+
+    //smallest count of events, on which some listener requested stop; -1 if nobody did
+    int64_t stopEventsCount() const {
+        return minEventsCount(&Inner::stopEventsCount);
+    }
+
+private:
+
+    int64_t minEventsCount(int64_t (Inner::*eventsCount)() const) const {
+        int64_t result = -1;
+        for (const auto& listener : listeners_) {
+            SharedPtr<Inner> ptr = listener.lock();
+            const int64_t count = ptr ? ((*ptr).*eventsCount)() : -1;
+            if (count >= 0 && (result < 0 || count < result)) {
+                result = count;
+            }
+        }
+        return result;
+    }
+
 private:
 
     std::vector<std::weak_ptr<Inner>> listeners_;
@@ -72,9 +124,29 @@ public:
         }
         std::cout << std::endl;
 
+        if (earlyStoppingMetric_ >= 0) {
+            const int32_t bestIter = bestIter_[earlyStoppingMetric_];
+            if (useBestModel_ && bestIter >= 0) {
+                bestEventsCount_ = bestIter + 1;
+            }
+            if (bestIter >= 0 && iter_ - bestIter >= patience_ && stopEventsCount_ < 0) {
+                std::cout << "early stopping: " << metricName[earlyStoppingMetric_] << " didn't improve for "
+                          << iter_ - bestIter << " iterations, best iteration " << bestIter << std::endl;
+                stopEventsCount_ = iter_ + 1;
+            }
+        }
+
         ++iter_;
     }
 
+    int64_t stopEventsCount() const override {
+        return stopEventsCount_;
+    }
+
+    int64_t bestEventsCount() const override {
+        return bestEventsCount_;
+    }
+
     enum MetricType {
         Maximization,
         Minimization,
@@ -95,6 +167,21 @@ public:
         }
     }
 
+    //asks to stop when metric (first one if name is empty) didn't improve for patience iterations.
+    //with useBestModel boosting keeps only trees up to the best iteration
+    void setEarlyStopping(const std::string& name, int64_t patience, bool useBestModel = true) {
+        VERIFY(!metrics_.empty(), "Add metrics before early stopping");
+        VERIFY(patience > 0, "Early stopping patience should be positive, got " << patience);
+        earlyStoppingMetric_ = 0;
+        if (!name.empty()) {
+            auto it = std::find(metricName.begin(), metricName.end(), name);
+            VERIFY(it != metricName.end(), "Unknown early stopping metric " << name);
+            earlyStoppingMetric_ = static_cast<int32_t>(it - metricName.begin());
+        }
+        patience_ = patience;
+        useBestModel_ = useBestModel;
+    }
+
 private:
     // TODO make "Metric" type
     std::vector<int> metricPeriods_;
@@ -105,6 +192,13 @@ private:
     std::vector<double> bestValue_;
     std::vector<int> bestIter_;
 
+    int32_t earlyStoppingMetric_ = -1;
+    int64_t patience_ = 0;
+    bool useBestModel_ = true;
+    //read by boosting while listener runs in other thread
+    std::atomic<int64_t> stopEventsCount_{-1};
+    std::atomic<int64_t> bestEventsCount_{-1};
+
     const DataSet& ds_;
     Mx cursor_;
     int32_t iter_ = 0;
@@ -2,6 +2,8 @@
 #include <stdlib.h>
 #include <time.h>
 #include <random>
+#include <algorithm>
+#include <cmath>
 
 #include <data/dataset.h>
 #include <data/load_data.h>
@@ -70,6 +72,99 @@ TEST(FeaturesTxt, TestTrainMseFeaturesTxt) {
     auto ensemble = boosting.fit(ds, target);
 }
 
+TEST(FeaturesTxt, TestAsyncListenersOrder) {
+    auto ds = loadFeaturesTxt(PATH_PREFIX "test_data/featuresTxt/train");
+    auto test = loadFeaturesTxt(PATH_PREFIX "test_data/featuresTxt/test");
+
+    BinarizationConfig config;
+    config.bordersCount_ = 32;
+    auto grid = buildGrid(ds, config);
+
+    class ModelsRecorder : public Listener<Model> {
+    public:
+        void operator()(const Model& model) override {
+            models_.push_back(&model);
+        }
+
+        std::vector<const Model*> models_;
+    };
+
+    BoostingConfig boostingConfig;
+    boostingConfig.iterations_ = 50;
+    boostingConfig.listenersQueueSize_ = 3;
+    Boosting boosting(boostingConfig, createWeakTarget(0.0), createWeakLearner(6, grid));
+
+    auto metricsCalcer = std::make_shared<BoostingMetricsCalcer>(test);
+    metricsCalcer->addMetric(L2(test), "l2");
+    boosting.addListener(metricsCalcer);
+    auto recorder = std::make_shared<ModelsRecorder>();
+    boosting.addListener(recorder);
+
+    L2 target(ds);
+    auto ensemble = std::dynamic_pointer_cast<Ensemble>(boosting.fit(ds, target));
+    ASSERT_TRUE(ensemble != nullptr);
+
+    std::vector<const Model*> fitted;
+    ensemble->visitModels([&](const ModelPtr& model) {
+        fitted.push_back(model.get());
+    });
+    EXPECT_EQ(recorder->models_, fitted);
+}
+
+TEST(FeaturesTxt, TestEarlyStopping) {
+    auto ds = loadFeaturesTxt(PATH_PREFIX "test_data/featuresTxt/train");
+    auto test = loadFeaturesTxt(PATH_PREFIX "test_data/featuresTxt/test");
+
+    BinarizationConfig config;
+    config.bordersCount_ = 32;
+    auto grid = buildGrid(ds, config);
+
+    BoostingConfig boostingConfig;
+    boostingConfig.step_ = 0.5;
+    boostingConfig.iterations_ = 300;
+    Boosting boosting(boostingConfig, createWeakTarget(0.0), createWeakLearner(6, grid));
+
+    auto metricsCalcer = std::make_shared<BoostingMetricsCalcer>(test);
+    metricsCalcer->addMetric(L2(test), "l2");
+    metricsCalcer->setEarlyStopping("l2", 3);
+    boosting.addListener(metricsCalcer);
+
+    L2 target(ds);
+    auto ensemble = std::dynamic_pointer_cast<Ensemble>(boosting.fit(ds, target));
+    ASSERT_TRUE(ensemble != nullptr);
+    EXPECT_TRUE(metricsCalcer->stopRequested());
+    EXPECT_EQ(static_cast<int64_t>(ensemble->size()), metricsCalcer->bestEventsCount());
+    EXPECT_LT(static_cast<int64_t>(ensemble->size()), boostingConfig.iterations_);
+}
+
+TEST(FeaturesTxt, TestEarlyStoppingWithoutBestModel) {
+    auto ds = loadFeaturesTxt(PATH_PREFIX "test_data/featuresTxt/train");
+    auto test = loadFeaturesTxt(PATH_PREFIX "test_data/featuresTxt/test");
+
+    BinarizationConfig config;
+    config.bordersCount_ = 32;
+    auto grid = buildGrid(ds, config);
+
+    //async listeners see stop few trees later, those trees are dropped anyway
+    BoostingConfig boostingConfig;
+    boostingConfig.step_ = 0.5;
+    boostingConfig.iterations_ = 300;
+    boostingConfig.listenersQueueSize_ = 4;
+    Boosting boosting(boostingConfig, createWeakTarget(0.0), createWeakLearner(6, grid));
+
+    auto metricsCalcer = std::make_shared<BoostingMetricsCalcer>(test);
+    metricsCalcer->addMetric(L2(test), "l2");
+    metricsCalcer->setEarlyStopping("l2", 3, false);
+    boosting.addListener(metricsCalcer);
+
+    L2 target(ds);
+    auto ensemble = std::dynamic_pointer_cast<Ensemble>(boosting.fit(ds, target));
+    ASSERT_TRUE(ensemble != nullptr);
+    EXPECT_TRUE(metricsCalcer->stopRequested());
+    EXPECT_EQ(metricsCalcer->bestEventsCount(), -1);
+    EXPECT_EQ(static_cast<int64_t>(ensemble->size()), metricsCalcer->stopEventsCount());
+}
+
 TEST(FeaturesTxt, TestTrainWithBootstrapMseFeaturesTxt) {
     auto ds = loadFeaturesTxt(PATH_PREFIX "test_data/featuresTxt/train");
     auto test = loadFeaturesTxt(PATH_PREFIX "test_data/featuresTxt/test");
@@ -90,6 +185,106 @@ TEST(FeaturesTxt, TestTrainWithBootstrapMseFeaturesTxt) {
     auto ensemble = boosting.fit(ds, target);
 }
 
+TEST(FeaturesTxt, TestTrainWithGradientSamplingMseFeaturesTxt) {
+    auto ds = loadFeaturesTxt(PATH_PREFIX "test_data/featuresTxt/train");
+    auto test = loadFeaturesTxt(PATH_PREFIX "test_data/featuresTxt/test");
+
+    BinarizationConfig config;
+    config.bordersCount_ = 32;
+    auto grid = buildGrid(ds, config);
+
+    for (auto type : {BootstrapType::Goss, BootstrapType::MinimalVariance}) {
+        BootstrapOptions options;
+        options.type_ = type;
+        options.sampleRate_ = 0.5;
+
+        BoostingConfig boostingConfig;
+        boostingConfig.iterations_ = 200;
+        Boosting boosting(boostingConfig,
+                          std::make_unique<GradientBoostingBootstrappedWeakTargetFactory>(options, 0.0),
+                          createWeakLearner(6, grid));
+
+        auto metricsCalcer = std::make_shared<BoostingMetricsCalcer>(test);
+        metricsCalcer->addMetric(L2(test), "l2");
+        boosting.addListener(metricsCalcer);
+        L2 target(ds);
+        auto ensemble = boosting.fit(ds, target);
+
+        Mx prediction(test.samplesCount(), 1);
+        ensemble->apply(test, prediction);
+        Mx zero(test.samplesCount(), 1);
+        EXPECT_LT(L2(test).value(prediction), L2(test).value(zero));
+    }
+}
+
+TEST(Bootstrap, SamplesDependOnSeedAndIterationOnly) {
+    const int64_t samplesCount = 50000;
+    std::mt19937 rng(42);
+    std::normal_distribution<double> normal;
+    std::vector<double> samples;
+    std::vector<double> targets;
+    for (int64_t i = 0; i < samplesCount; ++i) {
+        samples.push_back(normal(rng));
+        targets.push_back(normal(rng));
+    }
+    Vec samplesVec = VecFactory::fromVector(samples);
+    DataSet ds(Mx(samplesVec, samplesCount, 1), VecFactory::fromVector(targets));
+    L2 target(ds);
+    Mx startPoint(samplesCount, 1);
+
+    // expected share of taken samples and mean weight per sample (weights are unbiased except for uniform)
+    struct SamplingCase {
+        BootstrapType type_;
+        double rate_;
+        double meanWeight_;
+    };
+    const std::vector<SamplingCase> cases = {
+            {BootstrapType::Poisson, 1 - std::exp(-1.0), 1.0},
+            {BootstrapType::Uniform, 0.5, 0.5},
+            {BootstrapType::Goss, 0.5, 1.0},
+            {BootstrapType::MinimalVariance, 0.5, 1.0},
+    };
+    for (const auto& samplingCase : cases) {
+        BootstrapOptions options;
+        options.type_ = samplingCase.type_;
+        options.sampleRate_ = 0.5;
+        // bounds minimal variance weights, so their mean is stable
+        options.mvsReg_ = 1.0;
+        options.seed_ = 7;
+        GradientBoostingBootstrappedWeakTargetFactory first(options, 0.0);
+        GradientBoostingBootstrappedWeakTargetFactory second(options, 0.0);
+
+        std::vector<int32_t> previousIndices;
+        for (int iteration = 0; iteration < 2; ++iteration) {
+            auto firstTarget = first.create(ds, target, startPoint);
+            auto secondTarget = second.create(ds, target, startPoint);
+
+            auto firstIndices = firstTarget->indices();
+            auto secondIndices = secondTarget->indices();
+            auto firstWeights = firstTarget->weights();
+            auto secondWeights = secondTarget->weights();
+            ASSERT_EQ(firstIndices.size(), secondIndices.size());
+            ASSERT_EQ(firstWeights.dim(), firstIndices.size());
+            ASSERT_EQ(secondWeights.dim(), secondIndices.size());
+
+            std::vector<int32_t> indices(firstIndices.arrayRef().begin(), firstIndices.arrayRef().end());
+            double weightsSum = 0;
+            for (int64_t i = 0; i < firstIndices.size(); ++i) {
+                ASSERT_EQ(indices[i], secondIndices.arrayRef()[i]);
+                ASSERT_EQ(firstWeights.get(i), secondWeights.get(i));
+                weightsSum += firstWeights.get(i);
+            }
+
+            EXPECT_NEAR(static_cast<double>(indices.size()) / samplesCount, samplingCase.rate_, 0.02);
+            EXPECT_NEAR(weightsSum / samplesCount, samplingCase.meanWeight_, 0.05);
+
+            // next iteration draws another sample
+            EXPECT_NE(indices, previousIndices);
+            previousIndices = std::move(indices);
+        }
+    }
+}
+
 TEST(FeaturesTxt, TestTrainWithBootstrapLogLikelihoodFeaturesTxt) {
     auto ds = loadFeaturesTxt(PATH_PREFIX "test_data/featuresTxt/train");
 
@@ -194,6 +389,90 @@ TEST(BoostingLinearTrees, SimpleDs) {
     }
 }
 
+// two features and deep trees, so features are split repeatedly
+DataSet repeatedSplitsDs() {
+    const int samplesCount = 2000;
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> uniform(-1, 1);
+    std::normal_distribution<double> noise(0, 0.1);
+
+    std::vector<double> samples;
+    std::vector<double> target;
+    for (int i = 0; i < samplesCount; ++i) {
+        const double x0 = uniform(rng);
+        const double x1 = uniform(rng);
+        samples.push_back(x0);
+        samples.push_back(x1);
+        target.push_back(std::sin(4 * x0) + x0 * x1 + (x1 > 0.3 ? 1 : -x1) + noise(rng));
+    }
+
+    Vec samplesVec = VecFactory::fromVector(samples);
+    return DataSet(Mx(samplesVec, samplesCount, 2), VecFactory::fromVector(target));
+}
+
+std::shared_ptr<LinearObliviousTree> fitLinearTree(const DataSet& ds,
+                                                   GridPtr grid,
+                                                   const GreedyLinearObliviousTreeLearnerOptions& opts) {
+    GreedyLinearObliviousTreeLearner learner(std::move(grid), opts);
+    LinearL2 target(ds, opts.l2reg);
+    return std::dynamic_pointer_cast<LinearObliviousTree>(learner.fit(ds, target));
+}
+
+// float sums are taken in other order, so weights are compared approximately
+void expectSameLinearTrees(const LinearObliviousTree& expected, const LinearObliviousTree& actual) {
+    ASSERT_EQ(expected.splits_, actual.splits_);
+    ASSERT_EQ(expected.leaves_.size(), actual.leaves_.size());
+    for (int i = 0; i < (int)expected.leaves_.size(); ++i) {
+        const auto& expectedLeaf = expected.leaves_[i];
+        const auto& actualLeaf = actual.leaves_[i];
+        EXPECT_EQ(expectedLeaf.usedFeaturesInOrder_, actualLeaf.usedFeaturesInOrder_);
+        EXPECT_NEAR(expectedLeaf.weight_, actualLeaf.weight_, 1e-3);
+        ASSERT_EQ(expectedLeaf.w_.size(), actualLeaf.w_.size());
+        for (int j = 0; j < (int)expectedLeaf.w_.size(); ++j) {
+            EXPECT_NEAR(expectedLeaf.w_(j, 0), actualLeaf.w_(j, 0), 1e-3 * std::max(1.0, std::abs(expectedLeaf.w_(j, 0))));
+        }
+    }
+}
+
+TEST(BoostingLinearTrees, ParentStatsSubtractionMatchesFullScan) {
+    auto ds = repeatedSplitsDs();
+    BinarizationConfig config;
+    config.bordersCount_ = 16;
+    auto grid = buildGrid(ds, config);
+
+    GreedyLinearObliviousTreeLearnerOptions opts;
+    opts.maxDepth = 5;
+    opts.l2reg = 1.0;
+
+    opts.subtractParentStats = false;
+    auto fullScan = fitLinearTree(ds, grid, opts);
+    opts.subtractParentStats = true;
+    auto subtracted = fitLinearTree(ds, grid, opts);
+
+    // with two features some split reuses a feature, so parent stats are subtracted at least once
+    ASSERT_GT(fullScan->splits_.size(), 2u);
+    expectSameLinearTrees(*fullScan, *subtracted);
+}
+
+TEST(BoostingLinearTrees, SharedStatsMatchPerThreadStats) {
+    auto ds = repeatedSplitsDs();
+    BinarizationConfig config;
+    config.bordersCount_ = 16;
+    auto grid = buildGrid(ds, config);
+
+    GreedyLinearObliviousTreeLearnerOptions opts;
+    opts.maxDepth = 5;
+    opts.l2reg = 1.0;
+
+    auto perThread = fitLinearTree(ds, grid, opts);
+    // nothing fits, so threads share one copy of stats
+    opts.statsMemoryLimitMb = 0;
+    auto shared = fitLinearTree(ds, grid, opts);
+
+    ASSERT_GT(perThread->splits_.size(), 2u);
+    expectSameLinearTrees(*perThread, *shared);
+}
+
 TEST(BoostingLinearTrees, FeaturesTxt) {
     auto ds = loadFeaturesTxt(PATH_PREFIX "test_data/featuresTxt/train");
     auto test = loadFeaturesTxt(PATH_PREFIX "test_data/featuresTxt/test");
@@ -35,8 +35,7 @@ protected:
 
     virtual void applyToDs(const DataSet& ds, Mx to) const {
         if (gridPtr()) {
-            // TODO cachedBinarize... hardcode sizes for now
-            const auto& bds = cachedBinarize(ds, gridPtr(), gridPtr()->origFeaturesCount());
+            const auto& bds = cachedBinarize(ds, gridPtr());
             applyToBds(bds, to, ApplyType::Set);
         } else {
             Model::applyToDs(ds, to);
@@ -45,8 +44,7 @@ protected:
 
     virtual void appendToDs(const DataSet& ds, Mx to) const {
         if (gridPtr()) {
-            // TODO cachedBinarize... hardcode sizes for now
-            const auto& bds = cachedBinarize(ds, gridPtr(), gridPtr()->origFeaturesCount());
+            const auto& bds = cachedBinarize(ds, gridPtr());
             applyToBds(bds, to, ApplyType::Append);
         } else {
             Model::appendToDs(ds, to);
@@ -84,9 +82,7 @@ public:
     }
 
     Vec trans(const Vec& x, Vec to) const override {
-        Buffer<uint8_t> bins = Buffer<uint8_t>::create(x.dim());
-        static_cast<const Impl*>(this)->grid().binarize(x, bins);
-        static_cast<const Impl*>(this)->applyBinarizedRow(bins, to);
+        static_cast<const Impl*>(this)->applyToRows(x.arrayRef().data(), 1, to.arrayRef(), ApplyType::Set);
         return to;
     }
 
@@ -0,0 +1,182 @@
+#include "compiled_ensemble.h"
+#include "oblivious_tree.h"
+
+#include <util/parallel_executor.h>
+
+#include <algorithm>
+
+namespace {
+    //bins of block for all used features should fit into L1/L2
+    constexpr int64_t SamplesBlockSize = 256;
+    //scratch for raw rows lives on stack
+    constexpr int64_t RowsBlockSize = 64;
+}
+
+CompiledObliviousEnsemblePtr CompiledObliviousEnsemble::compile(const std::vector<ModelPtr>& models) {
+    if (models.empty()) {
+        return nullptr;
+    }
+
+    std::shared_ptr<CompiledObliviousEnsemble> result(new CompiledObliviousEnsemble());
+    std::vector<int32_t> featureSlots;
+    result->splitOffsets_.push_back(0);
+    result->leafOffsets_.push_back(0);
+
+    for (const auto& model : models) {
+        auto tree = std::dynamic_pointer_cast<ObliviousTree>(model);
+        if (!tree) {
+            return nullptr;
+        }
+
+        if (!result->grid_) {
+            result->grid_ = tree->gridPtr();
+            featureSlots.assign(result->grid_->nzFeaturesCount(), -1);
+        } else if (result->grid_ != tree->gridPtr()) {
+            return nullptr;
+        }
+
+        for (const auto& split : tree->splits()) {
+            auto& slot = featureSlots[split.featureId_];
+            if (slot < 0) {
+                slot = static_cast<int32_t>(result->usedFeatures_.size());
+                result->usedFeatures_.push_back(split.featureId_);
+            }
+            result->splitSlots_.push_back(slot);
+            result->splitConditions_.push_back(static_cast<uint8_t>(split.conditionId_));
+            result->splitOrigFeatures_.push_back(result->grid_->origFeatureIndex(split.featureId_));
+            result->splitBorders_.push_back(result->grid_->borders(split.featureId_)[split.conditionId_]);
+        }
+        result->splitOffsets_.push_back(static_cast<int32_t>(result->splitSlots_.size()));
+
+        auto leaves = tree->leaves().arrayRef();
+        result->leaves_.insert(result->leaves_.end(), leaves.begin(), leaves.end());
+        result->leafOffsets_.push_back(static_cast<int64_t>(result->leaves_.size()));
+    }
+    return result;
+}
+
+void CompiledObliviousEnsemble::apply(const BinarizedDataSet& ds, VecRef<float> dst, ApplyType type, double scale) const {
+    assert(ds.grid().uuid() == grid_->uuid());
+    assert(static_cast<int64_t>(dst.size()) == ds.samplesCount());
+
+    const int64_t samplesCount = ds.samplesCount();
+    const int64_t usedCount = static_cast<int64_t>(usedFeatures_.size());
+
+    struct FeatureColumn {
+        const uint8_t* data_ = nullptr;
+        int64_t stride_ = 0;
+    };
+
+    std::vector<FeatureColumn> columns;
+    for (int32_t fIndex : usedFeatures_) {
+        const int64_t groupIdx = ds.featureGroup(fIndex);
+        const auto& bundle = ds.featuresBundle(groupIdx);
+        columns.push_back({ds.group(groupIdx).data() + fIndex - bundle.firstFeature_, bundle.groupSize()});
+    }
+
+    const int64_t numThreads = GlobalThreadPool<0>().numThreads();
+    std::vector<std::vector<uint8_t>> blockBins(numThreads, std::vector<uint8_t>(usedCount * SamplesBlockSize));
+    std::vector<std::vector<uint32_t>> blockLeaves(numThreads, std::vector<uint32_t>(SamplesBlockSize));
+    std::vector<std::vector<float>> blockSums(numThreads, std::vector<float>(SamplesBlockSize));
+
+    const int64_t blocksCount = (samplesCount + SamplesBlockSize - 1) / SamplesBlockSize;
+    const float alpha = static_cast<float>(scale);
+
+    parallelFor(0, blocksCount, [&](int thId, int64_t blockIdx) {
+        const int64_t first = blockIdx * SamplesBlockSize;
+        const int64_t size = std::min<int64_t>(SamplesBlockSize, samplesCount - first);
+
+        uint8_t* bins = blockBins[thId].data();
+        uint32_t* leafIdx = blockLeaves[thId].data();
+        float* sums = blockSums[thId].data();
+
+        for (int64_t slot = 0; slot < usedCount; ++slot) {
+            const auto& column = columns[slot];
+            const uint8_t* src = column.data_ + first * column.stride_;
+            uint8_t* dstColumn = bins + slot * SamplesBlockSize;
+            for (int64_t i = 0; i < size; ++i) {
+                dstColumn[i] = src[i * column.stride_];
+            }
+        }
+
+        std::fill(sums, sums + size, 0.0f);
+
+        for (int64_t tree = 0; tree < treesCount(); ++tree) {
+            std::fill(leafIdx, leafIdx + size, 0u);
+
+            const int32_t firstSplit = splitOffsets_[tree];
+            for (int32_t split = firstSplit; split < splitOffsets_[tree + 1]; ++split) {
+                const uint8_t* column = bins + splitSlots_[split] * SamplesBlockSize;
+                const uint8_t condition = splitConditions_[split];
+                const uint32_t depth = split - firstSplit;
+                for (int64_t i = 0; i < size; ++i) {
+                    leafIdx[i] |= static_cast<uint32_t>(column[i] > condition) << depth;
+                }
+            }
+
+            const float* treeLeaves = leaves_.data() + leafOffsets_[tree];
+            for (int64_t i = 0; i < size; ++i) {
+                sums[i] += treeLeaves[leafIdx[i]];
+            }
+        }
+
+        if (type == ApplyType::Set) {
+            for (int64_t i = 0; i < size; ++i) {
+                dst[first + i] = alpha * sums[i];
+            }
+        } else {
+            for (int64_t i = 0; i < size; ++i) {
+                dst[first + i] += alpha * sums[i];
+            }
+        }
+    });
+}
+
+void CompiledObliviousEnsemble::apply(const DataSet& ds, VecRef<float> dst, ApplyType type, double scale) const {
+    //default group size as everywhere, so learners, trees and compiled ensemble share cached binarization
+    const auto& bds = cachedBinarize(ds, grid_);
+    apply(bds, dst, type, scale);
+}
+
+void CompiledObliviousEnsemble::apply(const float* rows, int64_t rowsCount, int64_t rowSize, VecRef<float> dst, ApplyType type, double scale) const {
+    assert(static_cast<int64_t>(dst.size()) >= rowsCount);
+    const float alpha = static_cast<float>(scale);
+
+    uint32_t leafIdx[RowsBlockSize];
+    float sums[RowsBlockSize];
+
+    for (int64_t first = 0; first < rowsCount; first += RowsBlockSize) {
+        const int64_t size = std::min<int64_t>(RowsBlockSize, rowsCount - first);
+        const float* block = rows + first * rowSize;
+        std::fill(sums, sums + size, 0.0f);
+
+        for (int64_t tree = 0; tree < treesCount(); ++tree) {
+            std::fill(leafIdx, leafIdx + size, 0u);
+
+            const int32_t firstSplit = splitOffsets_[tree];
+            for (int32_t split = firstSplit; split < splitOffsets_[tree + 1]; ++split) {
+                const float* column = block + splitOrigFeatures_[split];
+                const float border = splitBorders_[split];
+                const uint32_t depth = split - firstSplit;
+                for (int64_t i = 0; i < size; ++i) {
+                    leafIdx[i] |= static_cast<uint32_t>(column[i * rowSize] > border) << depth;
+                }
+            }
+
+            const float* treeLeaves = leaves_.data() + leafOffsets_[tree];
+            for (int64_t i = 0; i < size; ++i) {
+                sums[i] += treeLeaves[leafIdx[i]];
+            }
+        }
+
+        if (type == ApplyType::Set) {
+            for (int64_t i = 0; i < size; ++i) {
+                dst[first + i] = alpha * sums[i];
+            }
+        } else {
+            for (int64_t i = 0; i < size; ++i) {
+                dst[first + i] += alpha * sums[i];
+            }
+        }
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "model.h"
+#include <data/grid.h>
+#include <data/binarized_dataset.h>
+
+#include <memory>
+#include <vector>
+
+class CompiledObliviousEnsemble;
+using CompiledObliviousEnsemblePtr = std::shared_ptr<const CompiledObliviousEnsemble>;
+
+/*
+ * Oblivious trees of ensemble packed into flat arrays.
+ * Splits of tree t are [splitOffsets_[t], splitOffsets_[t + 1]), leaves are [leafOffsets_[t], leafOffsets_[t + 1]).
+ * Apply goes over blocks of samples: bins of used features for the block are transposed into small
+ * column-major buffer and all trees are evaluated against it while it's in cache
+ */
+class CompiledObliviousEnsemble {
+public:
+
+    //nullptr if models are not oblivious trees over one grid
+    static CompiledObliviousEnsemblePtr compile(const std::vector<ModelPtr>& models);
+
+    GridPtr gridPtr() const {
+        return grid_;
+    }
+
+    const Grid& grid() const {
+        return *grid_;
+    }
+
+    int64_t treesCount() const {
+        return static_cast<int64_t>(splitOffsets_.size()) - 1;
+    }
+
+    //dst = scale * sum or dst += scale * sum
+    void apply(const BinarizedDataSet& ds, VecRef<float> dst, ApplyType type, double scale = 1.0) const;
+
+    void apply(const DataSet& ds, VecRef<float> dst, ApplyType type, double scale = 1.0) const;
+
+    //raw row-major rows, compared with float borders. Runs in calling thread and doesn't allocate
+    void apply(const float* rows, int64_t rowsCount, int64_t rowSize, VecRef<float> dst, ApplyType type, double scale = 1.0) const;
+
+private:
+    CompiledObliviousEnsemble() = default;
+
+private:
+    GridPtr grid_;
+
+    //nz features, which are used in splits. splits reference them by slot in this vector
+    std::vector<int32_t> usedFeatures_;
+
+    std::vector<int32_t> splitOffsets_;
+    std::vector<int32_t> splitSlots_;
+    std::vector<uint8_t> splitConditions_;
+    //same splits for raw rows: original feature index and border
+    std::vector<int32_t> splitOrigFeatures_;
+    std::vector<float> splitBorders_;
+
+    std::vector<int64_t> leafOffsets_;
+    std::vector<float> leaves_;
+};
@@ -1,10 +1,33 @@
 #include "ensemble.h"
 
+#include <vector>
+
 void Ensemble::appendTo(const Vec& x, Vec to) const  {
+    if (scale_ == 1.0) {
+        for (const auto& modelPtr : models_) {
+            modelPtr->appendTo(x, to);
+        }
+        return;
+    }
+    Vec sums(to.dim());
     for (const auto& modelPtr : models_) {
-        modelPtr->appendTo(x, to);
+        modelPtr->appendTo(x, sums);
+    }
+    sums *= scale_;
+    to += sums;
+}
+
+void Ensemble::applyToRows(const float* rows, int64_t rowsCount, VecRef<float> dst, ApplyType type, double scale) const {
+    //scale is pushed down to models, so append to dst doesn't need scratch for ensemble sum
+    const double modelScale = scale * scale_;
+    if (compiled_) {
+        compiled_->apply(rows, rowsCount, xdim(), dst, type, modelScale);
+        return;
     }
-    if (scale_ != 1.0) {
-        to *= scale_;
+
+    ApplyType modelType = type;
+    for (const auto& model : models_) {
+        model->applyToRows(rows, rowsCount, dst, modelType, modelScale);
+        modelType = ApplyType::Append;
     }
 }
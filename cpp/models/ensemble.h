@@ -2,6 +2,7 @@
 
 #include "model.h"
 #include "bin_optimized_model.h"
+#include "compiled_ensemble.h"
 
 #include <util/io.h>
 #include <data/grid_builder.h>
@@ -13,7 +14,8 @@ public:
     : Stub<Model, Ensemble>(
         models.front()->xdim(),
         models.front()->ydim())
-    , models_(std::move(models)) {
+    , models_(std::move(models))
+    , compiled_(CompiledObliviousEnsemble::compile(models_)) {
 
     }
 
@@ -22,28 +24,48 @@ public:
             models.front()->xdim(),
             models.front()->ydim())
             , models_(std::move(models))
-            , scale_(scale) {
+            , scale_(scale)
+            , compiled_(CompiledObliviousEnsemble::compile(models_)) {
 
     }
 
     Ensemble(const Ensemble& other, double scale)
     : Stub<Model, Ensemble>(other.xdim(), other.ydim())
     , models_(other.models_)
-    , scale_(other.scale_ * scale){
+    , scale_(other.scale_ * scale)
+    , compiled_(other.compiled_) {
     }
 
     void appendTo(const Vec& x, Vec to) const override;
 
+    void applyToRows(const float* rows, int64_t rowsCount, VecRef<float> dst, ApplyType type = ApplyType::Set, double scale = 1.0) const override;
+
     void appendToDs(const DataSet& ds, Mx to) const override {
-        for (const auto& model : models_) {
-            model->append(ds, to);
+        if (compiled_) {
+            compiled_->apply(ds, static_cast<Vec>(to).arrayRef(), ApplyType::Append, scale_);
+            return;
         }
-        if (scale_ != 1.0) {
-            to *= scale_;
+        if (scale_ == 1.0) {
+            for (const auto& model : models_) {
+                model->append(ds, to);
+            }
+            return;
+        }
+        //scale applies to ensemble sum only, previous content of to stays as is
+        Mx sums(to.xdim(), to.ydim());
+        for (const auto& model : models_) {
+            model->append(ds, sums);
         }
+        sums *= scale_;
+        to += sums;
     }
 
     void applyToDs(const DataSet& ds, Mx to) const override {
+        if (compiled_) {
+            compiled_->apply(ds, static_cast<Vec>(to).arrayRef(), ApplyType::Set, scale_);
+            return;
+        }
+        VecTools::fill(0, to);
         for (const auto& model : models_) {
             model->append(ds, to);
         }
@@ -165,6 +187,8 @@ public:
 private:
     std::vector<ModelPtr> models_;
     double scale_ = 1.0;
+    //flat copy of trees for fast dataset apply, nullptr if ensemble is not made of oblivious trees
+    CompiledObliviousEnsemblePtr compiled_;
 
     mutable bool serializeLastCalled_ = false;
 };
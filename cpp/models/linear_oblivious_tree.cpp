@@ -1,32 +1,210 @@
 #include "linear_oblivious_tree.h"
 
+#include <util/parallel_executor.h>
+
+#include <algorithm>
+
+
+namespace {
+    //leaf indices and bins of block stay in L1
+    constexpr int64_t SamplesBlockSize = 256;
+
+    //bins column of nz feature fIndex, stride is group size
+    struct BinsColumn {
+        const uint8_t* data_ = nullptr;
+        int64_t stride_ = 0;
+    };
+}
+
+std::shared_ptr<const LinearObliviousTree::PackedLeaves> LinearObliviousTree::packedLeaves() const {
+    auto packed = std::atomic_load(&packedLeaves_);
+    if (packed) {
+        return packed;
+    }
+
+    auto leaves = std::make_shared<PackedLeaves>();
+    if (!leaves_.empty()) {
+        leaves->features_ = leaves_[0].usedFeaturesInOrder_;
+    }
+    leaves->sameFeatures_ = !leaves->features_.empty();
+    for (const auto& leaf : leaves_) {
+        leaves->sameFeatures_ &= leaf.usedFeaturesInOrder_ == leaves->features_
+            && (int64_t)leaf.w_.size() == (int64_t)leaves->features_.size();
+    }
+    if (leaves->sameFeatures_) {
+        const int64_t nLeaves = leaves_.size();
+        const int64_t wSize = leaves->features_.size();
+        leaves->weights_.resize(wSize * nLeaves);
+        for (int64_t l = 0; l < nLeaves; ++l) {
+            for (int64_t k = 0; k < wSize; ++k) {
+                leaves->weights_[k * nLeaves + l] = static_cast<float>(leaves_[l].w_(k, 0));
+            }
+        }
+    }
+    //concurrent callers could build it twice, result is the same
+    std::atomic_store(&packedLeaves_, std::shared_ptr<const PackedLeaves>(leaves));
+    return leaves;
+}
+
+std::shared_ptr<const LinearObliviousTree::BinSplits> LinearObliviousTree::binSplits(const GridPtr& grid) const {
+    auto cached = std::atomic_load(&binSplits_);
+    if (cached && cached->grid_ == grid) {
+        return cached;
+    }
+
+    auto splits = std::make_shared<BinSplits>();
+    splits->grid_ = grid;
+    for (const auto& split : splits_) {
+        const int32_t origFId = std::get<0>(split);
+        const double border = std::get<1>(split);
+        bool found = false;
+        for (int64_t fIndex = 0; fIndex < grid->nzFeaturesCount() && !found; ++fIndex) {
+            if (grid->origFeatureIndex(fIndex) != origFId) {
+                continue;
+            }
+            const auto borders = grid->borders(fIndex);
+            for (uint64_t condId = 0; condId < borders.size(); ++condId) {
+                if (borders[condId] == border) {
+                    splits->fIndices_.push_back(fIndex);
+                    splits->conditions_.push_back(condId);
+                    found = true;
+                    break;
+                }
+            }
+        }
+    }
+    splits->valid_ = splits->fIndices_.size() == splits_.size();
+    std::atomic_store(&binSplits_, std::shared_ptr<const BinSplits>(splits));
+    return splits;
+}
 
 void LinearObliviousTree::applyToBds(const BinarizedDataSet& bds, Mx to, ApplyType type) const {
     const auto &ds = bds.owner();
-    const uint64_t sampleDim = ds.featuresCount();
-    const uint64_t targetDim = to.xdim();
+    const int64_t samplesCount = ds.samplesCount();
+    const int64_t sampleDim = ds.featuresCount();
+    const int64_t depth = splits_.size();
+    assert(to.xdim() == 1);
 
-    ConstVecRef<float> dsRef = ds.samplesMx().arrayRef();
     VecRef<float> toRef = to.arrayRef();
+    const float* samples = ds.samples();
+    const int64_t blocksCount = (samplesCount + SamplesBlockSize - 1) / SamplesBlockSize;
+
+    const auto splits = binSplits(bds.gridPtr());
+    if (!splits->valid_) {
+        //splits are not on the grid of dataset, so leaves are found by feature values
+        parallelFor(0, blocksCount, [&](int64_t blockIdx) {
+            const int64_t first = blockIdx * SamplesBlockSize;
+            const int64_t size = std::min<int64_t>(SamplesBlockSize, samplesCount - first);
+            applyToRows(samples + first * sampleDim, size, VecRef<float>(toRef.data() + first, size), type);
+        });
+        return;
+    }
+    std::vector<BinsColumn> splitColumns;
+    splitColumns.reserve(depth);
+    for (int32_t fIndex : splits->fIndices_) {
+        const int64_t groupIdx = bds.featureGroup(fIndex);
+        const auto& bundle = bds.featuresBundle(groupIdx);
+        splitColumns.push_back({bds.group(groupIdx).data() + fIndex - bundle.firstFeature_, bundle.groupSize()});
+    }
+    const uint8_t* splitConditions = splits->conditions_.data();
 
-    uint64_t xSliceStart = 0;
-    uint64_t toSliceStart = 0;
+    const auto packed = packedLeaves();
+    const float leafScale = static_cast<float>(scale_);
 
-    for (int64_t i = 0; i < ds.samplesCount(); ++i) {
-        ConstVecRef<float> x = dsRef.slice(xSliceStart, sampleDim);
-        VecRef<float> y = toRef.slice(toSliceStart, targetDim);
+    parallelFor(0, blocksCount, [&](int64_t blockIdx) {
+        const int64_t first = blockIdx * SamplesBlockSize;
+        const int64_t size = std::min<int64_t>(SamplesBlockSize, samplesCount - first);
 
-        switch (type) {
-            case ApplyType::Append:
-                y[0] += value(x);
-                break;
-            case ApplyType::Set:
-            default:
-                y[0] = value(x);
+        uint32_t leafIdx[SamplesBlockSize];
+        float values[SamplesBlockSize];
+        std::fill(leafIdx, leafIdx + size, 0u);
+
+        for (int64_t s = 0; s < depth; ++s) {
+            const auto& column = splitColumns[s];
+            const uint8_t* bins = column.data_ + first * column.stride_;
+            const uint8_t condition = splitConditions[s];
+            const uint32_t shift = depth - s - 1;
+            for (int64_t i = 0; i < size; ++i) {
+                leafIdx[i] |= static_cast<uint32_t>(bins[i * column.stride_] > condition) << shift;
+            }
+        }
+
+        leafValues(*packed, samples + first * sampleDim, sampleDim, leafIdx, size, values);
+
+        float* dst = toRef.data() + first;
+        if (type == ApplyType::Append) {
+            for (int64_t i = 0; i < size; ++i) {
+                dst[i] += leafScale * values[i];
+            }
+        } else {
+            for (int64_t i = 0; i < size; ++i) {
+                dst[i] = leafScale * values[i];
+            }
+        }
+    });
+}
+
+void LinearObliviousTree::applyToRows(const float* rows, int64_t rowsCount, VecRef<float> dst, ApplyType type, double scale) const {
+    assert(static_cast<int64_t>(dst.size()) >= rowsCount);
+    const int64_t rowSize = xdim();
+    const int64_t depth = splits_.size();
+    const auto packed = packedLeaves();
+    const float leafScale = static_cast<float>(scale * scale_);
+
+    uint32_t leafIdx[SamplesBlockSize];
+    float values[SamplesBlockSize];
+
+    for (int64_t first = 0; first < rowsCount; first += SamplesBlockSize) {
+        const int64_t size = std::min<int64_t>(SamplesBlockSize, rowsCount - first);
+        const float* x = rows + first * rowSize;
+        std::fill(leafIdx, leafIdx + size, 0u);
+
+        for (int64_t s = 0; s < depth; ++s) {
+            const float* column = x + std::get<0>(splits_[s]);
+            const double border = std::get<1>(splits_[s]);
+            const uint32_t shift = depth - s - 1;
+            for (int64_t i = 0; i < size; ++i) {
+                leafIdx[i] |= static_cast<uint32_t>(column[i * rowSize] > border) << shift;
+            }
         }
 
-        xSliceStart += sampleDim;
-        toSliceStart += targetDim;
+        leafValues(*packed, x, rowSize, leafIdx, size, values);
+
+        if (type == ApplyType::Append) {
+            for (int64_t i = 0; i < size; ++i) {
+                dst[first + i] += leafScale * values[i];
+            }
+        } else {
+            for (int64_t i = 0; i < size; ++i) {
+                dst[first + i] = leafScale * values[i];
+            }
+        }
+    }
+}
+
+void LinearObliviousTree::leafValues(const PackedLeaves& packed, const float* x, int64_t rowStride,
+                                     const uint32_t* leafIdx, int64_t size, float* values) const {
+    if (!packed.sameFeatures_) {
+        for (int64_t i = 0; i < size; ++i) {
+            ConstVecRef<float> row(x + i * rowStride, rowStride);
+            values[i] = static_cast<float>(leaves_[leafIdx[i]].value(row));
+        }
+        return;
+    }
+
+    // bias first, then features, weights are gathered by leaf index
+    const int64_t nLeaves = leaves_.size();
+    const int64_t wSize = packed.features_.size();
+    const float* bias = packed.weights_.data();
+    for (int64_t i = 0; i < size; ++i) {
+        values[i] = bias[leafIdx[i]];
+    }
+    for (int64_t k = 1; k < wSize; ++k) {
+        const float* w = packed.weights_.data() + k * nLeaves;
+        const float* column = x + packed.features_[k];
+        for (int64_t i = 0; i < size; ++i) {
+            values[i] += column[i * rowStride] * w[leafIdx[i]];
+        }
     }
 }
 
@@ -125,6 +125,8 @@ public:
         scale_ = scale;
         leaves_ = other.leaves_;
         splits_ = other.splits_;
+        packedLeaves_ = std::atomic_load(&other.packedLeaves_);
+        binSplits_ = std::atomic_load(&other.binSplits_);
     }
 
     LinearObliviousTree(GridPtr grid, std::vector<LinearObliviousTreeLeaf> leaves)
@@ -168,9 +170,7 @@ public:
 
     void applyToBds(const BinarizedDataSet& ds, Mx to, ApplyType type) const override;
 
-    void applyBinarizedRow(const Buffer<uint8_t>& x, Vec to) const {
-        throw std::runtime_error("Unimplemented");
-    }
+    void applyToRows(const float* rows, int64_t rowsCount, VecRef<float> dst, ApplyType type = ApplyType::Set, double scale = 1.0) const override;
 
     double value(const Vec& x) override;
 
@@ -297,4 +297,34 @@ public:
     std::vector<std::tuple<int32_t, double>> splits_;
 
     std::vector<LinearObliviousTreeLeaf> leaves_;
+
+private:
+    //leaves as dense float arrays: weight k of leaf l is at [k * leaves count + l], scale is not folded in.
+    //Trees of learner have the same features in all leaves, otherwise leaves are applied one by one
+    struct PackedLeaves {
+        std::vector<int32_t> features_;
+        std::vector<float> weights_;
+        bool sameFeatures_ = false;
+    };
+
+    //splits as conditions on bins of grid: bin > condition is the same as x > border
+    struct BinSplits {
+        GridPtr grid_;
+        std::vector<int32_t> fIndices_;
+        std::vector<uint8_t> conditions_;
+        //false if splits are not from this grid (e.g. model was trained on other one)
+        bool valid_ = false;
+    };
+
+    //built on first batch apply: tree is not changed after learner or deserialization fills it
+    std::shared_ptr<const PackedLeaves> packedLeaves() const;
+
+    std::shared_ptr<const BinSplits> binSplits(const GridPtr& grid) const;
+
+    //unscaled values of rows block with known leaves, row i starts at x + i * rowStride
+    void leafValues(const PackedLeaves& packed, const float* x, int64_t rowStride,
+                    const uint32_t* leafIdx, int64_t size, float* values) const;
+
+    mutable std::shared_ptr<const PackedLeaves> packedLeaves_;
+    mutable std::shared_ptr<const BinSplits> binSplits_;
 };
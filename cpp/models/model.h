@@ -3,6 +3,8 @@
 #include <data/dataset.h>
 #include <vec_tools/fill.h>
 
+#include <algorithm>
+
 //todo: in model
 enum class ApplyType {
     Append,
@@ -40,6 +42,35 @@ public:
     }
 
     virtual void appendTo(const Vec& x, Vec to) const = 0;
+
+    /*
+     * Batch of raw rows: rows is row-major rowsCount x xdim(), dst[i * ydim() + j] is set to (or incremented by)
+     * j-th output for row i, multiplied by scale. Runs in calling thread: tree models don't allocate here,
+     * default implementation goes through appendTo with one row buffer per call
+     */
+    virtual void applyToRows(const float* rows, int64_t rowsCount, VecRef<float> dst, ApplyType type = ApplyType::Set, double scale = 1.0) const {
+        const int64_t rowSize = xdim();
+        const int64_t outSize = ydim();
+        assert(static_cast<int64_t>(dst.size()) >= rowsCount * outSize);
+
+        Vec x(rowSize);
+        Vec y(outSize);
+        VecRef<float> xRef = x.arrayRef();
+        VecRef<float> yRef = y.arrayRef();
+        for (int64_t i = 0; i < rowsCount; ++i) {
+            std::copy(rows + i * rowSize, rows + (i + 1) * rowSize, xRef.begin());
+            VecTools::fill(0, y);
+            appendTo(x, y);
+            for (int64_t j = 0; j < outSize; ++j) {
+                if (type == ApplyType::Set) {
+                    dst[i * outSize + j] = scale * yRef[j];
+                } else {
+                    dst[i * outSize + j] += scale * yRef[j];
+                }
+            }
+        }
+    }
+
     virtual double value(const Vec& x) { return 0; }
     virtual void grad(const Vec& x, Vec to) {}
 
@@ -0,0 +1,430 @@
+#include "model_binary.h"
+#include "ensemble.h"
+#include "oblivious_tree.h"
+#include "linear_oblivious_tree.h"
+
+#include <data/grid_builder.h>
+#include <util/exception.h>
+#include <util/mapped_file.h>
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+namespace {
+    const char ModelMagic[8] = {'E', 'T', 'M', 'O', 'D', 'E', 'L', 'B'};
+    constexpr uint32_t ModelFormatVersion = 1;
+    constexpr uint64_t SectionAlignment = 64;
+
+    enum class ModelKind : uint32_t {
+        Ensemble = 1,
+        ObliviousTree = 2,
+        LinearObliviousTree = 3
+    };
+
+    enum class TreesKind : uint32_t {
+        Oblivious = 1,
+        Linear = 2
+    };
+
+    enum class SectionType : uint32_t {
+        Grid = 1,
+        //trees count + 1 offsets in splits
+        TreeSplitOffsets = 2,
+        //nz feature index for oblivious trees, original feature index for linear ones
+        SplitFeatures = 3,
+        SplitConditions = 4,
+        SplitBorders = 5,
+        //trees count + 1 offsets in leaves
+        TreeLeafOffsets = 6,
+        LeafValues = 7,
+        //linear trees: leaves count + 1 offsets in weights, feature of every weight (-1 is bias)
+        LeafWeightOffsets = 8,
+        WeightFeatures = 9,
+        Weights = 10,
+        LeafSampleWeights = 11,
+        TreeScales = 12
+    };
+
+    struct FileHeader {
+        char magic_[8];
+        uint32_t version_ = ModelFormatVersion;
+        uint32_t sectionsCount_ = 0;
+        uint32_t modelKind_ = 0;
+        uint32_t treesKind_ = 0;
+        int64_t treesCount_ = 0;
+        int64_t xdim_ = 0;
+        double scale_ = 1.0;
+        //covers header bytes (with this field zeroed) and section table
+        uint64_t tableChecksum_ = 0;
+    };
+
+    struct SectionEntry {
+        uint32_t type_ = 0;
+        uint32_t reserved_ = 0;
+        uint64_t offset_ = 0;
+        uint64_t size_ = 0;
+        uint64_t checksum_ = 0;
+    };
+
+    //FNV-1a, hash of preceding bytes could be continued
+    uint64_t checksum(const char* data, uint64_t size, uint64_t hash = 14695981039346656037ULL) {
+        for (uint64_t i = 0; i < size; ++i) {
+            hash ^= static_cast<uint8_t>(data[i]);
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    uint64_t tableChecksum(FileHeader header, const char* table, uint64_t tableSize) {
+        header.tableChecksum_ = 0;
+        return checksum(table, tableSize, checksum(reinterpret_cast<const char*>(&header), sizeof(header)));
+    }
+
+    uint64_t alignUp(uint64_t offset) {
+        return (offset + SectionAlignment - 1) / SectionAlignment * SectionAlignment;
+    }
+
+    class SectionsWriter {
+    public:
+        template <class T>
+        void add(SectionType type, const std::vector<T>& data) {
+            add(type, reinterpret_cast<const char*>(data.data()), data.size() * sizeof(T));
+        }
+
+        void add(SectionType type, const char* data, uint64_t size) {
+            types_.push_back(type);
+            data_.emplace_back(data, size);
+        }
+
+        void write(FileHeader header, const std::string& file) const {
+            std::vector<SectionEntry> entries;
+            uint64_t offset = alignUp(sizeof(FileHeader) + data_.size() * sizeof(SectionEntry));
+            for (uint64_t i = 0; i < data_.size(); ++i) {
+                SectionEntry entry;
+                entry.type_ = static_cast<uint32_t>(types_[i]);
+                entry.offset_ = offset;
+                entry.size_ = data_[i].size();
+                entry.checksum_ = checksum(data_[i].data(), data_[i].size());
+                entries.push_back(entry);
+                offset = alignUp(offset + data_[i].size());
+            }
+            header.sectionsCount_ = static_cast<uint32_t>(entries.size());
+            header.tableChecksum_ = tableChecksum(header, reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(SectionEntry));
+
+            std::ofstream out(file, std::ios::binary);
+            VERIFY(out, "Failed to open file " << file);
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(SectionEntry));
+
+            const char padding[SectionAlignment] = {};
+            uint64_t written = sizeof(FileHeader) + entries.size() * sizeof(SectionEntry);
+            for (uint64_t i = 0; i < data_.size(); ++i) {
+                out.write(padding, entries[i].offset_ - written);
+                out.write(data_[i].data(), data_[i].size());
+                written = entries[i].offset_ + data_[i].size();
+            }
+            VERIFY(out, "Failed to write file " << file);
+        }
+
+    private:
+        std::vector<SectionType> types_;
+        std::vector<std::string> data_;
+    };
+
+    class ModelFile {
+    public:
+        ModelFile(const std::string& path, bool verifyChecksums)
+            : file_(std::make_shared<MappedFile>(path)) {
+            VERIFY(file_->size() >= static_cast<int64_t>(sizeof(FileHeader)), "Not a binary model: " << path);
+            std::memcpy(&header_, file_->data(), sizeof(header_));
+            VERIFY(std::memcmp(header_.magic_, ModelMagic, sizeof(ModelMagic)) == 0, "Not a binary model: " << path);
+            VERIFY(header_.version_ == ModelFormatVersion,
+                   "Unsupported binary model version " << header_.version_ << " in " << path);
+
+            const uint64_t tableSize = header_.sectionsCount_ * sizeof(SectionEntry);
+            VERIFY(sizeof(FileHeader) + tableSize <= static_cast<uint64_t>(file_->size()), "Truncated binary model: " << path);
+            const char* table = file_->data() + sizeof(FileHeader);
+            VERIFY(tableChecksum(header_, table, tableSize) == header_.tableChecksum_,
+                   "Corrupted header or section table in " << path);
+
+            sections_.resize(header_.sectionsCount_);
+            std::memcpy(sections_.data(), table, tableSize);
+            for (const auto& entry : sections_) {
+                VERIFY(entry.offset_ % SectionAlignment == 0 && entry.offset_ + entry.size_ <= static_cast<uint64_t>(file_->size()),
+                       "Corrupted section " << entry.type_ << " in " << path);
+                VERIFY(!verifyChecksums || checksum(file_->data() + entry.offset_, entry.size_) == entry.checksum_,
+                       "Checksum mismatch in section " << entry.type_ << " of " << path);
+            }
+        }
+
+        const FileHeader& header() const {
+            return header_;
+        }
+
+        const SectionEntry* find(SectionType type) const {
+            for (const auto& entry : sections_) {
+                if (entry.type_ == static_cast<uint32_t>(type)) {
+                    return &entry;
+                }
+            }
+            return nullptr;
+        }
+
+        template <class T>
+        const T* array(SectionType type, int64_t count) const {
+            auto entry = find(type);
+            VERIFY(entry, "Section " << static_cast<uint32_t>(type) << " is missing in " << file_->path());
+            VERIFY(entry->size_ == count * sizeof(T), "Section " << static_cast<uint32_t>(type) << " has size " << entry->size_
+                                                                 << ", expected " << count * sizeof(T) << " in " << file_->path());
+            return reinterpret_cast<const T*>(file_->data() + entry->offset_);
+        }
+
+        //offsets of trees or leaves: count + 1 non-decreasing values starting from zero
+        const int64_t* offsets(SectionType type, int64_t count) const {
+            const int64_t* result = array<int64_t>(type, count + 1);
+            VERIFY(result[0] == 0, "Corrupted offsets section " << static_cast<uint32_t>(type) << " in " << file_->path());
+            for (int64_t i = 0; i < count; ++i) {
+                VERIFY(result[i] <= result[i + 1], "Corrupted offsets section " << static_cast<uint32_t>(type) << " in " << file_->path());
+            }
+            return result;
+        }
+
+        GridPtr grid() const {
+            auto entry = find(SectionType::Grid);
+            if (!entry) {
+                return nullptr;
+            }
+            std::istringstream in(std::string(file_->data() + entry->offset_, entry->size_));
+            GridPtr grid = buildGridFromStream(in);
+            VERIFY(grid, "Corrupted grid in " << file_->path());
+            return grid;
+        }
+
+        //vec over mapped memory, mapping lives while vec does
+        Vec floatView(const float* data, int64_t count) const {
+            auto file = file_;
+            return Vec(torch::from_blob(const_cast<float*>(data), {count}, [file](void*) {},
+                                        torch::TensorOptions().dtype(torch::kFloat32).device(torch::kCPU)));
+        }
+
+        const std::string& path() const {
+            return file_->path();
+        }
+
+    private:
+        MappedFilePtr file_;
+        FileHeader header_;
+        std::vector<SectionEntry> sections_;
+    };
+
+    void addObliviousTrees(const std::vector<ModelPtr>& trees, const GridPtr& grid, SectionsWriter* writer) {
+        std::vector<int64_t> splitOffsets = {0};
+        std::vector<int32_t> splitFeatures;
+        std::vector<int32_t> splitConditions;
+        std::vector<int64_t> leafOffsets = {0};
+        std::vector<float> leafValues;
+
+        for (const auto& model : trees) {
+            auto tree = std::dynamic_pointer_cast<ObliviousTree>(model);
+            VERIFY(tree, "Trees of ensemble should be of one type");
+            VERIFY(tree->gridPtr() == grid, "Oblivious trees of ensemble should share one grid");
+            for (const auto& split : tree->splits()) {
+                splitFeatures.push_back(split.featureId_);
+                splitConditions.push_back(split.conditionId_);
+            }
+            splitOffsets.push_back(splitFeatures.size());
+
+            auto leaves = tree->leaves().arrayRef();
+            leafValues.insert(leafValues.end(), leaves.begin(), leaves.end());
+            leafOffsets.push_back(leafValues.size());
+        }
+
+        writer->add(SectionType::TreeSplitOffsets, splitOffsets);
+        writer->add(SectionType::SplitFeatures, splitFeatures);
+        writer->add(SectionType::SplitConditions, splitConditions);
+        writer->add(SectionType::TreeLeafOffsets, leafOffsets);
+        writer->add(SectionType::LeafValues, leafValues);
+    }
+
+    void addLinearTrees(const std::vector<ModelPtr>& trees, SectionsWriter* writer) {
+        std::vector<int64_t> splitOffsets = {0};
+        std::vector<int32_t> splitFeatures;
+        std::vector<double> splitBorders;
+        std::vector<int64_t> leafOffsets = {0};
+        std::vector<int64_t> weightOffsets = {0};
+        std::vector<int32_t> weightFeatures;
+        std::vector<double> weights;
+        std::vector<double> sampleWeights;
+        std::vector<double> scales;
+
+        for (const auto& model : trees) {
+            auto tree = std::dynamic_pointer_cast<LinearObliviousTree>(model);
+            VERIFY(tree, "Trees of ensemble should be of one type");
+            for (const auto& split : tree->splits_) {
+                splitFeatures.push_back(std::get<0>(split));
+                splitBorders.push_back(std::get<1>(split));
+            }
+            splitOffsets.push_back(splitFeatures.size());
+
+            for (const auto& leaf : tree->leaves_) {
+                VERIFY(leaf.usedFeaturesInOrder_.size() == static_cast<uint64_t>(leaf.w_.size()), "Leaf features don't match weights");
+                weightFeatures.insert(weightFeatures.end(), leaf.usedFeaturesInOrder_.begin(), leaf.usedFeaturesInOrder_.end());
+                weights.insert(weights.end(), leaf.w_.data(), leaf.w_.data() + leaf.w_.size());
+                weightOffsets.push_back(weights.size());
+                sampleWeights.push_back(leaf.weight_);
+            }
+            leafOffsets.push_back(sampleWeights.size());
+            scales.push_back(tree->scale_);
+        }
+
+        writer->add(SectionType::TreeSplitOffsets, splitOffsets);
+        writer->add(SectionType::SplitFeatures, splitFeatures);
+        writer->add(SectionType::SplitBorders, splitBorders);
+        writer->add(SectionType::TreeLeafOffsets, leafOffsets);
+        writer->add(SectionType::LeafWeightOffsets, weightOffsets);
+        writer->add(SectionType::WeightFeatures, weightFeatures);
+        writer->add(SectionType::Weights, weights);
+        writer->add(SectionType::LeafSampleWeights, sampleWeights);
+        writer->add(SectionType::TreeScales, scales);
+    }
+
+    std::vector<ModelPtr> loadObliviousTrees(const ModelFile& file, const GridPtr& grid) {
+        VERIFY(grid, "Oblivious trees without grid in " << file.path());
+        const int64_t treesCount = file.header().treesCount_;
+        const int64_t* splitOffsets = file.offsets(SectionType::TreeSplitOffsets, treesCount);
+        const int64_t* leafOffsets = file.offsets(SectionType::TreeLeafOffsets, treesCount);
+        const int32_t* splitFeatures = file.array<int32_t>(SectionType::SplitFeatures, splitOffsets[treesCount]);
+        const int32_t* splitConditions = file.array<int32_t>(SectionType::SplitConditions, splitOffsets[treesCount]);
+        const float* leafValues = file.array<float>(SectionType::LeafValues, leafOffsets[treesCount]);
+
+        std::vector<ModelPtr> models;
+        for (int64_t t = 0; t < treesCount; ++t) {
+            std::vector<BinaryFeature> splits;
+            for (int64_t s = splitOffsets[t]; s < splitOffsets[t + 1]; ++s) {
+                VERIFY(splitFeatures[s] >= 0 && splitFeatures[s] < grid->nzFeaturesCount()
+                       && splitConditions[s] >= 0 && splitConditions[s] < grid->conditionsCount(splitFeatures[s]),
+                       "Split doesn't match grid in " << file.path());
+                splits.emplace_back(splitFeatures[s], splitConditions[s]);
+            }
+            const int64_t leavesCount = leafOffsets[t + 1] - leafOffsets[t];
+            VERIFY(leavesCount == (1LL << splits.size()), "Wrong leaves count of tree " << t << " in " << file.path());
+            models.push_back(std::make_shared<ObliviousTree>(grid, std::move(splits),
+                                                             file.floatView(leafValues + leafOffsets[t], leavesCount)));
+        }
+        return models;
+    }
+
+    std::vector<ModelPtr> loadLinearTrees(const ModelFile& file, const GridPtr& grid) {
+        const int64_t treesCount = file.header().treesCount_;
+        const int64_t* splitOffsets = file.offsets(SectionType::TreeSplitOffsets, treesCount);
+        const int64_t* leafOffsets = file.offsets(SectionType::TreeLeafOffsets, treesCount);
+        const int64_t leavesCount = leafOffsets[treesCount];
+        const int64_t* weightOffsets = file.offsets(SectionType::LeafWeightOffsets, leavesCount);
+        const int32_t* splitFeatures = file.array<int32_t>(SectionType::SplitFeatures, splitOffsets[treesCount]);
+        const double* splitBorders = file.array<double>(SectionType::SplitBorders, splitOffsets[treesCount]);
+        const int32_t* weightFeatures = file.array<int32_t>(SectionType::WeightFeatures, weightOffsets[leavesCount]);
+        const double* weights = file.array<double>(SectionType::Weights, weightOffsets[leavesCount]);
+        const double* sampleWeights = file.array<double>(SectionType::LeafSampleWeights, leavesCount);
+        const double* scales = file.array<double>(SectionType::TreeScales, treesCount);
+
+        std::vector<ModelPtr> models;
+        for (int64_t t = 0; t < treesCount; ++t) {
+            auto tree = grid ? std::make_shared<LinearObliviousTree>(grid)
+                             : std::make_shared<LinearObliviousTree>(file.header().xdim_, 1);
+            tree->scale_ = scales[t];
+            for (int64_t s = splitOffsets[t]; s < splitOffsets[t + 1]; ++s) {
+                tree->splits_.emplace_back(splitFeatures[s], splitBorders[s]);
+            }
+            VERIFY(leafOffsets[t + 1] - leafOffsets[t] == (1LL << tree->splits_.size()),
+                   "Wrong leaves count of tree " << t << " in " << file.path());
+
+            tree->leaves_.reserve(leafOffsets[t + 1] - leafOffsets[t]);
+            for (int64_t leaf = leafOffsets[t]; leaf < leafOffsets[t + 1]; ++leaf) {
+                const int64_t first = weightOffsets[leaf];
+                const int64_t size = weightOffsets[leaf + 1] - first;
+                std::vector<int32_t> features(weightFeatures + first, weightFeatures + first + size);
+                Eigen::MatrixXd w = Eigen::Map<const Eigen::MatrixXd>(weights + first, size, 1);
+                tree->leaves_.emplace_back(std::move(features), std::move(w), sampleWeights[leaf]);
+            }
+            models.push_back(tree);
+        }
+        return models;
+    }
+}
+
+void saveModelBinary(const ModelPtr& model, const std::string& file) {
+    FileHeader header;
+    std::memcpy(header.magic_, ModelMagic, sizeof(ModelMagic));
+    header.xdim_ = model->xdim();
+
+    std::vector<ModelPtr> trees;
+    if (auto ensemble = std::dynamic_pointer_cast<Ensemble>(model)) {
+        header.modelKind_ = static_cast<uint32_t>(ModelKind::Ensemble);
+        header.scale_ = ensemble->scale();
+        ensemble->visitModels([&](const ModelPtr& tree) {
+            trees.push_back(tree);
+        });
+    } else if (std::dynamic_pointer_cast<ObliviousTree>(model)) {
+        header.modelKind_ = static_cast<uint32_t>(ModelKind::ObliviousTree);
+        trees.push_back(model);
+    } else if (std::dynamic_pointer_cast<LinearObliviousTree>(model)) {
+        header.modelKind_ = static_cast<uint32_t>(ModelKind::LinearObliviousTree);
+        trees.push_back(model);
+    } else {
+        VERIFY(false, "Binary format supports ensembles of oblivious or linear oblivious trees only");
+    }
+    VERIFY(!trees.empty(), "Can't save empty ensemble");
+    header.treesCount_ = static_cast<int64_t>(trees.size());
+
+    SectionsWriter writer;
+    GridPtr grid;
+    if (auto boModel = std::dynamic_pointer_cast<BinOptimizedModel>(trees.front())) {
+        grid = boModel->gridPtr();
+    }
+    std::string gridBytes;
+    if (grid) {
+        std::ostringstream gridOut;
+        grid->serialize(gridOut);
+        gridBytes = gridOut.str();
+        writer.add(SectionType::Grid, gridBytes.data(), gridBytes.size());
+    }
+
+    if (std::dynamic_pointer_cast<ObliviousTree>(trees.front())) {
+        header.treesKind_ = static_cast<uint32_t>(TreesKind::Oblivious);
+        addObliviousTrees(trees, grid, &writer);
+    } else {
+        header.treesKind_ = static_cast<uint32_t>(TreesKind::Linear);
+        addLinearTrees(trees, &writer);
+    }
+    writer.write(header, file);
+}
+
+bool isModelBinary(const std::string& file) {
+    std::ifstream in(file, std::ios::binary);
+    char magic[sizeof(ModelMagic)];
+    return in.read(magic, sizeof(magic)) && std::memcmp(magic, ModelMagic, sizeof(ModelMagic)) == 0;
+}
+
+ModelPtr loadModelBinary(const std::string& file, bool verifyChecksums) {
+    ModelFile modelFile(file, verifyChecksums);
+    const auto& header = modelFile.header();
+    VERIFY(header.treesCount_ > 0, "No trees in " << file);
+
+    GridPtr grid = modelFile.grid();
+    std::vector<ModelPtr> models;
+    if (header.treesKind_ == static_cast<uint32_t>(TreesKind::Oblivious)) {
+        models = loadObliviousTrees(modelFile, grid);
+    } else if (header.treesKind_ == static_cast<uint32_t>(TreesKind::Linear)) {
+        models = loadLinearTrees(modelFile, grid);
+    } else {
+        VERIFY(false, "Unknown trees type " << header.treesKind_ << " in " << file);
+    }
+
+    if (header.modelKind_ == static_cast<uint32_t>(ModelKind::Ensemble)) {
+        return std::make_shared<Ensemble>(std::move(models), header.scale_);
+    }
+    VERIFY(models.size() == 1, "Single tree model has " << models.size() << " trees in " << file);
+    return models.front();
+}
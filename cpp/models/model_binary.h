@@ -0,0 +1,21 @@
+#pragma once
+
+#include "model.h"
+
+#include <string>
+
+/*
+ * Binary model file: header, section table with checksums and 64-byte aligned sections.
+ * Ensemble (or single tree) of oblivious trees or of linear oblivious trees is stored as flat arrays:
+ * offsets of trees in splits and leaves, splits, leaves and, for linear trees, offsets of leaves in weights,
+ * weight features and weights. Grid is stored as its serialized bytes.
+ * Loading maps the file and builds models straight from mapped arrays, leaves of oblivious trees are views of mapped memory
+ */
+
+//model is Ensemble, ObliviousTree or LinearObliviousTree; trees of ensemble should be of one type
+void saveModelBinary(const ModelPtr& model, const std::string& file);
+
+bool isModelBinary(const std::string& file);
+
+//checksums of sections are verified on load unless verifyChecksums is false (then pages are touched lazily)
+ModelPtr loadModelBinary(const std::string& file, bool verifyChecksums = true);
@@ -20,7 +20,6 @@ void ObliviousTree::applyBinarizedRow(const Buffer<uint8_t>& x, Vec to) const {
 void ObliviousTree::applyToBds(const BinarizedDataSet& ds, Mx to, ApplyType type) const {
     assert(to.ydim() == ds.samplesCount());
     auto bins = Buffer<uint32_t>::create(ds.samplesCount());
-    bins.fill(0);
     auto binsArray = bins.arrayRef();
 
     for (uint64_t i = 0; i < splits_.size(); ++i) {
@@ -55,18 +54,39 @@ void ObliviousTree::appendTo(const Vec& x, Vec to) const {
     assert(to.device().deviceType() == ComputeDeviceType::Cpu);
     assert(to.dim() == 1);
 
+    applyToRows(x.arrayRef().data(), 1, to.arrayRef(), ApplyType::Append);
+}
 
-    int32_t bin = 0;
-    for (uint64_t f = 0; f < splits_.size(); ++f) {
-        const auto binFeature = splits_[f];
-        const auto border = grid_->condition(binFeature.featureId_, binFeature.conditionId_);
-        const auto val = x.get(grid_->origFeatureIndex(binFeature.featureId_));
-        if (val > border) {
-            bin |= 1 << f;
+void ObliviousTree::applyToRows(const float* rows, int64_t rowsCount, VecRef<float> dst, ApplyType type, double scale) const {
+    assert(static_cast<int64_t>(dst.size()) >= rowsCount);
+    const int64_t rowSize = xdim();
+    const int64_t depth = splitBorders_.size();
+    const int32_t* features = splitOrigFeatures_.data();
+    const float* borders = splitBorders_.data();
+    const float* leaves = leaves_.arrayRef().data();
+    const float leafScale = static_cast<float>(scale);
+
+    for (int64_t i = 0; i < rowsCount; ++i) {
+        const float* row = rows + i * rowSize;
+        uint32_t bin = 0;
+        for (int64_t f = 0; f < depth; ++f) {
+            bin |= static_cast<uint32_t>(row[features[f]] > borders[f]) << f;
+        }
+        if (type == ApplyType::Set) {
+            dst[i] = leafScale * leaves[bin];
+        } else {
+            dst[i] += leafScale * leaves[bin];
         }
     }
+}
 
-    to += leaves_.get(bin);
+void ObliviousTree::buildRowSplits() {
+    splitOrigFeatures_.clear();
+    splitBorders_.clear();
+    for (const auto& binFeature : splits_) {
+        splitOrigFeatures_.push_back(grid_->origFeatureIndex(binFeature.featureId_));
+        splitBorders_.push_back(grid_->borders(binFeature.featureId_)[binFeature.conditionId_]);
+    }
 }
 
 
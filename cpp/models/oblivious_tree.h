@@ -17,6 +17,7 @@ public:
       , grid_(std::move(grid))
       , splits_(std::move(binFeatures))
       , leaves_(leaves) {
+            buildRowSplits();
             bitVec.reserve(leaves_.size());
             auto leavesPtr = leaves_.arrayRef();
             for (uint32_t b = 0; b < leaves_.size(); ++b) {
@@ -37,6 +38,7 @@ public:
     , grid_(other.grid_)
     , splits_(other.splits_)
     , leaves_(scale == 1.0  ? other.leaves_ : VecFactory::clone(other.leaves_) * scale) {
+        buildRowSplits();
         bitVec.reserve(leaves_.size());
         auto leavesPtr = leaves_.arrayRef();
 
@@ -66,17 +68,32 @@ public:
 
     void applyBinarizedRow(const Buffer<uint8_t>& x, Vec to) const;
 
+    void applyToRows(const float* rows, int64_t rowsCount, VecRef<float> dst, ApplyType type = ApplyType::Set, double scale = 1.0) const override;
+
     double value(const Vec& x) override;
 
+    const std::vector<BinaryFeature>& splits() const {
+        return splits_;
+    }
+
+    const Vec& leaves() const {
+        return leaves_;
+    }
+
     void grad(const Vec& x, Vec to) override ;
 
 private:
     uint32_t bits(uint32_t i);
 
+    void buildRowSplits();
+
 
 private:
     GridPtr grid_;
     std::vector<BinaryFeature> splits_;
+    //splits in terms of raw rows: original feature index and border
+    std::vector<int32_t> splitOrigFeatures_;
+    std::vector<float> splitBorders_;
     Vec leaves_;
     std::vector<double> bitVec;
 };
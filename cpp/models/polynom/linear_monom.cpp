@@ -2,6 +2,8 @@
 
 #include "polynom.h"
 
+#include <util/parallel_executor.h>
+
 LinearMonom::LinearMonom(PolynomStructure structure, const std::vector<double> &values, int origFId)
         : Monom(std::move(structure), values, origFId) {
 }
@@ -78,16 +80,24 @@ std::vector<std::tuple<TSymmetricTree, int>> LinearToSymmetricTrees(const Linear
     return res;
 }
 
-Polynom LinearTreesToPolynom(const Ensemble& ensemble) {
-    PolynomBuilder builder;
-
+Polynom LinearTreesToPolynom(const Ensemble& ensemble, const PolynomPruning& pruning) {
+    std::vector<std::shared_ptr<LinearObliviousTree>> models;
     ensemble.visitModels([&](ModelPtr model) {
-        auto lModel = std::dynamic_pointer_cast<LinearObliviousTree>(model);
-        auto symmetricTrees = LinearToSymmetricTrees(*lModel, ensemble.scale());
-        for (const auto& treePair : symmetricTrees) {
-            builder.AddTree(std::get<0>(treePair), std::get<1>(treePair));
-        }
+        models.push_back(std::dynamic_pointer_cast<LinearObliviousTree>(model));
+    });
+
+    std::vector<std::vector<std::tuple<TSymmetricTree, int>>> symmetricTrees(models.size());
+    parallelFor(0, models.size(), [&](int64_t i) {
+        symmetricTrees[i] = LinearToSymmetricTrees(*models[i], ensemble.scale());
     });
 
-    return Polynom(Monom::MonomType::LinearMonom, builder.Build());
+    PolynomBuilder builder(pruning);
+    for (auto& trees : symmetricTrees) {
+        for (auto& treePair : trees) {
+            builder.AddTree(std::move(std::get<0>(treePair)), std::get<1>(treePair));
+        }
+        trees.clear();
+    }
+
+    return builder.BuildPolynom(Monom::MonomType::LinearMonom);
 }
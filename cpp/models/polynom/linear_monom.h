@@ -21,4 +21,4 @@ public:
 };
 
 std::vector<std::tuple<TSymmetricTree, int>> LinearToSymmetricTrees(const LinearObliviousTree& loTree, double scale);
-Polynom LinearTreesToPolynom(const Ensemble& ensemble);
+Polynom LinearTreesToPolynom(const Ensemble& ensemble, const PolynomPruning& pruning = PolynomPruning());
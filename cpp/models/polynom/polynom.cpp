@@ -1,112 +1,210 @@
 #include "polynom.h"
 #include <array>
 #include <cmath>
-#include <map>
+#include <cstring>
 #include <util/exception.h>
 #include <util/parallel_executor.h>
 #include <iostream>
 
-struct PathBit {
-    int Bits = 0;
-    int Sign = 1;
-};
+namespace {
 
-inline std::vector<PathBit> LeafToPolynoms(const int path, int maxDepth) {
-    std::vector<PathBit> pathBits = {{}};
-    for (int depth = 0; depth <  maxDepth; ++depth) {
-        const int mask = 1 << depth;
-        const bool isOne = path & mask;
+    //monoms of one tree, grouped by shard: monoms of shard are [ShardOffsets[shard], ShardOffsets[shard + 1])
+    template <class Key>
+    struct TreeMonoms {
+        std::vector<Key> Keys;
+        std::vector<double> Weights;
+        std::vector<double> Values;
+        std::vector<int32_t> ShardOffsets;
+    };
 
-        if (isOne) {
-            for (auto& bit : pathBits) {
-                bit.Bits |= 1 << depth;
-            }
-        } else {
-            uint64_t currentPaths = pathBits.size();
-            for (uint64_t i = 0; i < currentPaths; ++i) {
-                auto bit = pathBits[i];
-                bit.Bits |= 1 << depth;
-                bit.Sign *= -1;
-                pathBits.push_back(bit);
+    //sum of leaves of tree as monoms: leaf of path p is Prod_{d in p} x_d Prod_{d not in p} (1 - x_d), so value of
+    //monom T is sum over p in T of (-1)^{|T \ p|} leaf_p (Moebius transform), its weight is sum of weights of leaves p, containing T
+    void ExpandTree(const TSymmetricTree& tree, std::vector<double>* values, std::vector<double>* weights) {
+        const int maxDepth = static_cast<int>(tree.Conditions.size());
+        const int leaves = 1 << maxDepth;
+        const int outputDim = tree.OutputDim();
+
+        values->assign(tree.Leaves.begin(), tree.Leaves.begin() + leaves * outputDim);
+        weights->assign(leaves, 0.0);
+        for (int i = 0; i < leaves && i < static_cast<int>(tree.Weights.size()); ++i) {
+            (*weights)[i] = tree.Weights[i];
+        }
+
+        for (int depth = 0; depth < maxDepth; ++depth) {
+            const int mask = 1 << depth;
+            for (int i = 0; i < leaves; ++i) {
+                if (i & mask) {
+                    for (int dim = 0; dim < outputDim; ++dim) {
+                        (*values)[i * outputDim + dim] -= (*values)[(i ^ mask) * outputDim + dim];
+                    }
+                } else {
+                    (*weights)[i] += (*weights)[i | mask];
+                }
             }
         }
     }
-    return pathBits;
+
+    uint64_t PackSplit(int feature, float condition) {
+        uint32_t conditionBits = 0;
+        std::memcpy(&conditionBits, &condition, sizeof(conditionBits));
+        return (static_cast<uint64_t>(static_cast<uint32_t>(feature)) << 32u) | conditionBits;
+    }
+
 }
 
-template <class Vec>
-inline void SortUnique(Vec& vec) {
-    std::sort(vec.begin(), vec.end());
-    vec.erase(std::unique(vec.begin(), vec.end()), vec.end());
+PolynomStructure PolynomBuilder::MonomKey::Structure() const {
+    PolynomStructure structure;
+    for (int i = 0; i < Depth; ++i) {
+        BinarySplit split;
+        split.Feature = static_cast<int32_t>(static_cast<uint32_t>(Splits[i] >> 32u));
+        const uint32_t conditionBits = static_cast<uint32_t>(Splits[i]);
+        std::memcpy(&split.Condition, &conditionBits, sizeof(conditionBits));
+        structure.Splits.push_back(split);
+    }
+    return structure;
 }
 
-void PolynomBuilder::AddTree(const TSymmetricTree& tree, int origFId)  {
+void PolynomBuilder::AddTree(TSymmetricTree tree, int origFId)  {
     const int maxDepth = static_cast<int>(tree.Conditions.size());
     if (maxDepth == 0) {
         return;
     }
-    const int leaves = 1 << maxDepth;
+    VERIFY(maxDepth <= MaxDepth, "Tree depth " << maxDepth << " is greater than max supported " << MaxDepth);
+    Trees_.emplace_back(std::move(tree), origFId);
+    if (static_cast<int>(Trees_.size()) >= TreesPerChunk) {
+        Flush();
+    }
+}
+
+void PolynomBuilder::Flush() {
+    if (Trees_.empty()) {
+        return;
+    }
+    const int64_t treesCount = Trees_.size();
+    std::vector<TreeMonoms<MonomKey>> treeMonoms(treesCount);
 
-    std::vector<double> weights(leaves);
-    std::vector<double> values(leaves * tree.OutputDim());
+    parallelFor(0, treesCount, [&](int64_t treeIdx) {
+        const auto& tree = std::get<0>(Trees_[treeIdx]);
+        const int origFId = std::get<1>(Trees_[treeIdx]);
+        const int maxDepth = static_cast<int>(tree.Conditions.size());
+        const int leaves = 1 << maxDepth;
+        const int outputDim = tree.OutputDim();
 
-    const int outputDim = tree.OutputDim();
-    for (int path = 0; path < leaves; ++path) {
-        auto polynoms = LeafToPolynoms(path, maxDepth);
+        std::vector<double> values;
+        std::vector<double> weights;
+        ExpandTree(tree, &values, &weights);
 
-        for (const auto& polynom : polynoms) {
-            int idx = polynom.Bits;
-            for (int dim = 0; dim < outputDim; ++dim) {
-                values[idx * outputDim + dim] += polynom.Sign * tree.Leaves[path * outputDim + dim];
-            }
-        }
-    }
-    for (int path = 0; path < leaves; ++path) {
+        std::vector<MonomKey> keys(leaves);
+        std::vector<int32_t> shards(leaves);
+        std::vector<int32_t> offsets(ShardsCount + 1);
+        std::array<BinarySplit, MaxDepth> splits;
         for (int i = 0; i < leaves; ++i) {
-            if ((i & path) == path) {
-                weights[path] += tree.Weights[i];
+            //repeated feature in monom: x > c1 and x > c2 is x > max(c1, c2)
+            int depth = 0;
+            for (int d = 0; d < maxDepth; ++d) {
+                if (i & (1 << d)) {
+                    splits[depth].Feature = tree.Features[d];
+                    splits[depth].Condition = tree.Conditions[d];
+                    ++depth;
+                }
+            }
+            std::sort(splits.begin(), splits.begin() + depth);
+            auto& key = keys[i];
+            key.OrigFId = origFId;
+            for (int k = 0; k < depth; ++k) {
+                if (k + 1 < depth && splits[k + 1].Feature == splits[k].Feature) {
+                    continue;
+                }
+                key.Splits[key.Depth++] = PackSplit(splits[k].Feature, splits[k].Condition);
             }
+            shards[i] = static_cast<int32_t>(key.Hash() >> 58u);
+            ++offsets[shards[i] + 1];
         }
-    }
-
+        static_assert(ShardsCount == 64, "shard is top 6 bits of hash");
 
-    for (int i = 0; i < leaves; ++i) {
-        // co c1 (1 - c2)
-        //if 0 points in c0 c1 c2 => -c0c1c2 with weight 0, but valuee will not be zero
-//        if (weights[i] == 0) {
-//            continue;
-//        }
-        PolynomStructure polynomStructure;
-        std::map<int, float> polynom;
+        for (int shard = 0; shard < ShardsCount; ++shard) {
+            offsets[shard + 1] += offsets[shard];
+        }
+        auto& result = treeMonoms[treeIdx];
+        result.ShardOffsets = offsets;
+        result.Keys.resize(leaves);
+        result.Weights.resize(leaves);
+        result.Values.resize(leaves * outputDim);
+        for (int i = 0; i < leaves; ++i) {
+            const int pos = offsets[shards[i]]++;
+            result.Keys[pos] = keys[i];
+            result.Weights[pos] = weights[i];
+            std::copy(values.begin() + i * outputDim, values.begin() + (i + 1) * outputDim, result.Values.begin() + pos * outputDim);
+        }
+    });
 
-        for (int depth = 0; depth < maxDepth; ++depth) {
-            int mask = 1 << depth;
-            if (i & mask) {
-                BinarySplit split;
-                split.Feature = tree.Features[depth];
-                split.Condition = tree.Conditions[depth];
-                if (polynom.count(split.Feature)) {
-                    polynom[split.Feature] = std::max<float>(split.Condition, polynom[split.Feature]);
-                } else {
-                    polynom[split.Feature] = split.Condition;
+    parallelFor(0, ShardsCount, [&](int64_t shard) {
+        auto& dstShard = Shards_[shard];
+        for (int64_t treeIdx = 0; treeIdx < treesCount; ++treeIdx) {
+            const auto& monoms = treeMonoms[treeIdx];
+            const int outputDim = std::get<0>(Trees_[treeIdx]).OutputDim();
+            for (int32_t i = monoms.ShardOffsets[shard]; i < monoms.ShardOffsets[shard + 1]; ++i) {
+                // co c1 (1 - c2)
+                //if 0 points in c0 c1 c2 => -c0c1c2 with weight 0, but value will not be zero
+                auto& dst = dstShard[monoms.Keys[i]];
+                if (dst.Weight < 0) {
+                    dst.Weight = monoms.Weights[i];
+                }
+                dst.Value.resize(outputDim);
+                for (int dim = 0; dim < outputDim; ++dim) {
+                    dst.Value[dim] += monoms.Values[i * outputDim + dim];
                 }
             }
         }
-        for (const auto& [split, condition] : polynom) {
-            polynomStructure.Splits.push_back({split, condition});
+    });
+
+    Trees_.clear();
+}
+
+bool PolynomBuilder::IsPruned(const TStat& stat) const {
+    if (stat.Weight < Pruning_.MinWeight) {
+        return true;
+    }
+    if (Pruning_.MinAbsValue > 0) {
+        for (double value : stat.Value) {
+            if (std::abs(value) >= Pruning_.MinAbsValue) {
+                return false;
+            }
         }
-        SortUnique(polynomStructure.Splits);
-        auto& dst = EnsemblePolynoms[std::make_tuple(polynomStructure, origFId)];
-        if (dst.Weight < 0) {
-            dst.Weight = weights[i];
-        } else {
-//            VERIFY(dst.Weight == weights[i], "Weight for fixed path should be equal for all polynoms");
+        return true;
+    }
+    return false;
+}
+
+std::unordered_map<std::tuple<PolynomStructure, int>, TStat> PolynomBuilder::Build() {
+    Flush();
+    std::unordered_map<std::tuple<PolynomStructure, int>, TStat> result;
+    for (const auto& shard : Shards_) {
+        for (const auto& [key, stat] : shard) {
+            if (!IsPruned(stat)) {
+                result.emplace(std::make_tuple(key.Structure(), key.OrigFId), stat);
+            }
         }
-        dst.Value.resize(tree.OutputDim());
-        for (uint32_t dim = 0; dim < tree.OutputDim(); ++dim) {
-            dst.Value[dim] += values[i * tree.OutputDim() + dim];
+    }
+    return result;
+}
+
+Polynom PolynomBuilder::BuildPolynom(Monom::MonomType monomType) {
+    Flush();
+    std::vector<std::vector<MonomPtr>> shardMonoms(ShardsCount);
+    parallelFor(0, ShardsCount, [&](int64_t shard) {
+        for (const auto& [key, stat] : Shards_[shard]) {
+            if (!IsPruned(stat)) {
+                shardMonoms[shard].emplace_back(Monom::createMonom(monomType, key.Structure(), stat.Value, key.OrigFId));
+            }
         }
+    });
+
+    Polynom polynom;
+    for (auto& monoms : shardMonoms) {
+        polynom.Ensemble_.insert(polynom.Ensemble_.end(), monoms.begin(), monoms.end());
     }
+    return polynom;
 }
 
 Monom::MonomType Polynom::getMonomType() const {
@@ -3,6 +3,8 @@
 #include "monom.h"
 
 #include <catboost_wrapper.h>
+#include <algorithm>
+#include <array>
 #include <memory>
 #include <unordered_map>
 #include <util/array_ref.h>
@@ -16,10 +18,30 @@ struct TStat {
     double Weight = -1;
 };
 
+//monoms with weight below MinWeight or with all |values| below MinAbsValue are dropped on build; zeros keep all monoms.
+//linear trees don't keep leaf weights, so MinWeight is useful only for catboost ensembles
+struct PolynomPruning {
+    double MinWeight = 0;
+    double MinAbsValue = 0;
+};
+
+struct Polynom;
+
 // sum v * Prod [x _i > c_i]
+// Trees are kept by AddTree and expanded into monoms on Build in parallel. Monom keys are fixed width (origFId and
+// sorted splits packed into words), monoms are spread over hash shards and shards are merged in parallel.
+// Trees are merged into every shard in order of adding, so result doesn't depend on number of threads
 class PolynomBuilder {
 public:
-    void AddTree(const TSymmetricTree& tree, int origFId = -1);
+    static constexpr int MaxDepth = 16;
+
+    explicit PolynomBuilder(PolynomPruning pruning = PolynomPruning())
+        : Pruning_(pruning)
+        , Shards_(ShardsCount) {
+
+    }
+
+    void AddTree(TSymmetricTree tree, int origFId = -1);
 
     PolynomBuilder& AddEnsemble(const TEnsemble& ensemble) {
         for (const auto& tree : ensemble.Trees) {
@@ -28,12 +50,49 @@ public:
         return *this;
     }
 
-    std::unordered_map<std::tuple<PolynomStructure, int>, TStat> Build() {
-        return EnsemblePolynoms;
-    }
+    std::unordered_map<std::tuple<PolynomStructure, int>, TStat> Build();
+
+    //same monoms as Build without intermediate map, monoms are created in parallel
+    Polynom BuildPolynom(Monom::MonomType monomType);
 
 private:
-    std::unordered_map<std::tuple<PolynomStructure, int>, TStat> EnsemblePolynoms;
+    static constexpr int ShardsCount = 64;
+    //trees expanded at once, bounds memory for expanded monoms
+    static constexpr int TreesPerChunk = 1024;
+
+    //split is Feature << 32 | bits of Condition, unused splits are zero
+    struct MonomKey {
+        int32_t OrigFId = -1;
+        int32_t Depth = 0;
+        std::array<uint64_t, MaxDepth> Splits = {};
+
+        bool operator==(const MonomKey& rhs) const {
+            return OrigFId == rhs.OrigFId && Depth == rhs.Depth
+                && std::equal(Splits.begin(), Splits.begin() + Depth, rhs.Splits.begin());
+        }
+
+        uint64_t Hash() const {
+            return CityHash64WithSeed(reinterpret_cast<const char*>(Splits.data()), Depth * sizeof(uint64_t), OrigFId + 123);
+        }
+
+        PolynomStructure Structure() const;
+    };
+
+    struct MonomKeyHash {
+        size_t operator()(const MonomKey& key) const {
+            return key.Hash();
+        }
+    };
+
+    using Shard = std::unordered_map<MonomKey, TStat, MonomKeyHash>;
+
+    bool IsPruned(const TStat& stat) const;
+
+    void Flush();
+
+    PolynomPruning Pruning_;
+    std::vector<std::tuple<TSymmetricTree, int>> Trees_;
+    std::vector<Shard> Shards_;
 };
 
 struct Polynom {
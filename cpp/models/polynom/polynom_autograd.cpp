@@ -4,41 +4,27 @@
 #include <util/array_ref.h>
 
 torch::autograd::variable_list PolynomBackward::apply(torch::autograd::variable_list&& inputs)  {
-  auto dims = samplesBatch_.sizes();
-  const auto batchSize = dims[0];
-  const auto featuresCount = dims[1];
-
-  torch::Tensor grads = torch::zeros({batchSize, featuresCount}, torch::kFloat32);
-  auto backGrads = inputs[0];
-
-  parallelFor(0, batchSize, [&](int64_t i) {
-    Vec sample = Vec(samplesBatch_[i]);
-    Vec backDers = Vec(backGrads[i]);
-    Vec featureDers = Vec(grads[i]);
-    polynom_->Backward(sample.arrayRef(), backDers.arrayRef(), featureDers.arrayRef());
-  });
-  return {grads};
+    auto result = polynom_->Backward(samplesBatch_, inputs[0], activations_.get());
+    activations_ = nullptr;
+    return {result};
 }
 
 
 torch::autograd::variable_list PolynomForward::apply(torch::autograd::variable_list&& inputs) {
     torch::autograd::Variable samplesBatch = inputs[0];
+    VERIFY(polynom_->OutDim_ > 0, "Error");
 
-    auto dims = samplesBatch.sizes();
-    const int batchSize = dims[0];
-    const int outDim = polynom_->OutDim();
-    VERIFY(outDim > 0, "Error");
-    torch::autograd::Variable result = torch::zeros({batchSize, outDim}, torch::kFloat32);
-
-    for (int i = 0; i < batchSize; ++i) {
-        Vec resultVec = Vec(result[i]);
-        VecTools::fill(0.0f, resultVec);
-        auto sample = Vec(samplesBatch[i]);
-        polynom_->Forward(sample.arrayRef(), resultVec.arrayRef());
+    //forward saves split factors and monom probabilities, if backward is expected and they fit the limit
+    PolynomActivationsPtr activations;
+    if (torch::autograd::GradMode::is_enabled() && samplesBatch.requires_grad()
+        && polynom_->ActivationsBytes(samplesBatch.size(0)) <= polynom_->SavedActivationsLimit) {
+        activations = std::make_shared<PolynomActivations>();
     }
+    torch::autograd::Variable result = polynom_->Forward(samplesBatch, activations.get());
 
     auto gradFunc = std::make_shared<PolynomBackward>(samplesBatch,
                                                       polynom_,
+                                                      std::move(activations),
                                                       torch::autograd::collect_next_edges(inputs));
 
     torch::autograd::create_gradient_edge(result,
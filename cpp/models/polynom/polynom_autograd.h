@@ -2,6 +2,7 @@
 
 #include "polynom.h"
 #include "polynom_gpu.h"
+#include "polynom_cpu.h"
 #include <torch/torch.h>
 #include <torch/csrc/autograd/function.h>
 #include <torch/csrc/autograd/edge.h>
@@ -13,12 +14,15 @@
 
 class PolynomBackward : public torch::autograd::Node {
 public:
+    //activations are released after first backward, later calls (with retained graph) recompute them
     PolynomBackward(torch::Tensor samplesBatch,
-                    PolynomPtr polynom,
+                    PolynomCpuPtr polynom,
+                    PolynomActivationsPtr activations,
                     torch::autograd::edge_list&& nextEdges)
             : torch::autograd::Node(std::move(nextEdges))
             , samplesBatch_(std::move(samplesBatch))
-            , polynom_(polynom) {
+            , polynom_(polynom)
+            , activations_(std::move(activations)) {
 
     }
 
@@ -26,21 +30,28 @@ public:
 
 private:
     torch::Tensor samplesBatch_;
-    PolynomPtr polynom_;
+    PolynomCpuPtr polynom_;
+    PolynomActivationsPtr activations_;
 };
 
 class PolynomForward : public torch::autograd::Node {
 public:
 
+    //flattens polynom on every call: prefer keeping PolynomCpu between batches
     PolynomForward(PolynomPtr polynom)
-        : polynom_(std::move(polynom)){
+        : polynom_(std::make_shared<PolynomCpu>(std::move(polynom))) {
+
+    }
+
+    explicit PolynomForward(PolynomCpuPtr polynom)
+        : polynom_(std::move(polynom)) {
 
     }
 
     torch::autograd::variable_list apply(torch::autograd::variable_list&& inputs) override;
 private:
 
-    PolynomPtr polynom_;
+    PolynomCpuPtr polynom_;
 };
 
 
@@ -0,0 +1,447 @@
+#include "polynom_cpu.h"
+
+#include <util/exception.h>
+#include <util/fast_exp.h>
+#include <util/parallel_executor.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace {
+    //rows of cached split factors used by monom block should stay in L2
+    constexpr int64_t SamplesBlockSize = 64;
+    //monoms are split between tasks only when sample blocks are not enough to load threads
+    constexpr int64_t MinMonomsPerBlock = 256;
+
+    //factors of splits for samples of block, split gets its row on first use by some monom of task:
+    //factors of split are factors_[slots_[split] * SamplesBlockSize + s]
+    struct SplitFactorsCache {
+        std::vector<int32_t> slots_;
+        std::vector<int32_t> cached_;
+        std::vector<float> factors_;
+        std::vector<float> args_;
+
+        explicit SplitFactorsCache(int64_t splitsCount)
+            : slots_(splitsCount, -1)
+            , args_(SamplesBlockSize) {
+
+        }
+
+        //rows are kept allocated between blocks
+        void reset() {
+            for (int32_t split : cached_) {
+                slots_[split] = -1;
+            }
+            cached_.clear();
+        }
+
+        //factors of block saved by forward
+        void restore(const PolynomActivations::Task& saved) {
+            reset();
+            cached_ = saved.Splits;
+            for (uint64_t slot = 0; slot < cached_.size(); ++slot) {
+                slots_[cached_[slot]] = static_cast<int32_t>(slot);
+            }
+            factors_.assign(saved.Factors.begin(), saved.Factors.end());
+        }
+
+        void save(PolynomActivations::Task* saved) const {
+            saved->Splits = cached_;
+            saved->Factors.assign(factors_.begin(), factors_.begin() + cached_.size() * SamplesBlockSize);
+        }
+
+        const float* row(int32_t split) const {
+            return factors_.data() + static_cast<int64_t>(slots_[split]) * SamplesBlockSize;
+        }
+    };
+
+    struct BlockScratch {
+        SplitFactorsCache splits_;
+        //sums of probs * derMultiplier over monoms with split, same slots as cached factors; zero between tasks
+        std::vector<float> splitGrads_;
+        std::vector<float> probs_;
+        std::vector<float> weights_;
+        std::vector<float> derMultipliers_;
+
+        explicit BlockScratch(int64_t splitsCount)
+            : splits_(splitsCount)
+            , probs_(SamplesBlockSize)
+            , weights_(SamplesBlockSize)
+            , derMultipliers_(SamplesBlockSize) {
+
+        }
+    };
+
+    struct BatchView {
+        const float* samples_ = nullptr;
+        int64_t featuresCount_ = 0;
+        int64_t first_ = 0;
+        int64_t size_ = 0;
+
+        float feature(int64_t s, int32_t f) const {
+            return samples_[(first_ + s) * featuresCount_ + f];
+        }
+    };
+
+    //sigmoid / exp factor / indicator of split for samples of block, computed once per block
+    void cacheSplitFactors(const PolynomCpu& polynom, float lambda, int32_t split, const BatchView& block, SplitFactorsCache* cache) {
+        if (cache->slots_[split] >= 0) {
+            return;
+        }
+        const int32_t slot = static_cast<int32_t>(cache->cached_.size());
+        cache->slots_[split] = slot;
+        cache->cached_.push_back(split);
+        if (cache->factors_.size() < static_cast<uint64_t>(slot + 1) * SamplesBlockSize) {
+            cache->factors_.resize(static_cast<uint64_t>(slot + 1) * SamplesBlockSize);
+        }
+
+        const int64_t size = block.size_;
+        const int32_t f = polynom.SplitFeatures[split];
+        const float c = polynom.SplitConditions[split];
+        float* factor = cache->factors_.data() + static_cast<int64_t>(slot) * SamplesBlockSize;
+        float* args = cache->args_.data();
+        for (int64_t s = 0; s < size; ++s) {
+            factor[s] = block.feature(s, f);
+        }
+
+        switch (polynom.MonomType_) {
+            case Monom::MonomType::SigmoidProbMonom: {
+                for (int64_t s = 0; s < size; ++s) {
+                    args[s] = -lambda * (factor[s] - c);
+                }
+                expInPlace(args, size);
+                for (int64_t s = 0; s < size; ++s) {
+                    factor[s] = 1.0f / (1.0f + args[s]);
+                }
+                break;
+            }
+            case Monom::MonomType::ExpProbMonom: {
+                for (int64_t s = 0; s < size; ++s) {
+                    args[s] = -lambda * factor[s];
+                }
+                expInPlace(args, size);
+                //log of non-positive factor isn't finite: monom probability is zero
+                for (int64_t s = 0; s < size; ++s) {
+                    const float value = 1.0f - args[s];
+                    factor[s] = value > 0 ? value : 0.0f;
+                }
+                break;
+            }
+            case Monom::MonomType::LinearMonom: {
+                for (int64_t s = 0; s < size; ++s) {
+                    factor[s] = factor[s] > c ? 1.0f : 0.0f;
+                }
+                break;
+            }
+        }
+    }
+
+    //probability of monom for samples of block (split indicator for linear monoms) as product of cached split factors
+    void computeMonomProbs(const PolynomCpu& polynom, float lambda, int64_t monom, const BatchView& block, BlockScratch* scratch) {
+        const int32_t first = polynom.PolynomOffsets[monom];
+        const int32_t last = polynom.PolynomOffsets[monom + 1];
+        for (int32_t k = first; k < last; ++k) {
+            cacheSplitFactors(polynom, lambda, polynom.MonomSplits[k], block, &scratch->splits_);
+        }
+
+        const int64_t size = block.size_;
+        float* probs = scratch->probs_.data();
+        std::fill(probs, probs + size, 1.0f);
+        for (int32_t k = first; k < last; ++k) {
+            const float* factor = scratch->splits_.row(polynom.MonomSplits[k]);
+            for (int64_t s = 0; s < size; ++s) {
+                probs[s] *= factor[s];
+            }
+        }
+    }
+
+    //sample blocks x monom blocks; monom block writes to its own partial result
+    struct TaskGrid {
+        int64_t sampleBlocks_ = 0;
+        int64_t monomBlocks_ = 0;
+        int64_t monomsPerBlock_ = 0;
+
+        TaskGrid(int64_t batchSize, int64_t monomsCount) {
+            sampleBlocks_ = (batchSize + SamplesBlockSize - 1) / SamplesBlockSize;
+            const int64_t numThreads = GlobalThreadPool<0>().numThreads();
+            const int64_t wanted = (2 * numThreads + sampleBlocks_ - 1) / std::max<int64_t>(sampleBlocks_, 1);
+            monomBlocks_ = std::max<int64_t>(std::min<int64_t>(wanted, monomsCount / MinMonomsPerBlock), 1);
+            monomsPerBlock_ = (monomsCount + monomBlocks_ - 1) / monomBlocks_;
+        }
+
+        //grid of forward which saved activations
+        explicit TaskGrid(const PolynomActivations& saved)
+            : sampleBlocks_(saved.SampleBlocks)
+            , monomBlocks_(saved.MonomBlocks)
+            , monomsPerBlock_(saved.MonomsPerBlock) {
+
+        }
+
+        int64_t tasks() const {
+            return sampleBlocks_ * monomBlocks_;
+        }
+    };
+
+    //sums partial results into first one in fixed order
+    void reducePartials(std::vector<float*>& partials, int64_t size) {
+        if (partials.size() <= 1) {
+            return;
+        }
+        const int64_t chunk = 4096;
+        parallelFor(0, (size + chunk - 1) / chunk, [&](int64_t i) {
+            const int64_t last = std::min(size, (i + 1) * chunk);
+            for (uint64_t p = 1; p < partials.size(); ++p) {
+                for (int64_t j = i * chunk; j < last; ++j) {
+                    partials[0][j] += partials[p][j];
+                }
+            }
+        });
+    }
+}
+
+PolynomCpu::PolynomCpu(PolynomPtr polynom)
+    : Polynom_(std::move(polynom)) {
+    VERIFY(Polynom_ && !Polynom_->Ensemble_.empty(), "Polynom should have monoms");
+    MonomType_ = Polynom_->getMonomType();
+    OutDim_ = Polynom_->OutDim();
+
+    //exp monoms ignore condition, so their splits are shared by feature only
+    const bool useConditions = MonomType_ != Monom::MonomType::ExpProbMonom;
+    std::unordered_map<uint64_t, int32_t> splitIds;
+
+    PolynomOffsets.push_back(0);
+    for (const auto& monom : Polynom_->Ensemble_) {
+        VERIFY(monom->getMonomType() == MonomType_, "Monoms of polynom should be of one type");
+        VERIFY(monom->OutDim() == OutDim_, "Monoms of polynom should have same out dim");
+        for (const auto& split : monom->Structure_.Splits) {
+            const float condition = useConditions ? split.Condition : 0.0f;
+            uint32_t conditionBits = 0;
+            std::memcpy(&conditionBits, &condition, sizeof(conditionBits));
+            const uint64_t key = (static_cast<uint64_t>(static_cast<uint32_t>(split.Feature)) << 32u) | conditionBits;
+
+            auto inserted = splitIds.emplace(key, static_cast<int32_t>(SplitFeatures.size()));
+            if (inserted.second) {
+                SplitFeatures.push_back(split.Feature);
+                SplitConditions.push_back(condition);
+            }
+            MonomSplits.push_back(inserted.first->second);
+        }
+        PolynomValues.insert(PolynomValues.end(), monom->Values_.begin(), monom->Values_.end());
+        PolynomOffsets.push_back(static_cast<int32_t>(MonomSplits.size()));
+        OrigFIds.push_back(monom->origFId_);
+        MaxDepth_ = std::max<int>(MaxDepth_, monom->Structure_.Splits.size());
+    }
+}
+
+int64_t PolynomCpu::ActivationsBytes(int64_t batchSize) const {
+    TaskGrid grid(batchSize, MonomsCount());
+    const int64_t splitRows = std::min<int64_t>(SplitsCount() * grid.monomBlocks_, MonomSplits.size());
+    return grid.sampleBlocks_ * SamplesBlockSize * (MonomsCount() + splitRows) * static_cast<int64_t>(sizeof(float));
+}
+
+torch::Tensor PolynomCpu::Forward(torch::Tensor batch, PolynomActivations* saved) const {
+    batch = batch.to(torch::kCPU, torch::kFloat32).contiguous();
+    const int64_t batchSize = batch.size(0);
+    const int64_t fCount = batch.size(1);
+    const float lambda = static_cast<float>(Polynom_->Lambda_);
+    const float* samples = batch.data_ptr<float>();
+
+    TaskGrid grid(batchSize, MonomsCount());
+    torch::Tensor result = torch::zeros({batchSize, OutDim_}, torch::kFloat32);
+    std::vector<torch::Tensor> partialTensors;
+    std::vector<float*> partials = {result.data_ptr<float>()};
+    for (int64_t i = 1; i < grid.monomBlocks_; ++i) {
+        partialTensors.push_back(torch::zeros({batchSize, OutDim_}, torch::kFloat32));
+        partials.push_back(partialTensors.back().data_ptr<float>());
+    }
+
+    if (saved) {
+        saved->BatchSize = batchSize;
+        saved->Lambda = lambda;
+        saved->SampleBlocks = grid.sampleBlocks_;
+        saved->MonomBlocks = grid.monomBlocks_;
+        saved->MonomsPerBlock = grid.monomsPerBlock_;
+        saved->Tasks.assign(grid.tasks(), PolynomActivations::Task());
+    }
+
+    const int64_t numThreads = GlobalThreadPool<0>().numThreads();
+    std::vector<BlockScratch> scratches(numThreads, BlockScratch(SplitsCount()));
+
+    parallelFor(0, grid.tasks(), [&](int thId, int64_t task) {
+        const int64_t monomBlock = task / grid.sampleBlocks_;
+        const int64_t sampleBlock = task % grid.sampleBlocks_;
+
+        BatchView block;
+        block.samples_ = samples;
+        block.featuresCount_ = fCount;
+        block.first_ = sampleBlock * SamplesBlockSize;
+        block.size_ = std::min<int64_t>(SamplesBlockSize, batchSize - block.first_);
+
+        auto& scratch = scratches[thId];
+        scratch.splits_.reset();
+        float* dst = partials[monomBlock] + block.first_ * OutDim_;
+        const float* probs = scratch.probs_.data();
+        float* weights = scratch.weights_.data();
+
+        const int64_t firstMonom = monomBlock * grid.monomsPerBlock_;
+        const int64_t lastMonom = std::min(MonomsCount(), firstMonom + grid.monomsPerBlock_);
+        PolynomActivations::Task* savedTask = saved ? &saved->Tasks[task] : nullptr;
+        if (savedTask) {
+            savedTask->Probs.resize(std::max<int64_t>(lastMonom - firstMonom, 0) * SamplesBlockSize);
+        }
+
+        for (int64_t m = firstMonom; m < lastMonom; ++m) {
+            computeMonomProbs(*this, lambda, m, block, &scratch);
+            if (savedTask) {
+                std::copy(probs, probs + block.size_, savedTask->Probs.data() + (m - firstMonom) * SamplesBlockSize);
+            }
+
+            // TODO we store fID = -1 as our bias column, but it's a hack and we need to get rid of this
+            const int32_t origFId = OrigFIds[m];
+            for (int64_t s = 0; s < block.size_; ++s) {
+                weights[s] = MonomType_ == Monom::MonomType::LinearMonom && origFId != -1
+                             ? probs[s] * block.feature(s, origFId)
+                             : probs[s];
+            }
+
+            const float* values = PolynomValues.data() + m * OutDim_;
+            for (int64_t s = 0; s < block.size_; ++s) {
+                for (int dim = 0; dim < OutDim_; ++dim) {
+                    dst[s * OutDim_ + dim] += weights[s] * values[dim];
+                }
+            }
+        }
+
+        if (savedTask) {
+            scratch.splits_.save(savedTask);
+        }
+    });
+
+    reducePartials(partials, batchSize * OutDim_);
+    return result;
+}
+
+torch::Tensor PolynomCpu::Backward(torch::Tensor batch, torch::Tensor outputDer, const PolynomActivations* saved) const {
+    batch = batch.to(torch::kCPU, torch::kFloat32).contiguous();
+    outputDer = outputDer.to(torch::kCPU, torch::kFloat32).contiguous();
+    const int64_t batchSize = batch.size(0);
+    const int64_t fCount = batch.size(1);
+    VERIFY(outputDer.size(0) == batchSize && outputDer.size(1) == OutDim_, "error: out dim should be equal to polynom out dim");
+    VERIFY(!saved || saved->BatchSize == batchSize, "error: activations are saved for batch of size " << saved->BatchSize);
+
+    const float lambda = saved ? saved->Lambda : static_cast<float>(Polynom_->Lambda_);
+    const float* samples = batch.data_ptr<float>();
+    const float* outDer = outputDer.data_ptr<float>();
+
+    const TaskGrid grid = saved ? TaskGrid(*saved) : TaskGrid(batchSize, MonomsCount());
+    torch::Tensor result = torch::zeros({batchSize, fCount}, torch::kFloat32);
+    std::vector<torch::Tensor> partialTensors;
+    std::vector<float*> partials = {result.data_ptr<float>()};
+    for (int64_t i = 1; i < grid.monomBlocks_; ++i) {
+        partialTensors.push_back(torch::zeros({batchSize, fCount}, torch::kFloat32));
+        partials.push_back(partialTensors.back().data_ptr<float>());
+    }
+
+    const int64_t numThreads = GlobalThreadPool<0>().numThreads();
+    std::vector<BlockScratch> scratches(numThreads, BlockScratch(SplitsCount()));
+
+    parallelFor(0, grid.tasks(), [&](int thId, int64_t task) {
+        const int64_t monomBlock = task / grid.sampleBlocks_;
+        const int64_t sampleBlock = task % grid.sampleBlocks_;
+
+        BatchView block;
+        block.samples_ = samples;
+        block.featuresCount_ = fCount;
+        block.first_ = sampleBlock * SamplesBlockSize;
+        block.size_ = std::min<int64_t>(SamplesBlockSize, batchSize - block.first_);
+
+        auto& scratch = scratches[thId];
+        const PolynomActivations::Task* savedTask = saved ? &saved->Tasks[task] : nullptr;
+        if (savedTask) {
+            scratch.splits_.restore(*savedTask);
+        } else {
+            scratch.splits_.reset();
+        }
+        float* dst = partials[monomBlock] + block.first_ * fCount;
+        const float* blockOutDer = outDer + block.first_ * OutDim_;
+        float* derMultipliers = scratch.derMultipliers_.data();
+        auto& splitGrads = scratch.splitGrads_;
+
+        const int64_t firstMonom = monomBlock * grid.monomsPerBlock_;
+        const int64_t lastMonom = std::min(MonomsCount(), firstMonom + grid.monomsPerBlock_);
+        for (int64_t m = firstMonom; m < lastMonom; ++m) {
+            const int32_t origFId = OrigFIds[m];
+            // TODO for now we treat origFId=-1 as bias
+            if (MonomType_ == Monom::MonomType::LinearMonom && origFId == -1) {
+                continue;
+            }
+            const float* probs = scratch.probs_.data();
+            if (savedTask) {
+                probs = savedTask->Probs.data() + (m - firstMonom) * SamplesBlockSize;
+            } else {
+                computeMonomProbs(*this, lambda, m, block, &scratch);
+            }
+
+            //featureDerivative is outputDer * monom value * monom derivative
+            const float* values = PolynomValues.data() + m * OutDim_;
+            for (int64_t s = 0; s < block.size_; ++s) {
+                float derMultiplier = 0;
+                for (int dim = 0; dim < OutDim_; ++dim) {
+                    derMultiplier += values[dim] * blockOutDer[s * OutDim_ + dim];
+                }
+                derMultipliers[s] = derMultiplier * probs[s];
+            }
+
+            if (MonomType_ == Monom::MonomType::LinearMonom) {
+                for (int64_t s = 0; s < block.size_; ++s) {
+                    dst[s * fCount + origFId] += derMultipliers[s];
+                }
+                continue;
+            }
+
+            //derivatives of monoms are accumulated by splits and scattered to features once per block
+            for (int32_t k = PolynomOffsets[m]; k < PolynomOffsets[m + 1]; ++k) {
+                const int64_t slotOffset = static_cast<int64_t>(scratch.splits_.slots_[MonomSplits[k]]) * SamplesBlockSize;
+                if (static_cast<int64_t>(splitGrads.size()) < slotOffset + SamplesBlockSize) {
+                    splitGrads.resize(slotOffset + SamplesBlockSize, 0.0f);
+                }
+                float* grads = splitGrads.data() + slotOffset;
+                for (int64_t s = 0; s < block.size_; ++s) {
+                    grads[s] += derMultipliers[s];
+                }
+            }
+        }
+
+        if (MonomType_ == Monom::MonomType::LinearMonom) {
+            return;
+        }
+        const auto& cachedSplits = scratch.splits_.cached_;
+        for (uint64_t slot = 0; slot < cachedSplits.size(); ++slot) {
+            const int64_t slotOffset = static_cast<int64_t>(slot) * SamplesBlockSize;
+            if (static_cast<int64_t>(splitGrads.size()) < slotOffset + SamplesBlockSize) {
+                break;
+            }
+            const int32_t f = SplitFeatures[cachedSplits[slot]];
+            const float* factor = scratch.splits_.row(cachedSplits[slot]);
+            float* grads = splitGrads.data() + slotOffset;
+            if (MonomType_ == Monom::MonomType::SigmoidProbMonom) {
+                for (int64_t s = 0; s < block.size_; ++s) {
+                    dst[s * fCount + f] += grads[s] * (1.0f - factor[s]);
+                }
+            } else {
+                // dp / dx_i = p / (1 - e^{-l * x_i}) * (l * e^{-l * x_i}), zero when factor is zero (then p is zero)
+                for (int64_t s = 0; s < block.size_; ++s) {
+                    if (factor[s] > 0) {
+                        dst[s * fCount + f] += grads[s] / factor[s] * lambda * (1.0f - factor[s]);
+                    }
+                }
+            }
+            std::fill(grads, grads + SamplesBlockSize, 0.0f);
+        }
+    });
+
+    reducePartials(partials, batchSize * fCount);
+    return result;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "polynom.h"
+#include <torch/torch.h>
+
+#include <memory>
+#include <vector>
+
+/*
+ * Monoms of polynom flattened into arrays, offsets and values have same layout as PolynomCuda:
+ * splits of monom m are MonomSplits[PolynomOffsets[m]..PolynomOffsets[m + 1]), its values are PolynomValues[m * outDim + dim].
+ * Splits are interned: MonomSplits are indices of unique (feature, condition) pairs SplitFeatures/SplitConditions,
+ * so factor of split shared by many monoms is computed once per sample block of task, backward takes derivatives from same factors.
+ * Batch is processed by blocks of samples x blocks of monoms in parallel: factors of split for sample block are kept
+ * in contiguous rows, so probabilities of monom for whole block are computed by vectorized loops (exp is SIMD with avx2).
+ * Monom blocks write to own partial results, which are summed in fixed order, so results don't depend on scheduling.
+ * Lambda is read from polynom on every call, monoms are copied on construction
+ */
+
+//split factors and monom probabilities of batch saved by forward, so backward of same batch doesn't recompute them.
+//stored per forward task: rows of splits used by task and probabilities of its monoms, SamplesBlockSize floats per row
+struct PolynomActivations {
+    struct Task {
+        std::vector<int32_t> Splits;
+        std::vector<float> Factors;
+        std::vector<float> Probs;
+    };
+
+    int64_t BatchSize = 0;
+    float Lambda = 0;
+    int64_t SampleBlocks = 0;
+    int64_t MonomBlocks = 0;
+    int64_t MonomsPerBlock = 0;
+    std::vector<Task> Tasks;
+};
+
+using PolynomActivationsPtr = std::shared_ptr<PolynomActivations>;
+
+struct PolynomCpu {
+    PolynomPtr Polynom_;
+    Monom::MonomType MonomType_;
+    int OutDim_ = 0;
+    int MaxDepth_ = 0;
+
+    std::vector<int32_t> SplitFeatures;
+    std::vector<float> SplitConditions;
+    std::vector<int32_t> MonomSplits;
+    std::vector<int32_t> PolynomOffsets;
+    std::vector<float> PolynomValues;
+    std::vector<int32_t> OrigFIds;
+
+    //autograd saves activations in forward only for batches which need less memory
+    int64_t SavedActivationsLimit = 512ll << 20;
+
+    explicit PolynomCpu(PolynomPtr polynom);
+
+    int64_t MonomsCount() const {
+        return static_cast<int64_t>(PolynomOffsets.size()) - 1;
+    }
+
+    int64_t SplitsCount() const {
+        return static_cast<int64_t>(SplitFeatures.size());
+    }
+
+    //upper bound of memory for activations saved by forward of batch
+    int64_t ActivationsBytes(int64_t batchSize) const;
+
+    //batch is [batchSize, featuresCount], result is [batchSize, outDim]; fills saved if it's not null
+    torch::Tensor Forward(torch::Tensor batch, PolynomActivations* saved = nullptr) const;
+
+    //derivatives of sum(outputDer * Forward(batch)) by batch, saved are activations from forward of same batch or null
+    torch::Tensor Backward(torch::Tensor batch, torch::Tensor outputDer, const PolynomActivations* saved = nullptr) const;
+};
+
+using PolynomCpuPtr = std::shared_ptr<PolynomCpu>;
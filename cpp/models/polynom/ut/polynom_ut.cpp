@@ -1,6 +1,9 @@
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <vector>
 
 #include <models/linear_oblivious_tree.h>
 #include <models/polynom/linear_monom.h>
@@ -14,6 +17,7 @@
 #include <methods/greedy_linear_oblivious_trees.h>
 #include <methods/boosting_weak_target_factory.h>
 #include <models/polynom/polynom_gpu.h>
+#include <models/polynom/polynom_cpu.h>
 
 
 inline std::unique_ptr<GreedyLinearObliviousTreeLearner> createWeakLinearLearner(
@@ -153,3 +157,195 @@ TEST(LinearPolynomGpu, ValGrad) {
         }
     }
 }
+
+TEST(LinearPolynomCpu, ValGrad) {
+    auto ds = simpleDs();
+
+    BinarizationConfig config;
+    config.bordersCount_ = 32;
+    auto grid = buildGrid(ds, config);
+
+    const double l2reg = 1e-5;
+
+    BoostingConfig boostingConfig;
+    boostingConfig.iterations_ = 100;
+    boostingConfig.step_ = 0.01;
+    Boosting boosting(boostingConfig, createWeakTarget(l2reg), createWeakLinearLearner(3,  l2reg, grid));
+
+    LinearL2 target(ds, l2reg);
+    auto ensemble = boosting.fit(ds, target);
+
+    auto polynom = std::make_shared<Polynom>(LinearTreesToPolynom(*std::dynamic_pointer_cast<Ensemble>(ensemble)));
+    PolynomCpu cpuPolynom(polynom);
+
+    auto batch = ds.samplesMx().data().view({ds.samplesCount(), ds.featuresCount()});
+    auto values = cpuPolynom.Forward(batch);
+    auto outputGrads = torch::ones({ds.samplesCount(), 2}, torch::kFloat32);
+    auto grads = cpuPolynom.Backward(batch, outputGrads);
+
+    for (int i = 0; i < ds.samplesCount(); ++i) {
+        EXPECT_NEAR(values[i][0].item<float>(), 0, 1e-5);
+        EXPECT_NEAR(values[i][1].item<float>(), ensemble->value(ds.sample(i)), 1e-5);
+
+        Vec gradExpected(ds.featuresCount());
+        ensemble->grad(ds.sample(i), gradExpected);
+        for (int j = 0; j < gradExpected.size(); ++j) {
+            EXPECT_NEAR(grads[i][j].item<float>(), gradExpected(j), 1e-5);
+        }
+    }
+}
+
+// 1000 monoms over feature subsets with various conditions, out dim is 2
+PolynomPtr createProbPolynom(Monom::MonomType type, int64_t featuresCount) {
+    auto polynom = std::make_shared<Polynom>();
+    polynom->Lambda_ = 2.0;
+    for (int i = 0; i < 1000; ++i) {
+        PolynomStructure structure;
+        for (int f = 0; f < featuresCount; ++f) {
+            if ((i >> f) & 1) {
+                structure.AddSplit({f, static_cast<float>(0.01 * (i % 97) - 0.3)});
+            }
+        }
+        polynom->Ensemble_.push_back(Monom::createMonom(type, structure, {0.01 * (i % 13) - 0.05, 0.002 * i}, -1));
+    }
+    return polynom;
+}
+
+TEST(SigmoidPolynomCpu, ValGrad) {
+    auto ds = simpleDs();
+
+    auto polynom = createProbPolynom(Monom::MonomType::SigmoidProbMonom, ds.featuresCount());
+    PolynomCpu cpuPolynom(polynom);
+
+    auto batch = ds.samplesMx().data().view({ds.samplesCount(), ds.featuresCount()});
+    auto outputGrads = torch::rand({ds.samplesCount(), 2}, torch::kFloat32);
+    auto values = cpuPolynom.Forward(batch);
+    auto grads = cpuPolynom.Backward(batch, outputGrads);
+
+    for (int i = 0; i < ds.samplesCount(); ++i) {
+        Vec expected(2);
+        polynom->Forward(ds.sample(i).arrayRef(), expected.arrayRef());
+        for (int dim = 0; dim < 2; ++dim) {
+            EXPECT_NEAR(values[i][dim].item<float>(), expected(dim), 1e-3);
+        }
+
+        Vec gradExpected(ds.featuresCount());
+        Vec sampleOutputGrads = Vec(outputGrads[i].contiguous());
+        polynom->Backward(ds.sample(i).arrayRef(), sampleOutputGrads.arrayRef(), gradExpected.arrayRef());
+        for (int j = 0; j < gradExpected.size(); ++j) {
+            EXPECT_NEAR(grads[i][j].item<float>(), gradExpected(j), 1e-3);
+        }
+    }
+}
+
+TEST(SigmoidPolynomCpu, SavedActivations) {
+    auto ds = simpleDs();
+
+    auto polynom = createProbPolynom(Monom::MonomType::SigmoidProbMonom, ds.featuresCount());
+    PolynomCpu cpuPolynom(polynom);
+
+    auto batch = ds.samplesMx().data().view({ds.samplesCount(), ds.featuresCount()});
+    auto outputGrads = torch::rand({ds.samplesCount(), 2}, torch::kFloat32);
+
+    PolynomActivations activations;
+    auto values = cpuPolynom.Forward(batch, &activations);
+    auto grads = cpuPolynom.Backward(batch, outputGrads, &activations);
+    auto expectedValues = cpuPolynom.Forward(batch);
+    auto expectedGrads = cpuPolynom.Backward(batch, outputGrads);
+
+    EXPECT_EQ(activations.BatchSize, ds.samplesCount());
+    EXPECT_TRUE(torch::allclose(values, expectedValues));
+    EXPECT_TRUE(torch::allclose(grads, expectedGrads));
+}
+
+// derivatives as in ExpProbPolynomBackwardImpl of soft_polynom.cu: ExpProbMonom::Backward has extra 1e5 factor
+void expProbPolynomBackward(const Polynom& polynom, ConstVecRef<float> x, ConstVecRef<float> outputDer, VecRef<float> dst) {
+    const double lambda = polynom.Lambda_;
+    for (const auto& monom : polynom.Ensemble_) {
+        const auto& splits = monom->Structure_.Splits;
+        std::vector<double> vals(splits.size());
+        std::vector<double> logProbs(splits.size());
+        double totalLogProb = 0;
+        bool zeroProb = false;
+        for (int i = 0; i < (int)splits.size(); ++i) {
+            vals[i] = -lambda * x[splits[i].Feature];
+            logProbs[i] = std::log(1.0 - std::exp(vals[i]));
+            if (std::isfinite(logProbs[i])) {
+                totalLogProb += logProbs[i];
+            } else {
+                zeroProb = true;
+            }
+        }
+        if (zeroProb) {
+            continue;
+        }
+        double derMultiplier = 0;
+        for (int dim = 0; dim < monom->OutDim(); ++dim) {
+            derMultiplier += monom->Values_[dim] * outputDer[dim];
+        }
+        for (int i = 0; i < (int)splits.size(); ++i) {
+            dst[splits[i].Feature] += std::exp(totalLogProb - logProbs[i] + std::log(lambda) + vals[i]) * derMultiplier;
+        }
+    }
+}
+
+TEST(ExpPolynomCpu, ValGrad) {
+    auto ds = simpleDs();
+    auto polynom = createProbPolynom(Monom::MonomType::ExpProbMonom, ds.featuresCount());
+    PolynomCpu cpuPolynom(polynom);
+
+    auto batch = ds.samplesMx().data().view({ds.samplesCount(), ds.featuresCount()});
+    auto outputGrads = torch::rand({ds.samplesCount(), 2}, torch::kFloat32);
+    auto values = cpuPolynom.Forward(batch);
+    auto grads = cpuPolynom.Backward(batch, outputGrads);
+
+    // some features are zero or negative, so there are monoms of zero probability
+    for (int i = 0; i < ds.samplesCount(); ++i) {
+        Vec expected(2);
+        polynom->Forward(ds.sample(i).arrayRef(), expected.arrayRef());
+        for (int dim = 0; dim < 2; ++dim) {
+            EXPECT_NEAR(values[i][dim].item<float>(), expected(dim), 1e-3 * std::max(1.0, std::abs(expected(dim))));
+        }
+
+        Vec gradExpected(ds.featuresCount());
+        Vec sampleOutputGrads = Vec(outputGrads[i].contiguous());
+        expProbPolynomBackward(*polynom, ds.sample(i).arrayRef(), sampleOutputGrads.arrayRef(), gradExpected.arrayRef());
+        for (int j = 0; j < gradExpected.size(); ++j) {
+            EXPECT_NEAR(grads[i][j].item<float>(), gradExpected(j), 1e-3 * std::max(1.0, std::abs(gradExpected(j))));
+        }
+    }
+}
+
+TEST(LinearPolynom, Pruning) {
+    auto ds = simpleDs();
+
+    BinarizationConfig config;
+    config.bordersCount_ = 32;
+    auto grid = buildGrid(ds, config);
+
+    const double l2reg = 1e-5;
+
+    BoostingConfig boostingConfig;
+    boostingConfig.iterations_ = 100;
+    boostingConfig.step_ = 0.01;
+    Boosting boosting(boostingConfig, createWeakTarget(l2reg), createWeakLinearLearner(3,  l2reg, grid));
+
+    LinearL2 target(ds, l2reg);
+    auto ensemble = std::dynamic_pointer_cast<Ensemble>(boosting.fit(ds, target));
+
+    auto polynom = LinearTreesToPolynom(*ensemble);
+
+    PolynomPruning pruning;
+    pruning.MinAbsValue = 1e-3;
+    auto pruned = LinearTreesToPolynom(*ensemble, pruning);
+
+    int64_t expectedSize = 0;
+    for (const auto& monom : polynom.Ensemble_) {
+        expectedSize += std::abs(monom->Values_[1]) >= pruning.MinAbsValue;
+    }
+    EXPECT_EQ(static_cast<int64_t>(pruned.Ensemble_.size()), expectedSize);
+    EXPECT_LT(pruned.Ensemble_.size(), polynom.Ensemble_.size());
+    for (const auto& monom : pruned.Ensemble_) {
+        EXPECT_GE(std::abs(monom->Values_[1]), pruning.MinAbsValue);
+    }
+}
@@ -4,9 +4,17 @@
 #include <core/vec.h>
 
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <unistd.h>
 #include <data/grid_builder.h>
 #include <data/binarized_dataset.h>
 #include <models/oblivious_tree.h>
+#include <models/ensemble.h>
+#include <models/linear_oblivious_tree.h>
+#include <models/model_binary.h>
 #include <vec_tools/transform.h>
 
 #include <models/polynom/polynom.h>
@@ -14,6 +22,19 @@
 
 #define EPS 1e-5
 
+namespace {
+    //new empty file with unique name in temp dir, so concurrent test runs don't share it
+    std::string createTempFile(const std::string& suffix) {
+        std::string path = ::testing::TempDir() + "models_ut_XXXXXX" + suffix;
+        const int fd = mkstemps(&path[0], suffix.size());
+        if (fd < 0) {
+            throw std::runtime_error("can't create temp file " + path);
+        }
+        close(fd);
+        return path;
+    }
+}
+
 //run it from root
 TEST(FeaturesTxt, ApplyFloatAndBinarizedOtTest) {
     for (int32_t groupSize : {2, 4, 8, 16, 17, 32}) {
@@ -55,6 +76,226 @@ TEST(FeaturesTxt, ApplyFloatAndBinarizedOtTest) {
 
 }
 
+TEST(FeaturesTxt, CompiledEnsembleApplyTest) {
+    auto ds = loadFeaturesTxt("test_data/featuresTxt/train");
+
+    BinarizationConfig config;
+    config.bordersCount_ = 32;
+    auto grid = buildGrid(ds, config);
+
+    std::vector<ModelPtr> trees;
+    for (int32_t firstF = 0; firstF < grid->nzFeaturesCount(); firstF += 5) {
+        std::vector<BinaryFeature> features;
+        for (int32_t i = firstF; i < std::min<int32_t>(firstF + 6, grid->nzFeaturesCount()); ++i) {
+            features.emplace_back(i, (grid->conditionsCount(i) * (i % 3 + 1)) / 4);
+        }
+        Vec values(1 << features.size());
+        for (int64_t i = 0; i < values.dim(); ++i) {
+            values.arrayRef()[i] = 2.0 * std::rand() / RAND_MAX - 1.0;
+        }
+        trees.push_back(std::make_shared<ObliviousTree>(grid, features, values));
+    }
+
+    auto compiled = CompiledObliviousEnsemble::compile(trees);
+    ASSERT_TRUE(compiled != nullptr);
+    EXPECT_EQ(compiled->treesCount(), static_cast<int64_t>(trees.size()));
+
+    const double scale = 0.5;
+    Vec expected(ds.samplesCount());
+    for (const auto& tree : trees) {
+        tree->append(ds, Mx(expected, ds.samplesCount(), 1));
+    }
+
+    Vec fromCompiled(ds.samplesCount());
+    Ensemble ensemble(trees, scale);
+    ensemble.apply(ds, Mx(fromCompiled, ds.samplesCount(), 1));
+
+    for (int64_t i = 0; i < ds.samplesCount(); ++i) {
+        EXPECT_NEAR(fromCompiled.get(i), scale * expected.get(i), EPS);
+    }
+
+    std::vector<float> fromRows(ds.samplesCount());
+    ensemble.applyToRows(ds.samples(), ds.samplesCount(), VecRef<float>(fromRows));
+    for (int64_t i = 0; i < ds.samplesCount(); ++i) {
+        EXPECT_NEAR(fromRows[i], scale * expected.get(i), EPS);
+    }
+
+    std::vector<float> treeFromRows(ds.samplesCount());
+    trees.front()->applyToRows(ds.samples(), ds.samplesCount(), VecRef<float>(treeFromRows));
+    Vec treeFromDs(ds.samplesCount());
+    trees.front()->apply(ds, Mx(treeFromDs, ds.samplesCount(), 1));
+    for (int64_t i = 0; i < ds.samplesCount(); ++i) {
+        EXPECT_EQ(treeFromRows[i], treeFromDs.get(i));
+    }
+}
+
+TEST(FeaturesTxt, LinearTreeApplyToBdsTest) {
+    auto ds = loadFeaturesTxt("test_data/featuresTxt/train");
+
+    BinarizationConfig config;
+    config.bordersCount_ = 32;
+    auto grid = buildGrid(ds, config);
+    const auto& bds = cachedBinarize(ds, grid, 7);
+
+    auto tree = std::make_shared<LinearObliviousTree>(grid);
+    std::vector<int32_t> usedFeatures = {-1};
+    for (int32_t fIndex : {3, 11, 5}) {
+        tree->splits_.emplace_back(grid->origFeatureIndex(fIndex), grid->borders(fIndex)[grid->conditionsCount(fIndex) / 2]);
+        usedFeatures.push_back(grid->origFeatureIndex(fIndex));
+    }
+    for (int32_t leaf = 0; leaf < 8; ++leaf) {
+        Eigen::MatrixXd w(usedFeatures.size(), 1);
+        for (int32_t k = 0; k < (int32_t)usedFeatures.size(); ++k) {
+            w(k, 0) = 0.1 * (leaf + 1) - 0.25 * k;
+        }
+        tree->leaves_.emplace_back(usedFeatures, w, 1.0);
+    }
+    tree->scale_ = 0.5;
+
+    Vec toFromBds(ds.samplesCount());
+    tree->applyToBds(bds, Mx(toFromBds, ds.samplesCount(), 1), ApplyType::Set);
+    tree->applyToBds(bds, Mx(toFromBds, ds.samplesCount(), 1), ApplyType::Append);
+
+    std::vector<float> fromRows(ds.samplesCount());
+    tree->applyToRows(ds.samples(), ds.samplesCount(), VecRef<float>(fromRows), ApplyType::Set, 2.0);
+
+    auto samples = ds.samplesMx().arrayRef();
+    for (int64_t i = 0; i < ds.samplesCount(); ++i) {
+        ConstVecRef<float> x = samples.slice(i * ds.featuresCount(), ds.featuresCount());
+        EXPECT_NEAR(toFromBds.get(i), 2 * tree->value(x), 1e-4);
+        EXPECT_NEAR(fromRows[i], 2 * tree->value(x), 1e-4);
+    }
+}
+
+TEST(FeaturesTxt, ScaledEnsembleAppendTest) {
+    auto ds = loadFeaturesTxt("test_data/featuresTxt/train");
+
+    BinarizationConfig config;
+    config.bordersCount_ = 32;
+    auto grid = buildGrid(ds, config);
+
+    std::vector<ModelPtr> linearTrees;
+    for (int32_t firstF = 0; firstF + 3 <= grid->nzFeaturesCount(); firstF += 9) {
+        auto tree = std::make_shared<LinearObliviousTree>(grid);
+        std::vector<int32_t> usedFeatures = {-1};
+        for (int32_t i = firstF; i < firstF + 3; ++i) {
+            tree->splits_.emplace_back(grid->origFeatureIndex(i), grid->borders(i)[grid->conditionsCount(i) / 2]);
+            usedFeatures.push_back(grid->origFeatureIndex(i));
+        }
+        for (int32_t leaf = 0; leaf < 8; ++leaf) {
+            Eigen::MatrixXd w(usedFeatures.size(), 1);
+            for (int32_t k = 0; k < (int32_t)usedFeatures.size(); ++k) {
+                w(k, 0) = 2.0 * std::rand() / RAND_MAX - 1.0;
+            }
+            tree->leaves_.emplace_back(usedFeatures, w, 1.0);
+        }
+        linearTrees.push_back(tree);
+    }
+
+    const double scale = 0.5;
+    Vec expected(ds.samplesCount());
+    for (const auto& tree : linearTrees) {
+        tree->append(ds, Mx(expected, ds.samplesCount(), 1));
+    }
+
+    //scale of ensemble must not touch previous content of destination
+    Ensemble ensemble(linearTrees, scale);
+    Vec appended(ds.samplesCount(), 1.0);
+    ensemble.append(ds, Mx(appended, ds.samplesCount(), 1));
+    Vec applied(ds.samplesCount(), 1.0);
+    ensemble.apply(ds, Mx(applied, ds.samplesCount(), 1));
+    for (int64_t i = 0; i < ds.samplesCount(); ++i) {
+        EXPECT_NEAR(appended.get(i), 1.0 + scale * expected.get(i), 1e-4);
+        EXPECT_NEAR(applied.get(i), scale * expected.get(i), 1e-4);
+    }
+
+    //nested scaled ensembles append to rows without shared scratch
+    Ensemble outer(std::vector<ModelPtr>({std::make_shared<Ensemble>(linearTrees, scale)}), 2.0);
+    std::vector<float> fromRows(ds.samplesCount(), 1.0f);
+    outer.applyToRows(ds.samples(), ds.samplesCount(), VecRef<float>(fromRows), ApplyType::Append);
+    for (int64_t i = 0; i < ds.samplesCount(); ++i) {
+        EXPECT_NEAR(fromRows[i], 1.0 + expected.get(i), 1e-4);
+    }
+}
+
+TEST(FeaturesTxt, ModelBinaryTest) {
+    auto ds = loadFeaturesTxt("test_data/featuresTxt/train");
+
+    BinarizationConfig config;
+    config.bordersCount_ = 32;
+    auto grid = buildGrid(ds, config);
+
+    std::vector<ModelPtr> trees;
+    std::vector<ModelPtr> linearTrees;
+    for (int32_t firstF = 0; firstF + 3 <= grid->nzFeaturesCount(); firstF += 7) {
+        std::vector<BinaryFeature> features;
+        auto linearTree = std::make_shared<LinearObliviousTree>(grid);
+        std::vector<int32_t> usedFeatures = {-1};
+        for (int32_t i = firstF; i < firstF + 3; ++i) {
+            features.emplace_back(i, grid->conditionsCount(i) / 2);
+            linearTree->splits_.emplace_back(grid->origFeatureIndex(i), grid->borders(i)[grid->conditionsCount(i) / 2]);
+            usedFeatures.push_back(grid->origFeatureIndex(i));
+        }
+        Vec values(1 << features.size());
+        for (int64_t leaf = 0; leaf < values.dim(); ++leaf) {
+            values.arrayRef()[leaf] = 2.0 * std::rand() / RAND_MAX - 1.0;
+            Eigen::MatrixXd w(leaf % 2 ? usedFeatures.size() : 1, 1);
+            for (int64_t k = 0; k < w.size(); ++k) {
+                w(k, 0) = 2.0 * std::rand() / RAND_MAX - 1.0;
+            }
+            std::vector<int32_t> leafFeatures(usedFeatures.begin(), usedFeatures.begin() + w.size());
+            linearTree->leaves_.emplace_back(leafFeatures, w, 1.0 + leaf);
+        }
+        linearTree->scale_ = 0.25;
+        trees.push_back(std::make_shared<ObliviousTree>(grid, features, values));
+        linearTrees.push_back(linearTree);
+    }
+
+    const auto path = createTempFile("_model.bin");
+    for (const auto& models : {trees, linearTrees}) {
+        auto ensemble = std::make_shared<Ensemble>(models, 0.5);
+        saveModelBinary(ensemble, path);
+        ASSERT_TRUE(isModelBinary(path));
+
+        auto loaded = std::dynamic_pointer_cast<Ensemble>(loadModelBinary(path));
+        ASSERT_TRUE(loaded != nullptr);
+        EXPECT_EQ(loaded->size(), ensemble->size());
+        EXPECT_EQ(loaded->scale(), ensemble->scale());
+
+        Vec expected(ds.samplesCount());
+        ensemble->apply(ds, Mx(expected, ds.samplesCount(), 1));
+        Vec fromLoaded(ds.samplesCount());
+        loaded->apply(ds, Mx(fromLoaded, ds.samplesCount(), 1));
+        for (int64_t i = 0; i < ds.samplesCount(); ++i) {
+            EXPECT_EQ(fromLoaded.get(i), expected.get(i));
+        }
+    }
+
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(-1, std::ios::end);
+        file.put(42);
+    }
+    EXPECT_THROW(loadModelBinary(path), std::exception);
+
+    //header fields are covered by checksum too: ensemble scale is changed in place
+    saveModelBinary(std::make_shared<Ensemble>(trees, 0.5), path);
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        char header[64];
+        file.read(header, sizeof(header));
+        const double scale = 0.5;
+        auto scalePos = std::search(header, header + sizeof(header),
+                                    reinterpret_cast<const char*>(&scale), reinterpret_cast<const char*>(&scale + 1));
+        ASSERT_NE(scalePos, header + sizeof(header));
+        const double corrupted = 2.0;
+        file.seekp(scalePos - header);
+        file.write(reinterpret_cast<const char*>(&corrupted), sizeof(corrupted));
+    }
+    EXPECT_THROW(loadModelBinary(path, false), std::exception);
+    std::remove(path.c_str());
+}
+
 TEST(FeaturesTxt, Gradient) {
     auto ds = loadFeaturesTxt("../../../../test_data/featuresTxt/test");
     std::cout << ds.samplesCount() << std::endl;
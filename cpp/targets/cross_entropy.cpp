@@ -1,6 +1,8 @@
 #include "cross_entropy.h"
+#include "pointwise_kernels.h"
 #include <vec_tools/transform.h>
 #include <vec_tools/stats.h>
+#include <util/exception.h>
 
 
 inline void crossEntropyGradient(const Vec& target, const Vec& point, Vec to) {
@@ -10,6 +12,12 @@ inline void crossEntropyGradient(const Vec& target, const Vec& point, Vec to) {
 }
 
 void CrossEntropy::subsetDer(const Vec& point, const Buffer<int32_t>& indices, Vec to) const {
+    assert(indices.size() == to.dim());
+    if (isCpuContiguous(point, target_, indices, to)) {
+        PointwiseKernels::crossEntropyDer(target_.arrayRef().data(), point.arrayRef().data(), indices.arrayRef().data(),
+                                          indices.size(), to.arrayRef().data(), nullptr);
+        return;
+    }
     Vec gatheredPoint(indices.size());
     Vec gatheredTarget(indices.size());
     VecTools::gather(point, indices, gatheredPoint);
@@ -17,13 +25,37 @@ void CrossEntropy::subsetDer(const Vec& point, const Buffer<int32_t>& indices, V
     crossEntropyGradient(gatheredTarget, gatheredPoint, to);
 }
 
+void CrossEntropy::derAndDer2(const Vec& point, const Buffer<uint32_t>& indices, Vec derTo, Vec der2To) const {
+    VERIFY(isCpuContiguous(point, target_, indices, derTo, der2To), "error: der2 is implemented for cpu only");
+    PointwiseKernels::crossEntropyDer(target_.arrayRef().data(), point.arrayRef().data(),
+                                      reinterpret_cast<const int32_t*>(indices.arrayRef().data()), indices.size(),
+                                      derTo.arrayRef().data(), der2To.arrayRef().data());
+}
+
+void CrossEntropy::der2(const Vec& point, const Buffer<uint32_t>& indices, Vec to) const {
+    VERIFY(isCpuContiguous(point, target_, indices, to), "error: der2 is implemented for cpu only");
+    PointwiseKernels::crossEntropyDer(target_.arrayRef().data(), point.arrayRef().data(),
+                                      reinterpret_cast<const int32_t*>(indices.arrayRef().data()), indices.size(),
+                                      nullptr, to.arrayRef().data());
+}
+
 Vec CrossEntropy::gradientTo(const Vec& x, Vec to) const {
+    if (isCpuContiguous(x, target_, to)) {
+        PointwiseKernels::crossEntropyDer(target_.arrayRef().data(), x.arrayRef().data(), nullptr, x.dim(),
+                                          to.arrayRef().data(), nullptr);
+        return to;
+    }
     crossEntropyGradient(target_, x, to);
     return to;
 }
 
 
 DoubleRef CrossEntropy::valueTo(const Vec& x, DoubleRef to) const {
+    //t * log(s(x)) + (1.0 - t) * log(1.0 - s(x)) = t * x - log(1.0 + exp(x))
+    if (isCpuContiguous(x, target_)) {
+        to = PointwiseKernels::crossEntropySum(target_.arrayRef().data(), x.arrayRef().data(), x.dim()) / x.dim();
+        return to;
+    }
     auto tmp = VecTools::expCopy(x);
     tmp += 1;
     VecTools::log(tmp);
@@ -6,7 +6,7 @@
 #include <vec_tools/fill.h>
 
 class CrossEntropy :  public Stub<Target, CrossEntropy>,
-                      public  PointwiseTarget {
+                      public  PointwiseC2Target {
 public:
 
     CrossEntropy(const DataSet& ds,
@@ -37,6 +37,10 @@ public:
 
     void subsetDer(const Vec& point, const Buffer<int32_t>& indices, Vec to) const override;
 
+    void derAndDer2(const Vec& point, const Buffer<uint32_t>& indices, Vec derTo, Vec der2To) const override;
+
+    void der2(const Vec& point, const Buffer<uint32_t>& indices, Vec to) const override;
+
     DoubleRef valueTo(const Vec& x, DoubleRef to) const;
 
     Vec targets() const override {
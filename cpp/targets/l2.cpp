@@ -1,11 +1,11 @@
 #include "l2.h"
 
 void L2::makeStats(Buffer<L2Stat>* stats, Buffer<int32_t>* indices) const {
-    (*stats) = Buffer<L2Stat>(nzTargets_.dim());
+    (*stats) = Buffer<L2Stat>::createUninitialized(nzTargets_.dim());
     if (nzIndices_.size()) {
         (*indices) = nzIndices_.copy();
     } else {
-        (*indices) = Buffer<int32_t>(nzTargets_.dim());
+        (*indices) = Buffer<int32_t>::createUninitialized(nzTargets_.dim());
         auto indicesRef = indices->arrayRef();
         for (uint32_t i = 0; i < indicesRef.size(); ++i) {
             indicesRef[i] = i;
@@ -34,13 +34,19 @@ void L2::subsetDer(const Vec& point, const Buffer<int32_t>& indices, Vec to) con
     assert(point.dim() == nzTargets_.dim());
     assert(indices.size() == to.dim());
 
-    auto destArrayRef = to.arrayRef();
-    auto targetArrayRef = nzTargets_.arrayRef();
-    auto indicesArrayRef = indices.arrayRef();
-    auto sourceArrayRef = point.arrayRef();
+    PointwiseKernels::l2Der(nzTargets_.arrayRef().data(), point.arrayRef().data(), indices.arrayRef().data(),
+                            indices.size(), 1.0f, to.arrayRef().data(), nullptr);
+}
 
-    for (int64_t i = 0; i < indices.size(); ++i) {
-        const int32_t idx = indicesArrayRef[i];
-        destArrayRef[i] =  targetArrayRef[idx]  -  sourceArrayRef[idx];
-    }
+void L2::derAndDer2(const Vec& point, const Buffer<uint32_t>& indices, Vec derTo, Vec der2To) const {
+    assert(point.dim() == nzTargets_.dim());
+    PointwiseKernels::l2Der(nzTargets_.arrayRef().data(), point.arrayRef().data(),
+                            reinterpret_cast<const int32_t*>(indices.arrayRef().data()), indices.size(), 1.0f,
+                            derTo.arrayRef().data(), der2To.arrayRef().data());
+}
+
+void L2::der2(const Vec& point, const Buffer<uint32_t>& indices, Vec to) const {
+    PointwiseKernels::l2Der(nzTargets_.arrayRef().data(), point.arrayRef().data(),
+                            reinterpret_cast<const int32_t*>(indices.arrayRef().data()), indices.size(), 1.0f,
+                            nullptr, to.arrayRef().data());
 }
@@ -2,6 +2,7 @@
 
 #include "target.h"
 #include "stat_based_loss.h"
+#include "pointwise_kernels.h"
 #include <vec_tools/transform.h>
 #include <vec_tools/distance.h>
 #include <vec_tools/stats.h>
@@ -80,7 +81,7 @@ using ScoreFunction = LogL2Score;
 
 class L2 :  public Stub<Target, L2>,
             public StatBasedLoss<L2Stat>,
-            public PointwiseTarget {
+            public PointwiseC2Target {
 public:
 
     explicit L2(const DataSet& ds, Vec target, ScoreFunction scoreFunction = ScoreFunction())
@@ -147,10 +148,18 @@ public:
 
     void subsetDer(const Vec& point, const Buffer<int32_t>& indices, Vec to) const override;
 
+    void derAndDer2(const Vec& point, const Buffer<uint32_t>& indices, Vec derTo, Vec der2To) const override;
+
+    void der2(const Vec& point, const Buffer<uint32_t>& indices, Vec to) const override;
+
     DoubleRef valueTo(const Vec& x, DoubleRef to) const {
         assert(nzWeights_.dim() == 0);
         assert(nzIndices_.size() == 0);
-        to = VecTools::sum((x - nzTargets_) ^ 2);
+        if (isCpuContiguous(x, nzTargets_)) {
+            to = PointwiseKernels::l2Sum(nzTargets_.arrayRef().data(), x.arrayRef().data(), x.dim());
+        } else {
+            to = VecTools::sum((x - nzTargets_) ^ 2);
+        }
         to /= x.dim();
         to = sqrt(to);
         return to;
@@ -3,6 +3,7 @@
 #include "target.h"
 #include "stat_based_loss.h"
 #include "linear_l2_stat.h"
+#include "pointwise_kernels.h"
 
 #include <core/vec_factory.h>
 #include <core/vec.h>
@@ -69,6 +70,39 @@ public:
         return -targetValue;
     }
 
+    // same as score for every stat of batch, solves all systems at once. Destroys batch XTX
+    void scoreBatch(LinearL2StatBatch& batch, double* scores) const {
+        const int64_t n = batch.count();
+        batch.solve(lambda_);
+
+        const double* w = batch.w();
+        const double* sumY = batch.sumY();
+        // scores accumulate linear part first
+        std::fill(scores, scores + n, 0.0);
+        for (int f = 0; f < batch.size(); ++f) {
+            const double* wHat = batch.wHat(f);
+            const double* xty = batch.xty(f);
+            const double* sumX = batch.sumX(f);
+            for (int64_t i = 0; i < n; ++i) {
+                const double meanY = w[i] > 0 ? sumY[i] / w[i] : 0.0;
+                scores[i] += wHat[i] * (xty[i] - meanY * sumX[i]);
+            }
+        }
+
+        for (int64_t i = 0; i < n; ++i) {
+            if (w[i] < 2) {
+                scores[i] = 0;
+                continue;
+            }
+            double wHatNorm2 = 0;
+            for (int f = 0; f < batch.size(); ++f) {
+                wHatNorm2 += batch.wHat(f)[i] * batch.wHat(f)[i];
+            }
+            const double scoreFromConst = sumY[i] * sumY[i] / w[i];
+            scores[i] = -(scoreFromConst + scores[i] - lambda_ * std::sqrt(wHatNorm2));
+        }
+    }
+
 private:
     double lambda_ = 1;
 };
@@ -79,7 +113,7 @@ using LinearL2ScoreFunction = LinearL2LogScore;
 
 class LinearL2 : public Stub<Target, LinearL2>,
                  public StatBasedLoss<LinearL2Stat>,
-                 public PointwiseTarget {
+                 public PointwiseC2Target {
 public:
     LinearL2(const DataSet& ds, Vec target, double l2reg)
             : Stub<Target, LinearL2>(ds)
@@ -123,19 +157,29 @@ public:
         return scoreFunction_.score(comb);
     }
 
+    void scoreBatch(LinearL2StatBatch& batch, double* scores) const {
+        scoreFunction_.scoreBatch(batch, scores);
+    }
+
     void subsetDer(const Vec& point, const Buffer<int32_t>& indices, Vec to) const override {
         assert(point.dim() == nzTargets_.dim());
         assert(indices.size() == to.dim());
 
-        auto destArrayRef = to.arrayRef();
-        auto targetArrayRef = nzTargets_.arrayRef();
-        auto indicesArrayRef = indices.arrayRef();
-        auto sourceArrayRef = point.arrayRef();
+        PointwiseKernels::l2Der(nzTargets_.arrayRef().data(), point.arrayRef().data(), indices.arrayRef().data(),
+                                indices.size(), 2.0f, to.arrayRef().data(), nullptr);
+    }
 
-        for (int64_t i = 0; i < indices.size(); ++i) {
-            const int32_t idx = indicesArrayRef[i];
-            destArrayRef[i] = 2 * (targetArrayRef[idx] - sourceArrayRef[idx]);
-        }
+    void derAndDer2(const Vec& point, const Buffer<uint32_t>& indices, Vec derTo, Vec der2To) const override {
+        assert(point.dim() == nzTargets_.dim());
+        PointwiseKernels::l2Der(nzTargets_.arrayRef().data(), point.arrayRef().data(),
+                                reinterpret_cast<const int32_t*>(indices.arrayRef().data()), indices.size(), 2.0f,
+                                derTo.arrayRef().data(), der2To.arrayRef().data());
+    }
+
+    void der2(const Vec& point, const Buffer<uint32_t>& indices, Vec to) const override {
+        PointwiseKernels::l2Der(nzTargets_.arrayRef().data(), point.arrayRef().data(),
+                                reinterpret_cast<const int32_t*>(indices.arrayRef().data()), indices.size(), 2.0f,
+                                nullptr, to.arrayRef().data());
     }
 
     class Der : public Stub<Trans, Der> {
@@ -162,7 +206,11 @@ public:
     DoubleRef valueTo(const Vec& x, DoubleRef to) const {
         assert(nzWeights_.dim() == 0);
         assert(nzIndices_.size() == 0);
-        to = VecTools::sum((x - nzTargets_) ^ 2);
+        if (isCpuContiguous(x, nzTargets_)) {
+            to = PointwiseKernels::l2Sum(nzTargets_.arrayRef().data(), x.arrayRef().data(), x.dim());
+        } else {
+            to = VecTools::sum((x - nzTargets_) ^ 2);
+        }
         to /= x.dim();
         to = sqrt(to);
         return to;
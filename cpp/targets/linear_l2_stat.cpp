@@ -1,11 +1,73 @@
 #include "linear_l2_stat.h"
 
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define LINEAR_L2_X86_SIMD
+#include <immintrin.h>
+#endif
+
 
 namespace {
-    void vectorizedAdd(float* dst, const float* src, int size) {
-        int i;
+
+#ifdef LINEAR_L2_X86_SIMD
+    bool hasAvx2() {
+        static const bool result = []() {
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        }();
+        return result;
+    }
+
+    __attribute__((target("avx2")))
+    void vectorizedAddAvx2(float* dst, const float* src, int64_t size) {
+        int64_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), _mm256_loadu_ps(src + i)));
+        }
+        for (; i < size; ++i) {
+            dst[i] += src[i];
+        }
+    }
+
+    __attribute__((target("avx2,fma")))
+    void vectorizedScaleAddAvx2(float* dst, const float* src, float m, int size) {
+        const __m256 mv = _mm256_set1_ps(m);
+        int i = 0;
+        for (; i + 8 <= size; i += 8) {
+            _mm256_storeu_ps(dst + i, _mm256_fmadd_ps(mv, _mm256_loadu_ps(src + i), _mm256_loadu_ps(dst + i)));
+        }
+        for (; i < size; ++i) {
+            dst[i] += m * src[i];
+        }
+    }
+
+    __attribute__((target("avx2")))
+    void vectorizedAddDiffAvx2(float* dst, const float* a, const float* b, int64_t size) {
+        int64_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            const __m256 diff = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+            _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), diff));
+        }
+        for (; i < size; ++i) {
+            dst[i] += a[i] - b[i];
+        }
+    }
+#endif
+
+    void vectorizedAdd(float* dst, const float* src, int64_t size) {
+#ifdef LINEAR_L2_X86_SIMD
+        if (hasAvx2()) {
+            vectorizedAddAvx2(dst, src, size);
+            return;
+        }
+#endif
+        int64_t i;
         for (i = 0; i <= size - 4; i += 4) {
-            for (int j = i; j < i + 4; ++j) {
+            for (int64_t j = i; j < i + 4; ++j) {
                 dst[j] += src[j];
             }
         }
@@ -14,7 +76,17 @@ namespace {
         }
     }
 
+    int triangleSize(int size) {
+        return size * (size + 1) / 2;
+    }
+
     void vectorizedScaleAdd(float* dst, const float* src, float m, int size) {
+#ifdef LINEAR_L2_X86_SIMD
+        if (hasAvx2()) {
+            vectorizedScaleAddAvx2(dst, src, m, size);
+            return;
+        }
+#endif
         int i;
         for (i = 0; i <= size - 4; i += 4) {
             for (int j = i; j < i + 4; ++j) {
@@ -38,6 +110,24 @@ namespace {
         }
     }
 
+    void vectorizedAddDiff(float* dst, const float* a, const float* b, int64_t size) {
+#ifdef LINEAR_L2_X86_SIMD
+        if (hasAvx2()) {
+            vectorizedAddDiffAvx2(dst, a, b, size);
+            return;
+        }
+#endif
+        int64_t i;
+        for (i = 0; i <= size - 4; i += 4) {
+            for (int64_t j = i; j < i + 4; ++j) {
+                dst[j] += a[j] - b[j];
+            }
+        }
+        for (; i < size; ++i) {
+            dst[i] += a[i] - b[i];
+        }
+    }
+
     void vectorizedScaleRm(float* dst, const float* src, float m, int size) {
         int i;
         for (i = 0; i <= size - 4; i += 4) {
@@ -332,6 +422,280 @@ LinearL2Stat::EMx LinearL2Stat::getWHat(double l2reg, int size) const {
     return XTX.inverse() * getXTy(size);
 }
 
+// LinearL2StatArena
+
+
+LinearL2StatArena::LinearL2StatArena(int64_t cellsCount, int maxSize)
+        : cellsCount_(cellsCount)
+        , maxSize_(maxSize)
+        , stride_(cellSize(maxSize))
+        , data_(cellsCount * stride_, 0.0f) {
+
+}
+
+void LinearL2StatArena::reset(int64_t firstCell, int64_t count) {
+    std::fill_n(cellData(firstCell), count * stride_, 0.0f);
+}
+
+void LinearL2StatArena::addFullCorrelation(int64_t cell, const float* x, float y, float w, int filledSize) {
+    assert(filledSize <= maxSize_);
+    float* data = cellData(cell);
+    const float yw = y * w;
+    data[WeightPos] += w;
+    data[SumYPos] += yw;
+    data[SumY2Pos] += yw * y;
+
+    for (int i = 0; i < filledSize; ++i) {
+        float* feature = data + featurePos(i);
+        feature[0] += w * x[i];
+        feature[1] += yw * x[i];
+        vectorizedScaleAdd(feature + 2, x, x[i] * w, i + 1);
+    }
+}
+
+void LinearL2StatArena::addNewCorrelation(int64_t cell, const float* xtx, float xty, float sumX, int corPos) {
+    assert(corPos < maxSize_);
+    float* feature = cellData(cell) + featurePos(corPos);
+    feature[0] += sumX;
+    feature[1] += xty;
+    vectorizedAdd(feature + 2, xtx, corPos + 1);
+}
+
+void LinearL2StatArena::addNewCorrelationDifference(int64_t cell,
+                                                    const LinearL2StatArena& a, int64_t aCell,
+                                                    const LinearL2StatArena& b, int64_t bCell,
+                                                    int corPos) {
+    assert(corPos < maxSize_ && corPos < a.maxSize_ && corPos < b.maxSize_);
+    const int pos = featurePos(corPos);
+    vectorizedAddDiff(cellData(cell) + pos, a.cellData(aCell) + pos, b.cellData(bCell) + pos, corPos + 3);
+}
+
+void LinearL2StatArena::add(int64_t dstCell, const LinearL2StatArena& src, int64_t srcCell, int64_t count) {
+    assert(stride_ == src.stride_);
+    vectorizedAdd(cellData(dstCell), src.cellData(srcCell), count * stride_);
+}
+
+void LinearL2StatArena::copy(int64_t dstCell, const LinearL2StatArena& src, int64_t srcCell, int64_t count) {
+    if (stride_ == src.stride_) {
+        std::copy_n(src.cellData(srcCell), count * stride_, cellData(dstCell));
+        return;
+    }
+    const int64_t copySize = std::min(stride_, src.stride_);
+    for (int64_t i = 0; i < count; ++i) {
+        float* dst = cellData(dstCell + i);
+        std::copy_n(src.cellData(srcCell + i), copySize, dst);
+        std::fill(dst + copySize, dst + stride_, 0.0f);
+    }
+}
+
+void LinearL2StatArena::addDifference(int64_t dstCell,
+                                      const LinearL2StatArena& a, int64_t aCell,
+                                      const LinearL2StatArena& b, int64_t bCell,
+                                      int64_t count, int opSize) {
+    if (opSize >= maxSize_ && stride_ == a.stride_ && stride_ == b.stride_) {
+        vectorizedAddDiff(cellData(dstCell), a.cellData(aCell), b.cellData(bCell), count * stride_);
+        return;
+    }
+    opSize = std::min(opSize, maxSize_);
+    assert(opSize <= a.maxSize_ && opSize <= b.maxSize_);
+    const int64_t size = cellSize(opSize);
+    for (int64_t i = 0; i < count; ++i) {
+        vectorizedAddDiff(cellData(dstCell + i), a.cellData(aCell + i), b.cellData(bCell + i), size);
+    }
+}
+
+void LinearL2StatArena::fill(int64_t cell, int size, LinearL2Stat* stat) const {
+    assert(size <= stat->size_ && size <= maxSize_);
+    const float* data = cellData(cell);
+    stat->w_ = data[WeightPos];
+    stat->sumY_ = data[SumYPos];
+    stat->sumY2_ = data[SumY2Pos];
+    for (int i = 0; i < size; ++i) {
+        const float* feature = data + featurePos(i);
+        stat->sumX_[i] = feature[0];
+        stat->xty_[i] = feature[1];
+        std::copy_n(feature + 2, i + 1, stat->xtx_.begin() + triangleSize(i));
+    }
+    stat->setFilledSize(size);
+}
+
+void LinearL2StatArena::fillDifference(int64_t cell, int64_t otherCell, int size, LinearL2Stat* stat) const {
+    assert(size <= stat->size_ && size <= maxSize_);
+    const float* data = cellData(cell);
+    const float* other = cellData(otherCell);
+    stat->w_ = data[WeightPos] - other[WeightPos];
+    stat->sumY_ = data[SumYPos] - other[SumYPos];
+    stat->sumY2_ = data[SumY2Pos] - other[SumY2Pos];
+    for (int i = 0; i < size; ++i) {
+        const int pos = featurePos(i);
+        stat->sumX_[i] = data[pos] - other[pos];
+        stat->xty_[i] = data[pos + 1] - other[pos + 1];
+        const int xtxRow = triangleSize(i);
+        for (int j = 0; j <= i; ++j) {
+            stat->xtx_[xtxRow + j] = data[pos + 2 + j] - other[pos + 2 + j];
+        }
+    }
+    stat->setFilledSize(size);
+}
+
+
+// LinearL2CorStatArena
+
+
+LinearL2CorStatArena::LinearL2CorStatArena(int64_t cellsCount, int maxSize)
+        : cellsCount_(cellsCount)
+        , stride_(cellSize(maxSize))
+        , data_(cellsCount * stride_, 0.0f) {
+
+}
+
+void LinearL2CorStatArena::reset(int64_t firstCell, int64_t count) {
+    std::fill_n(cellData(firstCell), count * stride_, 0.0f);
+}
+
+void LinearL2CorStatArena::append(int64_t cell, const float* x, float y, float weight, float fVal, int filledSize) {
+    float* data = cellData(cell);
+    const float wf = weight * fVal;
+    float* xxt = data + ScalarsCount;
+    vectorizedScaleAdd(xxt, x, wf, filledSize - 1);
+    xxt[filledSize - 1] += fVal * wf;
+    data[XyPos] += y * wf;
+    data[SumXPos] += wf;
+}
+
+void LinearL2CorStatArena::add(int64_t dstCell, const LinearL2CorStatArena& src, int64_t srcCell, int64_t count) {
+    assert(stride_ == src.stride_);
+    vectorizedAdd(cellData(dstCell), src.cellData(srcCell), count * stride_);
+}
+
+
+// LinearL2StatBatch
+
+
+LinearL2StatBatch::LinearL2StatBatch(int64_t capacity, int maxSize)
+        : capacity_(capacity)
+        , maxSize_(maxSize)
+        , data_((ScalarRows + 4 * maxSize + triangleSize(maxSize)) * capacity, 0.0) {
+
+}
+
+void LinearL2StatBatch::clear(int size) {
+    assert(size <= maxSize_);
+    size_ = size;
+    count_ = 0;
+}
+
+void LinearL2StatBatch::add(const LinearL2StatArena& arena, int64_t cell) {
+    assert(count_ < capacity_ && size_ <= arena.maxSize_);
+    const float* data = arena.cellData(cell);
+    const int64_t i = count_++;
+    row(WeightRow)[i] = data[LinearL2StatArena::WeightPos];
+    row(SumYRow)[i] = data[LinearL2StatArena::SumYPos];
+    for (int f = 0; f < size_; ++f) {
+        const float* feature = data + LinearL2StatArena::featurePos(f);
+        row(sumXRow(f))[i] = feature[0];
+        row(xtyRow(f))[i] = feature[1];
+        for (int c = 0; c <= f; ++c) {
+            row(xtxRow(f, c))[i] = feature[2 + c];
+        }
+    }
+}
+
+void LinearL2StatBatch::addDifference(const LinearL2StatArena& arena, int64_t cell, int64_t otherCell) {
+    assert(count_ < capacity_ && size_ <= arena.maxSize_);
+    const float* data = arena.cellData(cell);
+    const float* other = arena.cellData(otherCell);
+    const int64_t i = count_++;
+    row(WeightRow)[i] = data[LinearL2StatArena::WeightPos] - other[LinearL2StatArena::WeightPos];
+    row(SumYRow)[i] = data[LinearL2StatArena::SumYPos] - other[LinearL2StatArena::SumYPos];
+    for (int f = 0; f < size_; ++f) {
+        const int pos = LinearL2StatArena::featurePos(f);
+        row(sumXRow(f))[i] = data[pos] - other[pos];
+        row(xtyRow(f))[i] = data[pos + 1] - other[pos + 1];
+        for (int c = 0; c <= f; ++c) {
+            row(xtxRow(f, c))[i] = data[pos + 2 + c] - other[pos + 2 + c];
+        }
+    }
+}
+
+void LinearL2StatBatch::solve(double l2reg) {
+    //pivots below this part of regularized diagonal are treated as zero
+    constexpr double PivotEps = 1e-9;
+    const int64_t n = count_;
+
+    // Cholesky L L^T = XTX + l2reg * I in place, row r borders factor of leading r x r block
+    for (int r = 0; r < size_; ++r) {
+        for (int c = 0; c <= r; ++c) {
+            double* a = row(xtxRow(r, c));
+            if (c == r) {
+                double* diag = row(DiagRow);
+                for (int64_t i = 0; i < n; ++i) {
+                    diag[i] = a[i] + l2reg;
+                }
+            }
+            for (int t = 0; t < c; ++t) {
+                const double* lr = row(xtxRow(r, t));
+                const double* lc = row(xtxRow(c, t));
+                for (int64_t i = 0; i < n; ++i) {
+                    a[i] -= lr[i] * lc[i];
+                }
+            }
+            if (c < r) {
+                const double* invDiag = row(invDiagRow(c));
+                for (int64_t i = 0; i < n; ++i) {
+                    a[i] *= invDiag[i];
+                }
+            } else {
+                const double* diag = row(DiagRow);
+                double* invDiag = row(invDiagRow(r));
+                for (int64_t i = 0; i < n; ++i) {
+                    const double pivot = a[i] + l2reg;
+                    const bool valid = pivot > PivotEps * std::abs(diag[i]);
+                    a[i] = valid ? std::sqrt(pivot) : 0.0;
+                    invDiag[i] = valid ? 1.0 / a[i] : 0.0;
+                }
+            }
+        }
+    }
+
+    // L z = XTy
+    for (int r = 0; r < size_; ++r) {
+        double* z = row(wHatRow(r));
+        const double* b = row(xtyRow(r));
+        for (int64_t i = 0; i < n; ++i) {
+            z[i] = b[i];
+        }
+        for (int t = 0; t < r; ++t) {
+            const double* l = row(xtxRow(r, t));
+            const double* zt = row(wHatRow(t));
+            for (int64_t i = 0; i < n; ++i) {
+                z[i] -= l[i] * zt[i];
+            }
+        }
+        const double* invDiag = row(invDiagRow(r));
+        for (int64_t i = 0; i < n; ++i) {
+            z[i] *= invDiag[i];
+        }
+    }
+
+    // L^T wHat = z
+    for (int r = size_ - 1; r >= 0; --r) {
+        double* w = row(wHatRow(r));
+        for (int t = r + 1; t < size_; ++t) {
+            const double* l = row(xtxRow(t, r));
+            const double* wt = row(wHatRow(t));
+            for (int64_t i = 0; i < n; ++i) {
+                w[i] -= l[i] * wt[i];
+            }
+        }
+        const double* invDiag = row(invDiagRow(r));
+        for (int64_t i = 0; i < n; ++i) {
+            w[i] *= invDiag[i];
+        }
+    }
+}
+
+
 LinearL2GridStat::LinearL2GridStat(int nBins, int size, int filledSize)
         : nBins_(nBins)
         , size_(size)
@@ -130,6 +130,247 @@ inline std::ostream& operator<<(std::ostream& os, const LinearL2Stat& s) {
     return os;
 }
 
+/*
+ * LinearL2Stat of many cells (e.g. leaves x bins) in one slab.
+ * Cell is fixed-stride record [w, sumY, sumY2, then per feature i: sumX[i], xty[i], row i of xtx (i + 1 values)],
+ * so ranges of cells are added or subtracted as one flat vector, and sample update touches one record.
+ * Stats of first n features are a prefix of record of the same size for any maxSize, so arenas
+ * of different maxSize (e.g. small leaf arenas and scratch of max depth) are copied and subtracted prefix-wise.
+ * Unused tail of record stays zero, so ops on whole records are equivalent to ops on filled parts
+ */
+class LinearL2StatArena {
+public:
+    LinearL2StatArena() = default;
+
+    LinearL2StatArena(int64_t cellsCount, int maxSize);
+
+    //floats per cell
+    static int64_t cellSize(int maxSize) {
+        return featurePos(maxSize);
+    }
+
+    int64_t cellsCount() const {
+        return cellsCount_;
+    }
+
+    int maxSize() const {
+        return maxSize_;
+    }
+
+    float weight(int64_t cell) const {
+        return cellData(cell)[WeightPos];
+    }
+
+    void reset(int64_t firstCell, int64_t count);
+
+    void addFullCorrelation(int64_t cell, const float* x, float y, float w, int filledSize);
+
+    //adds row corPos of xtx (corPos + 1 values) and corPos-th elements of xty and sumX
+    void addNewCorrelation(int64_t cell, const float* xtx, float xty, float sumX, int corPos);
+
+    //same for row corPos of a - b
+    void addNewCorrelationDifference(int64_t cell,
+                                     const LinearL2StatArena& a, int64_t aCell,
+                                     const LinearL2StatArena& b, int64_t bCell,
+                                     int corPos);
+
+    //cells [dstCell, dstCell + count) += src cells [srcCell, srcCell + count), arenas have the same maxSize
+    void add(int64_t dstCell, const LinearL2StatArena& src, int64_t srcCell, int64_t count);
+
+    //src may have other maxSize: common prefix is copied, rest of dst is zeroed
+    void copy(int64_t dstCell, const LinearL2StatArena& src, int64_t srcCell, int64_t count);
+
+    //dst += a - b, only first opSize features are updated (weights and sums of y always are).
+    //a and b may have other maxSize if they hold first opSize features
+    void addDifference(int64_t dstCell,
+                       const LinearL2StatArena& a, int64_t aCell,
+                       const LinearL2StatArena& b, int64_t bCell,
+                       int64_t count, int opSize);
+
+    //cell as LinearL2Stat of given size. stat should be created with size >= size
+    void fill(int64_t cell, int size, LinearL2Stat* stat) const;
+
+    //stat = cell - otherCell
+    void fillDifference(int64_t cell, int64_t otherCell, int size, LinearL2Stat* stat) const;
+
+private:
+    friend class LinearL2StatBatch;
+
+    float* cellData(int64_t cell) {
+        return data_.data() + cell * stride_;
+    }
+
+    const float* cellData(int64_t cell) const {
+        return data_.data() + cell * stride_;
+    }
+
+    //offset of [sumX[i], xty[i], row i of xtx] in cell
+    static int featurePos(int i) {
+        return ScalarsCount + 2 * i + i * (i + 1) / 2;
+    }
+
+private:
+    static constexpr int WeightPos = 0;
+    static constexpr int SumYPos = 1;
+    static constexpr int SumY2Pos = 2;
+    static constexpr int ScalarsCount = 3;
+
+    int64_t cellsCount_ = 0;
+    int maxSize_ = 0;
+    int64_t stride_ = 0;
+    std::vector<float> data_;
+};
+
+/*
+ * LinearL2CorStat of many cells in one slab: fixed-stride records [xy, sumX, xxt[maxSize]]
+ */
+class LinearL2CorStatArena {
+public:
+    LinearL2CorStatArena() = default;
+
+    LinearL2CorStatArena(int64_t cellsCount, int maxSize);
+
+    //floats per cell
+    static int64_t cellSize(int maxSize) {
+        return ScalarsCount + maxSize;
+    }
+
+    int64_t cellsCount() const {
+        return cellsCount_;
+    }
+
+    void reset(int64_t firstCell, int64_t count);
+
+    //same as LinearL2CorStat::append: first filledSize - 1 correlations with x, the last one with fVal
+    void append(int64_t cell, const float* x, float y, float weight, float fVal, int filledSize);
+
+    void add(int64_t dstCell, const LinearL2CorStatArena& src, int64_t srcCell, int64_t count);
+
+    const float* xxt(int64_t cell) const {
+        return cellData(cell) + ScalarsCount;
+    }
+
+    float xy(int64_t cell) const {
+        return cellData(cell)[XyPos];
+    }
+
+    float sumX(int64_t cell) const {
+        return cellData(cell)[SumXPos];
+    }
+
+private:
+    float* cellData(int64_t cell) {
+        return data_.data() + cell * stride_;
+    }
+
+    const float* cellData(int64_t cell) const {
+        return data_.data() + cell * stride_;
+    }
+
+private:
+    static constexpr int XyPos = 0;
+    static constexpr int SumXPos = 1;
+    static constexpr int ScalarsCount = 2;
+
+    int64_t cellsCount_ = 0;
+    int64_t stride_ = 0;
+    std::vector<float> data_;
+};
+
+/*
+ * Many stats of one size in SoA layout for batched solves: every field is a row of capacity values,
+ * value of i-th stat is at row[i], so solver kernels go over stats in inner loops.
+ * Cholesky factor is built row by row (bordered), i.e. factor of leading block is complete
+ * before the next feature is added
+ */
+class LinearL2StatBatch {
+public:
+    LinearL2StatBatch(int64_t capacity, int maxSize);
+
+    //drops stats, next ones are of given size
+    void clear(int size);
+
+    void add(const LinearL2StatArena& arena, int64_t cell);
+
+    //cell - otherCell
+    void addDifference(const LinearL2StatArena& arena, int64_t cell, int64_t otherCell);
+
+    //wHat of all stats for (XTX + l2reg * I) wHat = XTy. Destroys XTX.
+    //Degenerate directions (pivot is ~0) get zero weight
+    void solve(double l2reg);
+
+    int size() const {
+        return size_;
+    }
+
+    int64_t count() const {
+        return count_;
+    }
+
+    const double* w() const {
+        return row(WeightRow);
+    }
+
+    const double* sumY() const {
+        return row(SumYRow);
+    }
+
+    const double* sumX(int i) const {
+        return row(sumXRow(i));
+    }
+
+    const double* xty(int i) const {
+        return row(xtyRow(i));
+    }
+
+    //after solve
+    const double* wHat(int i) const {
+        return row(wHatRow(i));
+    }
+
+private:
+    double* row(int64_t r) {
+        return data_.data() + r * capacity_;
+    }
+
+    const double* row(int64_t r) const {
+        return data_.data() + r * capacity_;
+    }
+
+    int sumXRow(int i) const {
+        return ScalarRows + i;
+    }
+
+    int xtyRow(int i) const {
+        return ScalarRows + maxSize_ + i;
+    }
+
+    int wHatRow(int i) const {
+        return ScalarRows + 2 * maxSize_ + i;
+    }
+
+    int invDiagRow(int i) const {
+        return ScalarRows + 3 * maxSize_ + i;
+    }
+
+    //lower triangle, i >= j
+    int xtxRow(int i, int j) const {
+        return ScalarRows + 4 * maxSize_ + i * (i + 1) / 2 + j;
+    }
+
+private:
+    static constexpr int WeightRow = 0;
+    static constexpr int SumYRow = 1;
+    static constexpr int DiagRow = 2;
+    static constexpr int ScalarRows = 3;
+
+    int64_t capacity_;
+    int maxSize_;
+    int size_ = 0;
+    int64_t count_ = 0;
+    std::vector<double> data_;
+};
+
 struct LinearL2GridStatOpParams : public LinearL2StatOpParams {
     int bin = -1;
 };
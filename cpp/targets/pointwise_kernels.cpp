@@ -0,0 +1,125 @@
+#include "pointwise_kernels.h"
+
+#include <util/fast_exp.h>
+#include <util/parallel_executor.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+    //scratch of block lives on stack
+    constexpr int64_t BlockSize = 4096;
+
+    int64_t blocksCount(int64_t size) {
+        return (size + BlockSize - 1) / BlockSize;
+    }
+
+    template <bool Gather>
+    void l2DerBlock(const float* target, const float* point, const int32_t* indices, int64_t first, int64_t size,
+                    float scale, float* der) {
+        for (int64_t i = first; i < first + size; ++i) {
+            const int64_t idx = Gather ? indices[i] : i;
+            der[i] = scale * (target[idx] - point[idx]);
+        }
+    }
+
+    template <bool Gather>
+    void crossEntropyDerBlock(const float* target, const float* point, const int32_t* indices, int64_t first, int64_t size,
+                              float* der, float* der2) {
+        float expArgs[BlockSize];
+        for (int64_t i = 0; i < size; ++i) {
+            const int64_t idx = Gather ? indices[first + i] : first + i;
+            expArgs[i] = -point[idx];
+        }
+        expInPlace(expArgs, size);
+
+        for (int64_t i = 0; i < size; ++i) {
+            const int64_t idx = Gather ? indices[first + i] : first + i;
+            const float p = 1.0f / (1.0f + expArgs[i]);
+            if (der) {
+                der[first + i] = target[idx] - p;
+            }
+            if (der2) {
+                der2[first + i] = -p * (1.0f - p);
+            }
+        }
+    }
+
+    template <class BlockSum>
+    double sumByBlocks(int64_t size, BlockSum&& blockSum) {
+        std::vector<double> partials(blocksCount(size));
+        parallelFor(0, blocksCount(size), [&](int64_t block) {
+            const int64_t first = block * BlockSize;
+            partials[block] = blockSum(first, std::min(BlockSize, size - first));
+        });
+
+        double result = 0;
+        for (double partial : partials) {
+            result += partial;
+        }
+        return result;
+    }
+}
+
+namespace PointwiseKernels {
+
+    void l2Der(const float* target, const float* point, const int32_t* indices, int64_t size, float scale,
+               float* der, float* der2) {
+        parallelFor(0, blocksCount(size), [&](int64_t block) {
+            const int64_t first = block * BlockSize;
+            const int64_t blockSize = std::min(BlockSize, size - first);
+            if (der && indices) {
+                l2DerBlock<true>(target, point, indices, first, blockSize, scale, der);
+            } else if (der) {
+                l2DerBlock<false>(target, point, indices, first, blockSize, scale, der);
+            }
+            if (der2) {
+                std::fill(der2 + first, der2 + first + blockSize, -scale);
+            }
+        });
+    }
+
+    void crossEntropyDer(const float* target, const float* point, const int32_t* indices, int64_t size,
+                         float* der, float* der2) {
+        parallelFor(0, blocksCount(size), [&](int64_t block) {
+            const int64_t first = block * BlockSize;
+            const int64_t blockSize = std::min(BlockSize, size - first);
+            if (indices) {
+                crossEntropyDerBlock<true>(target, point, indices, first, blockSize, der, der2);
+            } else {
+                crossEntropyDerBlock<false>(target, point, indices, first, blockSize, der, der2);
+            }
+        });
+    }
+
+    double l2Sum(const float* target, const float* point, int64_t size) {
+        return sumByBlocks(size, [&](int64_t first, int64_t blockSize) {
+            double sum = 0;
+            for (int64_t i = first; i < first + blockSize; ++i) {
+                const double diff = point[i] - target[i];
+                sum += diff * diff;
+            }
+            return sum;
+        });
+    }
+
+    double crossEntropySum(const float* target, const float* point, int64_t size) {
+        return sumByBlocks(size, [&](int64_t first, int64_t blockSize) {
+            float expArgs[BlockSize];
+            for (int64_t i = 0; i < blockSize; ++i) {
+                expArgs[i] = -std::abs(point[first + i]);
+            }
+            expInPlace(expArgs, blockSize);
+
+            //log(1 + exp(x)) = max(x, 0) + log(1 + exp(-|x|)) doesn't overflow for large x
+            double sum = 0;
+            for (int64_t i = 0; i < blockSize; ++i) {
+                const float x = point[first + i];
+                sum += target[first + i] * x - (std::max(x, 0.0f) + std::log1p(expArgs[i]));
+            }
+            return sum;
+        });
+    }
+
+}
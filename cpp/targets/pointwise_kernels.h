@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+ * Fused kernels of pointwise targets over contiguous cpu arrays. Derivatives gather point and target by indices
+ * (indices could be null for identity) and write der and der2 (any of them could be null) in one pass.
+ * Arrays are processed by blocks in parallel, sums are reduced over blocks in fixed order, so they don't depend on threads
+ */
+namespace PointwiseKernels {
+
+    //der = scale * (target - point), der2 = -scale
+    void l2Der(const float* target, const float* point, const int32_t* indices, int64_t size, float scale,
+               float* der, float* der2);
+
+    //der = target - sigmoid(point), der2 = -sigmoid(point) * (1 - sigmoid(point))
+    void crossEntropyDer(const float* target, const float* point, const int32_t* indices, int64_t size,
+                         float* der, float* der2);
+
+    //sum of (point - target)^2
+    double l2Sum(const float* target, const float* point, int64_t size);
+
+    //sum of target * point - log(1 + exp(point))
+    double crossEntropySum(const float* target, const float* point, int64_t size);
+
+}
@@ -26,6 +26,7 @@ public:
 };
 
 class PointwiseC2Target : public PointwiseTarget {
+public:
 
     virtual void derAndDer2(const Vec& point,
                             const Buffer<uint32_t>& indices,
@@ -36,6 +37,16 @@ class PointwiseC2Target : public PointwiseTarget {
 
 };
 
+//fused pointwise kernels work with contiguous cpu buffers, other buffers go through vec tools
+inline bool isCpuContiguous() {
+    return true;
+}
+
+template <class TBuffer, class... Rest>
+inline bool isCpuContiguous(const TBuffer& buffer, const Rest&... rest) {
+    return buffer.isCpu() && buffer.isContiguous() && isCpuContiguous(rest...);
+}
+
 template <class Impl>
 class Stub<Target, Impl> : public virtual Target, public Stub<FuncC1, Impl> {
 public:
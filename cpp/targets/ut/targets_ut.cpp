@@ -8,8 +8,11 @@
 #include <data/binarized_dataset.h>
 #include <models/oblivious_tree.h>
 #include <targets/l2.h>
+#include <targets/cross_entropy.h>
 
 #include <targets/correlation_stat.h>
+#include <targets/linear_l2_stat.h>
+#include <targets/linear_l2.h>
 
 #define EPS 1e-5
 
@@ -32,6 +35,46 @@ TEST(TargetsTest, TestL2) {
     }
 }
 
+TEST(TargetsTest, TestCrossEntropyDers) {
+    auto ds = loadFeaturesTxt("test_data/featuresTxt/train");
+    CrossEntropy target(ds, 0.5);
+
+    Vec cursor(target.dim());
+    for (int64_t i = 0; i < cursor.dim(); ++i) {
+        cursor.set(i, 40.0 * i / target.dim() - 20.0);
+    }
+
+    std::vector<int32_t> indicesVec;
+    for (int32_t i = 0; i < target.dim(); i += 3) {
+        indicesVec.push_back(i);
+    }
+    auto indices = Buffer<int32_t>::fromVector(indicesVec);
+    auto uIndices = Buffer<uint32_t>::fromVector(std::vector<uint32_t>(indicesVec.begin(), indicesVec.end()));
+
+    Vec subsetDer(indices.size());
+    Vec der(indices.size());
+    Vec der2(indices.size());
+    target.subsetDer(cursor, indices, subsetDer);
+    target.derAndDer2(cursor, uIndices, der, der2);
+
+    double expectedValue = 0;
+    for (int64_t i = 0; i < target.dim(); ++i) {
+        const double x = cursor.get(i);
+        expectedValue += target.targets().get(i) * x - std::log1p(std::exp(x));
+    }
+    double value = 0;
+    target.valueTo(cursor, value);
+    EXPECT_NEAR(value, expectedValue / target.dim(), 1e-5);
+
+    for (int64_t i = 0; i < indices.size(); ++i) {
+        const int32_t idx = indicesVec[i];
+        const double p = 1.0 / (1.0 + std::exp(-cursor.get(idx)));
+        EXPECT_NEAR(subsetDer.get(i), target.targets().get(idx) - p, EPS);
+        EXPECT_NEAR(der.get(i), target.targets().get(idx) - p, EPS);
+        EXPECT_NEAR(der2.get(i), -p * (1 - p), EPS);
+    }
+}
+
 TEST(AdditiveStatTest, CorrelationBinStat) {
     CorrelationBinStat s(4, 4);
 
@@ -50,3 +93,195 @@ TEST(AdditiveStatTest, CorrelationBinStat) {
 
 }
 
+
+TEST(AdditiveStatTest, LinearL2StatArena) {
+    const int maxSize = 4;
+    std::vector<std::vector<float>> x = {
+            {1, 2, 3, 4},
+            {1, 0.2, 0.3, -0.2},
+            {1, .45, 13, -7.1},
+            {1, 3, -.2, .1},
+            {1, 3, 3.3, 3.33},
+    };
+    std::vector<float> y = {1, -2, 0.5, 3, 0.1};
+    std::vector<float> w = {1, 0.5, 2, 1, 1.5};
+
+    LinearL2StatArena arena(3, maxSize);
+    LinearL2Stat stat(maxSize, 0);
+    LinearL2Stat total(maxSize, 2);
+    LinearL2Stat first(maxSize, 2);
+    LinearL2StatOpParams fullParams;
+    fullParams.vecAddMode = LinearL2StatOpParams::FullCorrelation;
+
+    for (int i = 0; i < (int)x.size(); ++i) {
+        arena.addFullCorrelation(1, x[i].data(), y[i], w[i], 2);
+        total.append(x[i].data(), y[i], w[i], fullParams);
+        if (i < 2) {
+            arena.addFullCorrelation(0, x[i].data(), y[i], w[i], 2);
+            first.append(x[i].data(), y[i], w[i], fullParams);
+        }
+    }
+
+    // correlations of third feature
+    LinearL2CorStatArena corArena(1, maxSize);
+    LinearL2CorStat corStat(maxSize, 3);
+    for (int i = 0; i < (int)x.size(); ++i) {
+        LinearL2CorStatOpParams params;
+        params.fVal = x[i][2];
+        corArena.append(0, x[i].data(), y[i], w[i], x[i][2], 3);
+        corStat.append(x[i].data(), y[i], w[i], params);
+    }
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_NEAR(corArena.xxt(0)[i], corStat.xxt[i], EPS);
+    }
+    EXPECT_NEAR(corArena.xy(0), corStat.xy, EPS);
+    EXPECT_NEAR(corArena.sumX(0), corStat.sumX, EPS);
+
+    arena.addNewCorrelation(1, corArena.xxt(0), corArena.xy(0), corArena.sumX(0), 2);
+    total.append(corStat.xxt.data(), corStat.xy, corStat.sumX, LinearL2StatOpParams());
+
+    // row of correlations is derived from total and the same correlations
+    LinearL2StatArena derived(1, maxSize);
+    arena.addNewCorrelation(2, corArena.xxt(0), corArena.xy(0), corArena.sumX(0), 2);
+    derived.addNewCorrelationDifference(0, arena, 1, arena, 2, 2);
+    arena.reset(2, 1);
+    derived.fill(0, 3, &stat);
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_NEAR(stat.xtx_[3 + i], 0, EPS);
+    }
+    EXPECT_NEAR(stat.xty_[2], 0, EPS);
+    EXPECT_NEAR(stat.sumX_[2], 0, EPS);
+
+    auto expectEqual = [](const LinearL2Stat& expected, const LinearL2Stat& actual, int size) {
+        EXPECT_NEAR(expected.w_, actual.w_, EPS);
+        EXPECT_NEAR(expected.sumY_, actual.sumY_, EPS);
+        EXPECT_NEAR(expected.sumY2_, actual.sumY2_, EPS);
+        auto expectedXTX = expected.getXTX(0., size);
+        auto actualXTX = actual.getXTX(0., size);
+        auto expectedXTy = expected.getXTy(size);
+        auto actualXTy = actual.getXTy(size);
+        for (int i = 0; i < size; ++i) {
+            EXPECT_NEAR(expectedXTy(i, 0), actualXTy(i, 0), EPS);
+            for (int j = 0; j < size; ++j) {
+                EXPECT_NEAR(expectedXTX(i, j), actualXTX(i, j), 1e-4);
+            }
+        }
+    };
+
+    arena.fill(1, 3, &stat);
+    expectEqual(total, stat, 3);
+
+    arena.fillDifference(1, 0, 2, &stat);
+    expectEqual(total - first, stat, 2);
+
+    // ops on ranges of cells
+    arena.add(2, arena, 0, 1);
+    arena.addDifference(2, arena, 1, arena, 0, 1, 2);
+    arena.fill(2, 2, &stat);
+    expectEqual(total, stat, 2);
+    EXPECT_NEAR(arena.weight(2), total.w_, EPS);
+}
+
+TEST(AdditiveStatTest, LinearL2StatArenasOfDifferentSize) {
+    std::vector<std::vector<float>> x = {
+            {1, 2, 3},
+            {1, 0.2, 0.3},
+            {1, .45, 13},
+            {1, 3, -.2},
+    };
+    std::vector<float> y = {1, -2, 0.5, 3};
+
+    // cell 0 has all samples, cell 1 has first two
+    LinearL2StatArena large(2, 4);
+    for (int i = 0; i < (int)x.size(); ++i) {
+        large.addFullCorrelation(0, x[i].data(), y[i], 1, 3);
+        if (i < 2) {
+            large.addFullCorrelation(1, x[i].data(), y[i], 1, 3);
+        }
+    }
+
+    LinearL2Stat expected(4, 0);
+    LinearL2Stat actual(4, 0);
+    auto expectEqual = [&](int size) {
+        EXPECT_NEAR(expected.w_, actual.w_, EPS);
+        EXPECT_NEAR(expected.sumY_, actual.sumY_, EPS);
+        EXPECT_NEAR(expected.sumY2_, actual.sumY2_, EPS);
+        for (int i = 0; i < size; ++i) {
+            EXPECT_NEAR(expected.sumX_[i], actual.sumX_[i], EPS);
+            EXPECT_NEAR(expected.xty_[i], actual.xty_[i], EPS);
+        }
+        for (int i = 0; i < size * (size + 1) / 2; ++i) {
+            EXPECT_NEAR(expected.xtx_[i], actual.xtx_[i], EPS);
+        }
+    };
+
+    // common prefix of two features is copied
+    LinearL2StatArena small(2, 2);
+    small.copy(0, large, 0, 2);
+    large.fill(0, 2, &expected);
+    small.fill(0, 2, &actual);
+    expectEqual(2);
+
+    // difference of large cells is added to small one only for its features
+    small.reset(1, 1);
+    small.addDifference(1, large, 0, large, 1, 1, 2);
+    large.fillDifference(0, 1, 2, &expected);
+    small.fill(1, 2, &actual);
+    expectEqual(2);
+
+    // larger arena gets zero tail
+    LinearL2StatArena wide(1, 4);
+    wide.addFullCorrelation(0, x[0].data(), y[0], 1, 3);
+    wide.copy(0, small, 0, 1);
+    wide.fill(0, 3, &actual);
+    EXPECT_NEAR(actual.sumX_[2], 0, EPS);
+    EXPECT_NEAR(actual.xty_[2], 0, EPS);
+    for (int i = 3; i < 6; ++i) {
+        EXPECT_NEAR(actual.xtx_[i], 0, EPS);
+    }
+}
+
+TEST(AdditiveStatTest, LinearL2StatBatchScore) {
+    const int maxSize = 3;
+    std::vector<std::vector<float>> x = {
+            {1, 2, 3},
+            {1, 0.2, 0.3},
+            {1, .45, 13},
+            {1, 3, -.2},
+            {1, 3, 3.3},
+            {1, -1, 0.7},
+    };
+    std::vector<float> y = {1, -2, 0.5, 3, 0.1, 2};
+
+    // prefix stats: cell i has first i + 1 samples
+    LinearL2StatArena arena(x.size(), maxSize);
+    for (int cell = 0; cell < (int)x.size(); ++cell) {
+        for (int i = 0; i <= cell; ++i) {
+            arena.addFullCorrelation(cell, x[i].data(), y[i], 1, maxSize);
+        }
+    }
+
+    LinearL2LogScore scoreFunction(0.5);
+    LinearL2StatBatch batch(2 * x.size(), maxSize);
+    LinearL2Stat stat(maxSize, 0);
+    for (int size = 1; size <= maxSize; ++size) {
+        batch.clear(size);
+        std::vector<double> expected;
+        const int64_t last = x.size() - 1;
+        for (int cell = 0; cell < (int)x.size(); ++cell) {
+            batch.add(arena, cell);
+            arena.fill(cell, size, &stat);
+            expected.push_back(scoreFunction.score(stat));
+
+            batch.addDifference(arena, last, cell);
+            arena.fillDifference(last, cell, size, &stat);
+            expected.push_back(scoreFunction.score(stat));
+        }
+
+        std::vector<double> scores(batch.count());
+        scoreFunction.scoreBatch(batch, scores.data());
+        for (int i = 0; i < (int)scores.size(); ++i) {
+            EXPECT_NEAR(scores[i], expected[i], 1e-3);
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#include "fast_exp.h"
+
+#include <cmath>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define FAST_EXP_X86_SIMD
+#include <immintrin.h>
+#endif
+
+#ifdef FAST_EXP_X86_SIMD
+
+namespace {
+
+    //cephes expf: exp(x) = 2^n * exp(r), |r| <= ln(2) / 2, relative error ~1e-7. inputs are clamped to finite range
+    __attribute__((target("avx2,fma")))
+    void expAvx2(float* x, int64_t size) {
+        const __m256 maxArg = _mm256_set1_ps(88.3762626647949f);
+        const __m256 minArg = _mm256_set1_ps(-88.3762626647949f);
+        const __m256 log2e = _mm256_set1_ps(1.44269504088896341f);
+        const __m256 ln2Hi = _mm256_set1_ps(0.693359375f);
+        const __m256 ln2Lo = _mm256_set1_ps(-2.12194440e-4f);
+        const __m256 half = _mm256_set1_ps(0.5f);
+        const __m256 one = _mm256_set1_ps(1.0f);
+
+        int64_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            __m256 v = _mm256_loadu_ps(x + i);
+            v = _mm256_max_ps(_mm256_min_ps(v, maxArg), minArg);
+
+            const __m256 n = _mm256_floor_ps(_mm256_fmadd_ps(v, log2e, half));
+            v = _mm256_fnmadd_ps(n, ln2Hi, v);
+            v = _mm256_fnmadd_ps(n, ln2Lo, v);
+
+            const __m256 z = _mm256_mul_ps(v, v);
+            __m256 y = _mm256_set1_ps(1.9875691500E-4f);
+            y = _mm256_fmadd_ps(y, v, _mm256_set1_ps(1.3981999507E-3f));
+            y = _mm256_fmadd_ps(y, v, _mm256_set1_ps(8.3334519073E-3f));
+            y = _mm256_fmadd_ps(y, v, _mm256_set1_ps(4.1665795894E-2f));
+            y = _mm256_fmadd_ps(y, v, _mm256_set1_ps(1.6666665459E-1f));
+            y = _mm256_fmadd_ps(y, v, half);
+            y = _mm256_add_ps(_mm256_fmadd_ps(y, z, v), one);
+
+            __m256i pow2n = _mm256_add_epi32(_mm256_cvttps_epi32(n), _mm256_set1_epi32(127));
+            pow2n = _mm256_slli_epi32(pow2n, 23);
+            _mm256_storeu_ps(x + i, _mm256_mul_ps(y, _mm256_castsi256_ps(pow2n)));
+        }
+        for (; i < size; ++i) {
+            x[i] = std::exp(x[i]);
+        }
+    }
+
+    bool hasAvx2() {
+        static const bool result = []() {
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        }();
+        return result;
+    }
+
+}
+
+#endif
+
+void expInPlace(float* x, int64_t size) {
+#ifdef FAST_EXP_X86_SIMD
+    if (hasAvx2()) {
+        expAvx2(x, size);
+        return;
+    }
+#endif
+    for (int64_t i = 0; i < size; ++i) {
+        x[i] = std::exp(x[i]);
+    }
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <cstdint>
+
+//x[i] = exp(x[i]) with relative error ~1e-7, vectorized with avx2 when cpu supports it. inputs are clamped to [-88.37, 88.37]
+void expInPlace(float* x, int64_t size);
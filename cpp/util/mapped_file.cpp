@@ -0,0 +1,43 @@
+#include "mapped_file.h"
+#include "exception.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+MappedFile::MappedFile(const std::string& path)
+    : path_(path) {
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    VERIFY(fd >= 0, "Failed to open file " << path << ": " << std::strerror(errno));
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        const int error = errno;
+        ::close(fd);
+        VERIFY(false, "Failed to stat file " << path << ": " << std::strerror(error));
+    }
+    size_ = st.st_size;
+
+    if (size_ > 0) {
+        void* ptr = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (ptr == MAP_FAILED) {
+            const int error = errno;
+            ::close(fd);
+            VERIFY(false, "Failed to map file " << path << ": " << std::strerror(error));
+        }
+        data_ = static_cast<char*>(ptr);
+        ::madvise(data_, size_, MADV_WILLNEED);
+    }
+    //mapping keeps file alive
+    ::close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (data_) {
+        ::munmap(data_, size_);
+    }
+}
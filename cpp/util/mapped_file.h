@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/*
+ * Whole file mapped into memory. Pages are private copy-on-write,
+ * so owners of the mapping could modify them without touching the file
+ */
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    char* data() const {
+        return data_;
+    }
+
+    int64_t size() const {
+        return size_;
+    }
+
+    const std::string& path() const {
+        return path_;
+    }
+
+private:
+    std::string path_;
+    char* data_ = nullptr;
+    int64_t size_ = 0;
+};
+
+using MappedFilePtr = std::shared_ptr<MappedFile>;
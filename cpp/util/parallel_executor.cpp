@@ -1,11 +1,264 @@
 #include "parallel_executor.h"
 #include "singleton.h"
 
-//tiny wrapper for torch::thread_pool
-
+namespace {
+    //pool and queue of worker, which runs current thread
+    thread_local ThreadPool* CurrentPool = nullptr;
+    thread_local int64_t CurrentWorker = -1;
 
+    int64_t defaultThreadCount() {
+        return std::max<int64_t>(std::thread::hardware_concurrency(), 1);
+    }
+}
 
 ThreadPool::ThreadPool()
-    : pool_(std::thread::hardware_concurrency()) {
+    : ThreadPool(defaultThreadCount()) {
+
+}
+
+ThreadPool::ThreadPool(int64_t numThreads) {
+    numThreads = std::max<int64_t>(numThreads, 1);
+    for (int64_t i = 0; i < numThreads; ++i) {
+        queues_.emplace_back(new WorkerQueue());
+    }
+    for (int64_t i = 0; i < numThreads; ++i) {
+        workers_.emplace_back([this, i]() {
+            workerLoop(i);
+        });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(sleepLock_);
+        stop_ = true;
+    }
+    wakeUp_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+void ThreadPool::push(std::function<void()> task) {
+    ++unfinished_;
+    const bool fromOwnWorker = CurrentPool == this && CurrentWorker >= 0;
+    const uint64_t queueId = fromOwnWorker ? CurrentWorker : nextQueue_++ % queues_.size();
+    {
+        auto& queue = *queues_[queueId];
+        std::lock_guard<std::mutex> guard(queue.lock_);
+        queue.tasks_.push_back(std::move(task));
+    }
+    ++queued_;
+    {
+        std::lock_guard<std::mutex> guard(sleepLock_);
+    }
+    wakeUp_.notify_one();
+    //waiters help with pending tasks
+    waiters_.notify_all();
+}
+
+void ThreadPool::notifyWaiters() {
+    {
+        std::lock_guard<std::mutex> guard(sleepLock_);
+    }
+    waiters_.notify_all();
+}
+
+bool ThreadPool::popOrSteal(std::function<void()>* task) {
+    if (queued_.load() == 0) {
+        return false;
+    }
+    const int64_t queuesCount = static_cast<int64_t>(queues_.size());
+    const bool isOwnWorker = CurrentPool == this && CurrentWorker >= 0;
+
+    if (isOwnWorker) {
+        auto& queue = *queues_[CurrentWorker];
+        std::lock_guard<std::mutex> guard(queue.lock_);
+        if (!queue.tasks_.empty()) {
+            *task = std::move(queue.tasks_.back());
+            queue.tasks_.pop_back();
+            --queued_;
+            return true;
+        }
+    }
+
+    const int64_t first = isOwnWorker ? CurrentWorker + 1 : 0;
+    for (int64_t k = 0; k < queuesCount; ++k) {
+        auto& queue = *queues_[(first + k) % queuesCount];
+        std::lock_guard<std::mutex> guard(queue.lock_);
+        if (!queue.tasks_.empty()) {
+            *task = std::move(queue.tasks_.front());
+            queue.tasks_.pop_front();
+            --queued_;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::run(std::function<void()>& task) {
+    try {
+        task();
+    } catch (...) {
+        std::lock_guard<std::mutex> guard(errorLock_);
+        if (!error_) {
+            error_ = std::current_exception();
+        }
+    }
+    task = nullptr;
+    if (--unfinished_ == 0) {
+        notifyWaiters();
+    }
+}
+
+bool ThreadPool::tryRunPendingTask() {
+    std::function<void()> task;
+    if (!popOrSteal(&task)) {
+        return false;
+    }
+    run(task);
+    return true;
+}
+
+void ThreadPool::waitComplete() {
+    waitFor([&]() {
+        return unfinished_.load() == 0;
+    });
+
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> guard(errorLock_);
+        std::swap(error, error_);
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void ThreadPool::workerLoop(int64_t workerId) {
+    CurrentPool = this;
+    CurrentWorker = workerId;
+
+    std::function<void()> task;
+    while (true) {
+        if (popOrSteal(&task)) {
+            run(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> guard(sleepLock_);
+        wakeUp_.wait(guard, [&]() {
+            return stop_.load() || queued_.load() > 0;
+        });
+        if (stop_.load() && queued_.load() == 0) {
+            return;
+        }
+    }
+}
+
+TaskGroup::~TaskGroup() {
+    try {
+        wait();
+    } catch (...) {
+        //already reported by the first wait
+    }
+}
+
+void TaskGroup::wait() {
+    pool_.waitFor([&]() {
+        return pending_.load() == 0;
+    });
+
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        std::swap(error, error_);
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+SerialExecutor::SerialExecutor(int64_t maxQueued)
+    : maxQueued_(std::max<int64_t>(maxQueued, 1)) {
+    worker_ = std::thread([this]() {
+        workerLoop();
+    });
+}
+
+SerialExecutor::~SerialExecutor() {
+    {
+        std::unique_lock<std::mutex> guard(lock_);
+        changed_.wait(guard, [&]() {
+            return tasks_.empty() && !running_;
+        });
+        stop_ = true;
+    }
+    changed_.notify_all();
+    worker_.join();
+}
+
+void SerialExecutor::push(std::function<void()> task) {
+    {
+        std::unique_lock<std::mutex> guard(lock_);
+        changed_.wait(guard, [&]() {
+            return static_cast<int64_t>(tasks_.size()) < maxQueued_ || error_;
+        });
+        rethrowError();
+        tasks_.push_back(std::move(task));
+    }
+    changed_.notify_all();
+}
+
+void SerialExecutor::wait() {
+    std::unique_lock<std::mutex> guard(lock_);
+    changed_.wait(guard, [&]() {
+        return tasks_.empty() && !running_;
+    });
+    rethrowError();
+}
+
+void SerialExecutor::rethrowError() {
+    if (error_) {
+        std::exception_ptr error;
+        std::swap(error, error_);
+        std::rethrow_exception(error);
+    }
+}
+
+void SerialExecutor::workerLoop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> guard(lock_);
+            changed_.wait(guard, [&]() {
+                return stop_ || !tasks_.empty();
+            });
+            if (tasks_.empty()) {
+                return;
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+            running_ = true;
+        }
+        changed_.notify_all();
+
+        std::exception_ptr error;
+        try {
+            task();
+        } catch (...) {
+            error = std::current_exception();
+        }
+        task = nullptr;
 
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            running_ = false;
+            if (error && !error_) {
+                error_ = error;
+                //tasks after failed one see inconsistent state
+                tasks_.clear();
+            }
+        }
+        changed_.notify_all();
+    }
 }
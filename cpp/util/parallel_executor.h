@@ -3,32 +3,98 @@
 #include "singleton.h"
 #include "semaphore.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
+#include <exception>
 #include <functional>
-#include <utility>
-
-#include <c10/core/thread_pool.h>
+#include <memory>
+#include <mutex>
 #include <thread>
+#include <utility>
+#include <vector>
 
+/*
+ * Work-stealing pool: every worker owns a deque, tasks enqueued from worker go to its own deque (LIFO for owner),
+ * idle workers steal from the other end of others' deques.
+ * Threads waiting for tasks (TaskGroup::wait, waitComplete) execute pending tasks meanwhile,
+ * so nested parallelFor doesn't deadlock and doesn't leave cores idle. Waiters sleep until some task is pushed
+ * or their condition could have changed
+ */
 class ThreadPool {
 public:
     ThreadPool();
 
+    explicit ThreadPool(int64_t numThreads);
+
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
     template <class Task>
     void enqueue(Task&& task) {
-        pool_.run(std::forward<Task>(task));
+        push(std::function<void()>(std::forward<Task>(task)));
     }
 
-    void waitComplete() {
-        pool_.waitWorkComplete();
-    }
+    //waits for all tasks in pool (not only enqueued by caller): prefer TaskGroup
+    void waitComplete();
 
     int64_t numThreads() const {
-        return pool_.size();
+        return static_cast<int64_t>(workers_.size());
+    }
+
+    //executes one pending task in calling thread. false if there is nothing to do
+    bool tryRunPendingTask();
+
+    //runs pending tasks until ready() is true. ready should become true only together with notifyWaiters call
+    template <class Ready>
+    void waitFor(Ready&& ready) {
+        while (!ready()) {
+            if (tryRunPendingTask()) {
+                continue;
+            }
+            std::unique_lock<std::mutex> guard(sleepLock_);
+            waiters_.wait(guard, [&]() {
+                return ready() || queued_.load() > 0;
+            });
+        }
     }
+
+    void notifyWaiters();
+
+private:
+    struct WorkerQueue {
+        std::mutex lock_;
+        std::deque<std::function<void()>> tasks_;
+    };
+
+    void push(std::function<void()> task);
+
+    bool popOrSteal(std::function<void()>* task);
+
+    void run(std::function<void()>& task);
+
+    void workerLoop(int64_t workerId);
+
 private:
+    std::vector<std::unique_ptr<WorkerQueue>> queues_;
+    std::vector<std::thread> workers_;
 
-    c10::ThreadPool pool_;
+    std::mutex sleepLock_;
+    std::condition_variable wakeUp_;
+    std::condition_variable waiters_;
+
+    std::atomic<int64_t> queued_{0};
+    std::atomic<int64_t> unfinished_{0};
+    std::atomic<uint64_t> nextQueue_{0};
+    std::atomic<bool> stop_{false};
+
+    std::mutex errorLock_;
+    std::exception_ptr error_;
 };
 
 template <int N = 0>
@@ -36,68 +102,196 @@ inline ThreadPool& GlobalThreadPool() {
     return Singleton<ThreadPool, N>();
 }
 
-template <class Task>
-inline void parallelForInThreadPool(ThreadPool& pool, int64_t from, int64_t to, Task&& task, bool parallel = true,
-                                    decltype(std::declval<Task>()(1, 1))* unused = NULL) {
-    const int64_t numBlocks = pool.numThreads();
-    const int64_t blockSize = (to - from + numBlocks - 1) / numBlocks;
-
-//    Semaphore sema;
-//    SemaphoreAcquireGuard sag(sema, to - from);
-
-    for (int64_t blockId = 0; blockId < numBlocks; ++blockId) {
-        const int64_t startBlock = std::min<int64_t>(blockId * blockSize, to);
-        const int64_t endBlock = std::min<int64_t>((blockId + 1) * blockSize, to);
-        if (startBlock != endBlock) {
-            if (parallel) {
-                pool.enqueue([startBlock, endBlock, blockId, &task] {
-//                    SemaphoreReleaseGuard srg(sema, endBlock - startBlock);
-                    for (int64_t i = startBlock; i < endBlock; ++i) {
-                        task(blockId, i);
-                    }
-                });
-            } else {
-//                SemaphoreReleaseGuard srg(sema, endBlock - startBlock);
-                for (int64_t i = startBlock; i < endBlock; ++i) {
-                    task(blockId, i);
+/*
+ * Tasks which could be waited independently from other pool users
+ *
+ * TaskGroup group;
+ * group.run([&] { ... });
+ * group.wait();
+ */
+class TaskGroup {
+public:
+    explicit TaskGroup(ThreadPool& pool = GlobalThreadPool<0>())
+        : pool_(pool) {
+
+    }
+
+    ~TaskGroup();
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    template <class Task>
+    void run(Task&& task) {
+        ++pending_;
+        pool_.enqueue([this, task = std::forward<Task>(task)]() mutable {
+            std::exception_ptr error;
+            try {
+                task();
+            } catch (...) {
+                error = std::current_exception();
+            }
+            if (error) {
+                std::lock_guard<std::mutex> guard(lock_);
+                if (!error_) {
+                    error_ = error;
+                }
+            }
+            //waiter may destroy group right after pending_ becomes zero: don't touch members after it
+            ThreadPool& pool = pool_;
+            if (--pending_ == 0) {
+                pool.notifyWaiters();
+            }
+        });
+    }
+
+    //helps pool while waiting, rethrows first exception of group tasks
+    void wait();
+
+private:
+    ThreadPool& pool_;
+    std::atomic<int64_t> pending_{0};
+    std::mutex lock_;
+    std::exception_ptr error_;
+};
+
+/*
+ * Runs tasks one by one in its own thread, in order of run calls.
+ * At most maxQueued tasks wait for execution: run blocks until there is room, so producer is slowed down
+ * to consumer speed and tasks are never dropped.
+ * First exception of tasks is rethrown from next run or wait, remaining tasks are skipped after it
+ */
+class SerialExecutor {
+public:
+    explicit SerialExecutor(int64_t maxQueued = 1);
+
+    //waits for queued tasks
+    ~SerialExecutor();
+
+    SerialExecutor(const SerialExecutor&) = delete;
+    SerialExecutor& operator=(const SerialExecutor&) = delete;
+
+    template <class Task>
+    void run(Task&& task) {
+        push(std::function<void()>(std::forward<Task>(task)));
+    }
+
+    //waits until all queued tasks are done
+    void wait();
+
+private:
+    void push(std::function<void()> task);
+
+    void workerLoop();
+
+    void rethrowError();
+
+private:
+    int64_t maxQueued_;
+    std::deque<std::function<void()>> tasks_;
+    bool running_ = false;
+    bool stop_ = false;
+    std::exception_ptr error_;
+
+    std::mutex lock_;
+    std::condition_variable changed_;
+    std::thread worker_;
+};
+
+namespace Detail {
+
+    //in dynamic mode every block grabs chunks from shared cursor, so skewed work is balanced between threads
+    constexpr int64_t ChunksPerBlock = 8;
+
+    //chunkTask(blockId, first, last); blockId < pool.numThreads() and no two running chunks share blockId.
+    //static mode gives block blockId the same contiguous range on every run, so partials indexed by blockId
+    //are summed in the same order for fixed number of threads. Dynamic mode balances load, but ranges of block vary
+    template <class ChunkTask>
+    inline void parallelForChunks(ThreadPool& pool, int64_t from, int64_t to, ChunkTask&& chunkTask, bool dynamic) {
+        const int64_t size = to - from;
+        if (size <= 0) {
+            return;
+        }
+        const int64_t numBlocks = std::max<int64_t>(std::min<int64_t>(pool.numThreads(), size), 1);
+        const int64_t grain = dynamic
+                              ? std::max<int64_t>(size / (numBlocks * ChunksPerBlock), 1)
+                              : (size + numBlocks - 1) / numBlocks;
+
+        std::atomic<int64_t> cursor(from);
+        auto runBlock = [&](int64_t blockId) {
+            if (!dynamic) {
+                const int64_t first = std::min<int64_t>(from + blockId * grain, to);
+                const int64_t last = std::min<int64_t>(first + grain, to);
+                if (first < last) {
+                    chunkTask(blockId, first, last);
                 }
+                return;
             }
+            while (true) {
+                const int64_t first = cursor.fetch_add(grain);
+                if (first >= to) {
+                    break;
+                }
+                chunkTask(blockId, first, std::min<int64_t>(first + grain, to));
+            }
+        };
+
+        if (numBlocks == 1) {
+            runBlock(0);
+            return;
+        }
+
+        TaskGroup group(pool);
+        for (int64_t blockId = 1; blockId < numBlocks; ++blockId) {
+            group.run([&runBlock, blockId]() {
+                runBlock(blockId);
+            });
+        }
+        //caller is one of workers
+        std::exception_ptr error;
+        try {
+            runBlock(0);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        group.wait();
+        if (error) {
+            std::rethrow_exception(error);
         }
     }
+}
 
-    pool.waitComplete();
+template <class Task>
+inline void parallelForInThreadPool(ThreadPool& pool, int64_t from, int64_t to, Task&& task, bool parallel = true,
+                                    decltype(std::declval<Task>()(1, 1))* unused = NULL) {
+    if (!parallel) {
+        for (int64_t i = from; i < to; ++i) {
+            task(0, i);
+        }
+        return;
+    }
+    //callers accumulate into per block state: keep ranges of blocks fixed
+    Detail::parallelForChunks(pool, from, to, [&task](int64_t blockId, int64_t first, int64_t last) {
+        for (int64_t i = first; i < last; ++i) {
+            task(blockId, i);
+        }
+    }, false);
 }
 
 template <class Task>
 inline void parallelForInThreadPool(ThreadPool& pool, int64_t from, int64_t to, Task&& task, bool parallel = true,
                                     decltype(std::declval<Task>()(1))* unused = NULL) {
-    const int64_t numBlocks = pool.numThreads();
-    const int64_t blockSize = (to - from + numBlocks - 1) / numBlocks;
-
-//    Semaphore sema;
-//    SemaphoreAcquireGuard sag(sema, to - from);
-
-    for (int64_t blockId = 0; blockId < numBlocks; ++blockId) {
-        const int64_t startBlock = std::min<int64_t>(blockId * blockSize, to);
-        const int64_t endBlock = std::min<int64_t>((blockId + 1) * blockSize, to);
-        if (startBlock != endBlock) {
-            if (parallel) {
-                pool.enqueue([startBlock, endBlock, &task] {
-//                    SemaphoreReleaseGuard srg(sema, endBlock - startBlock);
-                    for (int64_t i = startBlock; i < endBlock; ++i) {
-                        task(i);
-                    }
-                });
-            } else {
-//                SemaphoreReleaseGuard srg(sema, endBlock - startBlock);
-                for (int64_t i = startBlock; i < endBlock; ++i) {
-                    task(i);
-                }
-            }
+    if (!parallel) {
+        for (int64_t i = from; i < to; ++i) {
+            task(i);
         }
+        return;
     }
-
-    pool.waitComplete();
+    Detail::parallelForChunks(pool, from, to, [&task](int64_t, int64_t first, int64_t last) {
+        for (int64_t i = first; i < last; ++i) {
+            task(i);
+        }
+    }, true);
 }
 
 template <class Task>
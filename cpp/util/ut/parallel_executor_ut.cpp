@@ -0,0 +1,167 @@
+#include <util/parallel_executor.h>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+TEST(ThreadPoolTest, NestedParallelFor) {
+    ThreadPool pool(2);
+    std::vector<int64_t> sums(16);
+    parallelForInThreadPool(pool, 0, 16, [&](int64_t i) {
+        std::atomic<int64_t> sum(0);
+        parallelForInThreadPool(pool, 0, 1000, [&](int64_t j) {
+            sum += j;
+        });
+        sums[i] = sum.load();
+    });
+    for (auto sum : sums) {
+        EXPECT_EQ(sum, 999 * 1000 / 2);
+    }
+}
+
+TEST(ThreadPoolTest, BlocksAreStatic) {
+    ThreadPool pool(4);
+    std::vector<int64_t> firstRun(1000);
+    std::vector<int64_t> secondRun(1000);
+    parallelForInThreadPool(pool, 0, 1000, [&](int blockId, int64_t i) {
+        firstRun[i] = blockId;
+    });
+    parallelForInThreadPool(pool, 0, 1000, [&](int blockId, int64_t i) {
+        secondRun[i] = blockId;
+    });
+    EXPECT_EQ(firstRun, secondRun);
+    for (int64_t i = 1; i < 1000; ++i) {
+        EXPECT_LE(firstRun[i - 1], firstRun[i]);
+    }
+}
+
+TEST(ThreadPoolTest, TaskGroupRethrows) {
+    ThreadPool pool(2);
+    std::atomic<int64_t> done(0);
+    TaskGroup group(pool);
+    for (int i = 0; i < 10; ++i) {
+        group.run([&, i]() {
+            if (i == 3) {
+                throw std::runtime_error("task failed");
+            }
+            ++done;
+        });
+    }
+    EXPECT_THROW(group.wait(), std::runtime_error);
+    EXPECT_EQ(done.load(), 9);
+
+    //error is reported once
+    group.run([&]() {
+        ++done;
+    });
+    group.wait();
+    EXPECT_EQ(done.load(), 10);
+}
+
+TEST(ThreadPoolTest, ParallelForRethrows) {
+    ThreadPool pool(2);
+    EXPECT_THROW(parallelForInThreadPool(pool, 0, 100, [&](int64_t i) {
+        if (i == 50) {
+            throw std::runtime_error("iteration failed");
+        }
+    }), std::runtime_error);
+}
+
+TEST(ThreadPoolTest, WaiterRunsPendingTasks) {
+    //the only worker is blocked until task, which could be run only by waiter, is done
+    ThreadPool pool(1);
+    std::atomic<bool> workerBlocked(false);
+    std::atomic<bool> released(false);
+
+    TaskGroup blocker(pool);
+    blocker.run([&]() {
+        workerBlocked = true;
+        while (!released.load()) {
+            std::this_thread::yield();
+        }
+    });
+    while (!workerBlocked.load()) {
+        std::this_thread::yield();
+    }
+
+    TaskGroup group(pool);
+    group.run([&]() {
+        released = true;
+    });
+    group.wait();
+    blocker.wait();
+    EXPECT_TRUE(released.load());
+}
+
+TEST(SerialExecutorTest, RunsInOrder) {
+    SerialExecutor executor(2);
+    std::vector<int> order;
+    for (int i = 0; i < 100; ++i) {
+        executor.run([&order, i]() {
+            order.push_back(i);
+        });
+    }
+    executor.wait();
+    ASSERT_EQ(order.size(), 100u);
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(order[i], i);
+    }
+}
+
+TEST(SerialExecutorTest, QueueIsBounded) {
+    SerialExecutor executor(1);
+    std::atomic<bool> released(false);
+    std::atomic<bool> started(false);
+    executor.run([&]() {
+        started = true;
+        while (!released.load()) {
+            std::this_thread::yield();
+        }
+    });
+    while (!started.load()) {
+        std::this_thread::yield();
+    }
+    //fills the queue
+    executor.run([]() {});
+
+    std::atomic<bool> pushed(false);
+    std::thread producer([&]() {
+        executor.run([]() {});
+        pushed = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_FALSE(pushed.load());
+
+    released = true;
+    producer.join();
+    EXPECT_TRUE(pushed.load());
+    executor.wait();
+}
+
+TEST(SerialExecutorTest, RethrowsAndSkipsAfterError) {
+    SerialExecutor executor(4);
+    std::atomic<bool> released(false);
+    std::atomic<int64_t> done(0);
+    executor.run([&]() {
+        while (!released.load()) {
+            std::this_thread::yield();
+        }
+        throw std::runtime_error("listener failed");
+    });
+    executor.run([&]() {
+        ++done;
+    });
+    released = true;
+    EXPECT_THROW(executor.wait(), std::runtime_error);
+    EXPECT_EQ(done.load(), 0);
+
+    //executor is usable after error was reported
+    executor.run([&]() {
+        ++done;
+    });
+    executor.wait();
+    EXPECT_EQ(done.load(), 1);
+}